@@ -0,0 +1,167 @@
+//
+//  Animation.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "Animation.h"
+
+#include <algorithm>
+
+#pragma mark Interpolation
+
+// Finds the keys around time: index of the segment's first key and how far along it
+// we are. Holds the end keys outside of the keyframed range
+template< typename Keyframe >
+static void findSegment(const std::vector< Keyframe >& keyframes, float time, int* index, float* fraction)
+{
+    const int count = (int)keyframes.size();
+    if( count < 2 || time <= keyframes.front().time )
+    {
+        *index = 0;
+        *fraction = 0;
+        return;
+    }
+    if( time >= keyframes.back().time )
+    {
+        *index = count - 2;
+        *fraction = 1;
+        return;
+    }
+
+    const auto next = std::upper_bound( keyframes.begin(), keyframes.end(), time, [](float t, const Keyframe& keyframe) {
+        return t < keyframe.time;
+    });
+    *index = (int)( next - keyframes.begin() ) - 1;
+
+    const float duration = keyframes[ *index + 1 ].time - keyframes[ *index ].time;
+    *fraction = ( duration > 0 ) ? ( time - keyframes[ *index ].time ) / duration : 0;
+}
+
+// Uniform Catmull-Rom between p1 and p2
+static float3 catmullRom(const float3& p0, const float3& p1, const float3& p2, const float3& p3, float t)
+{
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    return 0.5f * ( 2.0f * p1 + ( p2 - p0 ) * t + ( 2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 ) * t2 + ( 3.0f * p1 - p0 - 3.0f * p2 + p3 ) * t3 );
+}
+
+template< typename Keyframe >
+static void insertSorted(std::vector< Keyframe >& keyframes, const Keyframe& keyframe)
+{
+    const auto position = std::upper_bound( keyframes.begin(), keyframes.end(), keyframe, [](const Keyframe& a, const Keyframe& b) {
+        return a.time < b.time;
+    });
+    keyframes.insert( position, keyframe );
+}
+
+#pragma mark CameraPath Class
+
+void CameraPath::addKeyframe(const Keyframe& keyframe)
+{
+    insertSorted( _keyframes, keyframe );
+}
+
+const std::vector< CameraPath::Keyframe >& CameraPath::keyframes() const
+{
+    return _keyframes;
+}
+
+CameraPath::Keyframe CameraPath::keyframeAt(float time) const
+{
+    if( _keyframes.size() < 2 )
+        return _keyframes.empty() ? Keyframe() : _keyframes.front();
+
+    int index;
+    float t;
+    findSegment( _keyframes, time, &index, &t );
+
+    const int count = (int)_keyframes.size();
+    const Keyframe& k0 = _keyframes[ std::max( index - 1, 0 ) ];
+    const Keyframe& k1 = _keyframes[ index ];
+    const Keyframe& k2 = _keyframes[ index + 1 ];
+    const Keyframe& k3 = _keyframes[ std::min( index + 2, count - 1 ) ];
+
+    Keyframe keyframe;
+    keyframe.time = time;
+    keyframe.position = catmullRom( k0.position, k1.position, k2.position, k3.position, t );
+    keyframe.target = catmullRom( k0.target, k1.target, k2.target, k3.target, t );
+    keyframe.up = simd_normalize( simd_mix( k1.up, k2.up, simd_make_float3( t, t, t ) ) );
+    keyframe.fovy = k1.fovy + ( k2.fovy - k1.fovy ) * t;
+    keyframe.aperature = k1.aperature + ( k2.aperature - k1.aperature ) * t;
+    keyframe.focusDistance = k1.focusDistance + ( k2.focusDistance - k1.focusDistance ) * t;
+    return keyframe;
+}
+
+Camera CameraPath::cameraAt(float time, int2 resolution) const
+{
+    const Keyframe keyframe = keyframeAt( time );
+    return Camera( resolution, keyframe.position, keyframe.target, keyframe.up, keyframe.fovy,
+                   keyframe.aperature, keyframe.focusDistance );
+}
+
+CameraPath CameraPath::turntable(float3 target, float radius, float height, float duration, float fovy)
+{
+    // Enough keys that the spline stays close to the circle
+    const int keyCount = 16;
+
+    CameraPath path;
+    for( int i = 0; i <= keyCount; i++ )
+    {
+        const float angle = 2.0 * M_PI * i / keyCount;
+
+        Keyframe keyframe;
+        keyframe.time = duration * i / keyCount;
+        keyframe.position = target + simd_make_float3( radius * sin( angle ), height, radius * cos( angle ) );
+        keyframe.target = target;
+        keyframe.fovy = fovy;
+        keyframe.focusDistance = simd_length( keyframe.position - target );
+        path.addKeyframe( keyframe );
+    }
+    return path;
+}
+
+#pragma mark ObjectTrack Class
+
+ObjectTrack::ObjectTrack(Sphere* sphere)
+{
+    _sphere = sphere;
+}
+
+Sphere* ObjectTrack::sphere() const
+{
+    return _sphere;
+}
+
+void ObjectTrack::addKeyframe(const Keyframe& keyframe)
+{
+    insertSorted( _keyframes, keyframe );
+}
+
+void ObjectTrack::apply(float time) const
+{
+    if( _keyframes.empty() )
+        return;
+
+    if( _keyframes.size() < 2 )
+    {
+        _sphere->setPosition( _keyframes.front().position );
+        _sphere->setRadius( _keyframes.front().radius );
+        return;
+    }
+
+    int index;
+    float t;
+    findSegment( _keyframes, time, &index, &t );
+
+    const int count = (int)_keyframes.size();
+    const Keyframe& k0 = _keyframes[ std::max( index - 1, 0 ) ];
+    const Keyframe& k1 = _keyframes[ index ];
+    const Keyframe& k2 = _keyframes[ index + 1 ];
+    const Keyframe& k3 = _keyframes[ std::min( index + 2, count - 1 ) ];
+
+    _sphere->setPosition( catmullRom( k0.position, k1.position, k2.position, k3.position, t ) );
+    _sphere->setRadius( k1.radius + ( k2.radius - k1.radius ) * t );
+}
@@ -0,0 +1,76 @@
+//
+//  Animation.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef Animation_h
+#define Animation_h
+
+#include <vector>
+
+#include "Raytracer.h"
+
+// Keyframed camera. Positions and targets follow a Catmull-Rom spline through the
+// keys so flythroughs don't jerk at each one; the lens settings are interpolated
+// linearly. Before the first key / after the last, the end keys hold.
+class CameraPath
+{
+public:
+
+    struct Keyframe
+    {
+        float time = 0; // Seconds
+        float3 position = simd_make_float3( 0, 0, 0 );
+        float3 target = simd_make_float3( 0, 0, -1 );
+        float3 up = simd_make_float3( 0, 1, 0 );
+        float fovy = 60;
+        float aperature = 0;
+        float focusDistance = 1;
+    };
+
+    // Keys may be added in any order
+    void addKeyframe(const Keyframe& keyframe);
+    const std::vector< Keyframe >& keyframes() const;
+
+    Keyframe keyframeAt(float time) const;
+    Camera cameraAt(float time, int2 resolution) const;
+
+    // A camera circling target at the given radius and height, one turn over duration
+    static CameraPath turntable(float3 target, float radius, float height, float duration, float fovy);
+
+private:
+
+    std::vector< Keyframe > _keyframes; // Sorted by time
+};
+
+// Keyframed position and radius of one sphere, same interpolation as the camera
+class ObjectTrack
+{
+public:
+
+    struct Keyframe
+    {
+        float time = 0;
+        float3 position = simd_make_float3( 0, 0, 0 );
+        float radius = 1;
+    };
+
+    ObjectTrack(Sphere* sphere);
+
+    Sphere* sphere() const;
+
+    void addKeyframe(const Keyframe& keyframe);
+
+    // Moves the sphere to where it is at the given time
+    void apply(float time) const;
+
+private:
+
+    Sphere* _sphere;
+    std::vector< Keyframe > _keyframes;
+};
+
+#endif /* Animation_h */
@@ -0,0 +1,304 @@
+//
+//  BVH.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "BVH.h"
+#include "Raytracer.h"
+
+#include <algorithm>
+#include <limits>
+
+// Tuning: SAH bins per axis, and the most shapes we'll leave in a leaf
+static const int kBinCount = 12;
+static const int kMaxLeafSize = 2;
+
+// Deeper than this and leaves just get bigger; keeps the traversal stack bounded
+static const int kMaxDepth = 48;
+static const int kStackSize = kMaxDepth + 2;
+
+// Relative cost of stepping into a node vs. testing a shape
+static const float kTraversalCost = 1.0f;
+static const float kIntersectionCost = 1.0f;
+
+#pragma mark AABB Struct
+
+void AABB::grow(const AABB& box)
+{
+    min = simd_min( min, box.min );
+    max = simd_max( max, box.max );
+}
+
+void AABB::grow(const float3& point)
+{
+    min = simd_min( min, point );
+    max = simd_max( max, point );
+}
+
+float3 AABB::center() const
+{
+    return ( min + max ) * 0.5f;
+}
+
+float AABB::surfaceArea() const
+{
+    if( min.x > max.x )
+        return 0;
+
+    const float3 size = max - min;
+    return 2.0f * ( size.x * size.y + size.y * size.z + size.z * size.x );
+}
+
+bool AABB::hitTest(const float3& origin, const float3& inverseDirection, float tmin, float tmax) const
+{
+    const float3 t0 = ( min - origin ) * inverseDirection;
+    const float3 t1 = ( max - origin ) * inverseDirection;
+    const float3 tNear = simd_min( t0, t1 );
+    const float3 tFar = simd_max( t0, t1 );
+
+    tmin = std::max( tmin, std::max( tNear.x, std::max( tNear.y, tNear.z ) ) );
+    tmax = std::min( tmax, std::min( tFar.x, std::min( tFar.y, tFar.z ) ) );
+    return tmin <= tmax;
+}
+
+#pragma mark BVH Class
+
+BVH::BVH(const std::vector< IHittable* >& shapes)
+{
+    build( shapes );
+}
+
+void BVH::build(const std::vector< IHittable* >& shapes)
+{
+    _nodes.clear();
+    _shapeIndices.resize( shapes.size() );
+    _shapeBounds.resize( shapes.size() );
+    for( size_t i = 0; i < shapes.size(); i++ )
+    {
+        _shapeIndices[ i ] = (int)i;
+        _shapeBounds[ i ] = shapes[ i ]->bounds();
+    }
+
+    // No nodes at all for an empty scene: count 0 means internal
+    _buildCost = 0;
+    if( shapes.empty() )
+        return;
+
+    // Binary tree with leaves of at least one shape: under 2n nodes
+    _nodes.reserve( shapes.size() * 2 );
+
+    Node root;
+    root.firstChild = 0;
+    root.count = (int)shapes.size();
+    for( const AABB& box : _shapeBounds )
+        root.bounds.grow( box );
+    _nodes.push_back( root );
+
+    subdivide( 0, 0 );
+
+    _buildCost = cost();
+}
+
+void BVH::subdivide(int nodeIndex, int depth)
+{
+    const Node node = _nodes[ nodeIndex ];
+    if( node.count <= kMaxLeafSize || depth >= kMaxDepth )
+        return;
+
+    // Bin on centroids, not on the boxes themselves
+    AABB centroidBounds;
+    for( int i = node.firstChild; i < node.firstChild + node.count; i++ )
+        centroidBounds.grow( _shapeBounds[ _shapeIndices[ i ] ].center() );
+
+    // Find the cheapest split plane across all three axes
+    float bestCost = kIntersectionCost * node.count;
+    int bestAxis = -1;
+    float bestSplit = 0;
+    for( int axis = 0; axis < 3; axis++ )
+    {
+        const float axisMin = centroidBounds.min[ axis ];
+        const float axisMax = centroidBounds.max[ axis ];
+        if( axisMax <= axisMin )
+            continue;
+
+        AABB binBounds[ kBinCount ];
+        int binCounts[ kBinCount ] = {};
+        const float scale = kBinCount / ( axisMax - axisMin );
+        for( int i = node.firstChild; i < node.firstChild + node.count; i++ )
+        {
+            const AABB& box = _shapeBounds[ _shapeIndices[ i ] ];
+            const int bin = std::min( kBinCount - 1, (int)( ( box.center()[ axis ] - axisMin ) * scale ) );
+            binBounds[ bin ].grow( box );
+            binCounts[ bin ]++;
+        }
+
+        // Sweep from the right to get the areas of every right hand side, then left to right
+        float rightAreas[ kBinCount ];
+        int rightCounts[ kBinCount ];
+        AABB right;
+        int rightCount = 0;
+        for( int bin = kBinCount - 1; bin > 0; bin-- )
+        {
+            right.grow( binBounds[ bin ] );
+            rightCount += binCounts[ bin ];
+            rightAreas[ bin ] = right.surfaceArea();
+            rightCounts[ bin ] = rightCount;
+        }
+
+        AABB left;
+        int leftCount = 0;
+        for( int bin = 0; bin < kBinCount - 1; bin++ )
+        {
+            left.grow( binBounds[ bin ] );
+            leftCount += binCounts[ bin ];
+            if( leftCount == 0 || rightCounts[ bin + 1 ] == 0 )
+                continue;
+
+            const float splitCost = kTraversalCost + kIntersectionCost *
+                ( left.surfaceArea() * leftCount + rightAreas[ bin + 1 ] * rightCounts[ bin + 1 ] ) / node.bounds.surfaceArea();
+            if( splitCost < bestCost )
+            {
+                bestCost = splitCost;
+                bestAxis = axis;
+                bestSplit = axisMin + ( bin + 1 ) / scale;
+            }
+        }
+    }
+
+    // Nothing beats testing every shape here: stay a leaf
+    if( bestAxis < 0 )
+        return;
+
+    int* begin = _shapeIndices.data() + node.firstChild;
+    int* middle = std::partition( begin, begin + node.count, [this, bestAxis, bestSplit](int shapeIndex) {
+        return _shapeBounds[ shapeIndex ].center()[ bestAxis ] < bestSplit;
+    });
+    const int leftCount = (int)( middle - begin );
+    if( leftCount == 0 || leftCount == node.count )
+        return;
+
+    Node leftNode;
+    leftNode.firstChild = node.firstChild;
+    leftNode.count = leftCount;
+    for( int i = leftNode.firstChild; i < leftNode.firstChild + leftNode.count; i++ )
+        leftNode.bounds.grow( _shapeBounds[ _shapeIndices[ i ] ] );
+
+    Node rightNode;
+    rightNode.firstChild = node.firstChild + leftCount;
+    rightNode.count = node.count - leftCount;
+    for( int i = rightNode.firstChild; i < rightNode.firstChild + rightNode.count; i++ )
+        rightNode.bounds.grow( _shapeBounds[ _shapeIndices[ i ] ] );
+
+    // Turn this node internal
+    const int childIndex = (int)_nodes.size();
+    _nodes[ nodeIndex ].firstChild = childIndex;
+    _nodes[ nodeIndex ].count = 0;
+    _nodes.push_back( leftNode );
+    _nodes.push_back( rightNode );
+
+    subdivide( childIndex, depth + 1 );
+    subdivide( childIndex + 1, depth + 1 );
+}
+
+void BVH::refit(const std::vector< IHittable* >& shapes)
+{
+    for( size_t i = 0; i < shapes.size(); i++ )
+        _shapeBounds[ i ] = shapes[ i ]->bounds();
+
+    // Children always come after their parents
+    for( int nodeIndex = (int)_nodes.size() - 1; nodeIndex >= 0; nodeIndex-- )
+    {
+        Node& node = _nodes[ nodeIndex ];
+        node.bounds = AABB();
+        if( node.count > 0 )
+        {
+            for( int i = node.firstChild; i < node.firstChild + node.count; i++ )
+                node.bounds.grow( _shapeBounds[ _shapeIndices[ i ] ] );
+        }
+        else
+        {
+            node.bounds.grow( _nodes[ node.firstChild ].bounds );
+            node.bounds.grow( _nodes[ node.firstChild + 1 ].bounds );
+        }
+    }
+}
+
+float BVH::cost() const
+{
+    // Probability of visiting a node is its area over the root's
+    const float rootArea = _nodes.empty() ? 0 : _nodes[ 0 ].bounds.surfaceArea();
+    if( rootArea <= 0 )
+        return 0;
+
+    float total = 0;
+    for( const Node& node : _nodes )
+    {
+        const float visit = node.bounds.surfaceArea() / rootArea;
+        total += visit * ( ( node.count > 0 ) ? kIntersectionCost * node.count : kTraversalCost );
+    }
+    return total;
+}
+
+float BVH::buildCost() const
+{
+    return _buildCost;
+}
+
+size_t BVH::shapeCount() const
+{
+    return _shapeIndices.size();
+}
+
+bool BVH::hitTest(const std::vector< IHittable* >& shapes, const Ray& ray, float tmin, float tmax, Hit* hit) const
+{
+    if( _nodes.empty() )
+        return false;
+
+    // Shapes measure hits along the normalized direction, so we do too
+    const float3 direction = simd_normalize( ray.dir );
+    const float3 inverseDirection = simd_make_float3( 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z );
+
+    // The closest hit so far bounds the rest of the search
+    float closest = tmax;
+    bool didHit = false;
+
+    int stack[ kStackSize ];
+    int stackSize = 0;
+    stack[ stackSize++ ] = 0;
+    while( stackSize > 0 )
+    {
+        const Node& node = _nodes[ stack[ --stackSize ] ];
+        if( node.bounds.hitTest( ray.pos, inverseDirection, tmin, closest ) == false )
+            continue;
+
+        if( node.count > 0 )
+        {
+            for( int i = node.firstChild; i < node.firstChild + node.count; i++ )
+            {
+                const int shapeIndex = _shapeIndices[ i ];
+                Hit candidate;
+                if( shapes[ shapeIndex ]->hitTest( ray, tmin, closest, &candidate ) )
+                {
+                    // Any hit will do for shadow rays
+                    didHit = true;
+                    if( hit == nullptr )
+                        return true;
+
+                    closest = simd_length( candidate.pos - ray.pos );
+                    *hit = candidate;
+                    hit->shapeIndex = shapeIndex;
+                }
+            }
+        }
+        else
+        {
+            stack[ stackSize++ ] = node.firstChild;
+            stack[ stackSize++ ] = node.firstChild + 1;
+        }
+    }
+
+    return didHit;
+}
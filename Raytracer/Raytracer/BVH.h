@@ -0,0 +1,78 @@
+//
+//  BVH.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef BVH_h
+#define BVH_h
+
+#include <vector>
+
+#include "VectorTypes.h"
+
+struct Ray;
+struct Hit;
+class IHittable;
+
+// Axis aligned box
+struct AABB
+{
+    float3 min = simd_make_float3( INFINITY, INFINITY, INFINITY );
+    float3 max = simd_make_float3( -INFINITY, -INFINITY, -INFINITY );
+
+    void grow(const AABB& box);
+    void grow(const float3& point);
+    float3 center() const;
+    float surfaceArea() const;
+
+    // Slab test against [tmin, tmax] of a ray with precomputed inverse direction
+    bool hitTest(const float3& origin, const float3& inverseDirection, float tmin, float tmax) const;
+};
+
+// Bounding volume hierarchy over a scene's shapes, built with binned SAH.
+// Animated scenes refit it between frames (new bounds, same tree), which is
+// linear in the node count; once the refit tree's cost drifts too far above
+// the cost it had when built, rebuild it.
+class BVH
+{
+public:
+
+    // Builds over the shapes as they are now
+    BVH(const std::vector< IHittable* >& shapes);
+    void build(const std::vector< IHittable* >& shapes);
+
+    // Re-bounds every node after shapes moved; the shapes must be the same as built with
+    void refit(const std::vector< IHittable* >& shapes);
+
+    // Expected traversal cost (surface area heuristic) now, and right after the last build
+    float cost() const;
+    float buildCost() const;
+
+    size_t shapeCount() const;
+
+    // Closest hit, with the hit's shape index set
+    bool hitTest(const std::vector< IHittable* >& shapes, const Ray& ray, float tmin, float tmax, Hit* hit) const;
+
+private:
+
+    // Children of an internal node sit next to each other at firstChild, always
+    // after their parent, so walking the array backwards is bottom up
+    struct Node
+    {
+        AABB bounds;
+        int firstChild; // Or first index into _shapeIndices, for leaves
+        int count;      // Shapes in a leaf, 0 for internal nodes
+    };
+
+    std::vector< Node > _nodes;
+    std::vector< int > _shapeIndices;
+    std::vector< AABB > _shapeBounds; // Per shape index, scratch for build and refit
+    float _buildCost = 0;
+
+    void subdivide(int nodeIndex, int depth);
+};
+
+#endif /* BVH_h */
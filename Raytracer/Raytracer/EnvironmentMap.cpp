@@ -0,0 +1,186 @@
+//
+//  EnvironmentMap.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "EnvironmentMap.h"
+#include "ImageLoader.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#pragma mark EnvironmentMap Class
+
+EnvironmentMap* EnvironmentMap::load(const std::string& path)
+{
+    int2 resolution = simd_make_int2( 0, 0 );
+    std::vector< float > pixels;
+    if( loadImage( path, &resolution, &pixels ) == false )
+    {
+        printf( "Failed to read environment map %s\n", path.c_str() );
+        return nullptr;
+    }
+
+    return new EnvironmentMap( resolution, pixels );
+}
+
+EnvironmentMap::EnvironmentMap(int2 resolution, const std::vector< float >& pixels)
+{
+    _resolution = resolution;
+    const int width = resolution.x;
+    const int height = resolution.y;
+
+    // Negative (or NaN) texels would break the sampling CDFs
+    _texels.resize( (size_t)width * height * 3 );
+    for( size_t i = 0; i < _texels.size(); i++ )
+        _texels[ i ] = fmax( pixels[ i ], 0.0f );
+    _weights.resize( (size_t)width * height );
+    _conditionalCdf.resize( (size_t)( width + 1 ) * height );
+    _marginalCdf.resize( height + 1 );
+
+    // Weight texels by luminance and by the solid angle their row covers
+    for( int y = 0; y < height; y++ )
+    {
+        const float sinTheta = sin( M_PI * ( y + 0.5f ) / height );
+        for( int x = 0; x < width; x++ )
+        {
+            const size_t index = (size_t)y * width + x;
+            _weights[ index ] = luminance( texel( index ) ) * sinTheta;
+        }
+    }
+
+    // Conditional CDF per row, and the row sums feed the marginal
+    _marginalCdf[ 0 ] = 0;
+    for( int y = 0; y < height; y++ )
+    {
+        float* cdf = &_conditionalCdf[ (size_t)y * ( width + 1 ) ];
+        cdf[ 0 ] = 0;
+        for( int x = 0; x < width; x++ )
+            cdf[ x + 1 ] = cdf[ x ] + _weights[ (size_t)y * width + x ];
+
+        const float rowWeight = cdf[ width ];
+        for( int x = 1; x <= width; x++ )
+            cdf[ x ] = ( rowWeight > 0 ) ? cdf[ x ] / rowWeight : (float)x / width;
+
+        _marginalCdf[ y + 1 ] = _marginalCdf[ y ] + rowWeight;
+    }
+
+    _totalWeight = _marginalCdf[ height ];
+    for( int y = 1; y <= height; y++ )
+        _marginalCdf[ y ] = ( _totalWeight > 0 ) ? _marginalCdf[ y ] / _totalWeight : (float)y / height;
+}
+
+int2 EnvironmentMap::resolution() const
+{
+    return _resolution;
+}
+
+float EnvironmentMap::intensity() const
+{
+    return _intensity;
+}
+
+void EnvironmentMap::setIntensity(float intensity)
+{
+    _intensity = intensity;
+}
+
+float EnvironmentMap::rotation() const
+{
+    return _rotation * 360.0f;
+}
+
+void EnvironmentMap::setRotation(float degrees)
+{
+    _rotation = degrees / 360.0f;
+    _rotation -= floor( _rotation );
+}
+
+float2 EnvironmentMap::directionToUV(const float3& direction) const
+{
+    const float3 dir = simd_normalize( direction );
+    const float theta = acos( fmin( fmax( dir.y, -1.0f ), 1.0f ) );
+    const float phi = atan2( dir.z, dir.x );
+
+    float u = ( phi + M_PI ) / ( 2.0 * M_PI ) - _rotation;
+    u -= floor( u );
+    return simd_make_float2( u, theta / M_PI );
+}
+
+float3 EnvironmentMap::uvToDirection(float2 uv) const
+{
+    const float phi = ( uv.x + _rotation ) * 2.0 * M_PI - M_PI;
+    const float theta = uv.y * M_PI;
+    return simd_make_float3( sin( theta ) * cos( phi ), cos( theta ), sin( theta ) * sin( phi ) );
+}
+
+int EnvironmentMap::texelIndex(float2 uv) const
+{
+    const int x = std::min( (int)( uv.x * _resolution.x ), _resolution.x - 1 );
+    const int y = std::min( (int)( uv.y * _resolution.y ), _resolution.y - 1 );
+    return y * _resolution.x + x;
+}
+
+float3 EnvironmentMap::texel(size_t index) const
+{
+    const float* rgb = &_texels[ index * 3 ];
+    return simd_make_float3( rgb[ 0 ], rgb[ 1 ], rgb[ 2 ] );
+}
+
+float3 EnvironmentMap::radiance(const float3& direction) const
+{
+    return _intensity * texel( texelIndex( directionToUV( direction ) ) );
+}
+
+float3 EnvironmentMap::sample(float2 u, float3* direction, float* pdf) const
+{
+    *pdf = 0;
+    if( _totalWeight <= 0 )
+        return simd_make_float3( 0, 0, 0 );
+
+    const int width = _resolution.x;
+    const int height = _resolution.y;
+
+    // Row from the marginal, then column from that row's conditional
+    int row = (int)( std::upper_bound( _marginalCdf.begin(), _marginalCdf.end(), u.y ) - _marginalCdf.begin() ) - 1;
+    row = std::min( std::max( row, 0 ), height - 1 );
+    const float rowWidth = _marginalCdf[ row + 1 ] - _marginalCdf[ row ];
+    const float rowOffset = ( rowWidth > 0 ) ? ( u.y - _marginalCdf[ row ] ) / rowWidth : 0.5f;
+
+    const float* cdf = &_conditionalCdf[ (size_t)row * ( width + 1 ) ];
+    int column = (int)( std::upper_bound( cdf, cdf + width + 1, u.x ) - cdf ) - 1;
+    column = std::min( std::max( column, 0 ), width - 1 );
+    const float columnWidth = cdf[ column + 1 ] - cdf[ column ];
+    const float columnOffset = ( columnWidth > 0 ) ? ( u.x - cdf[ column ] ) / columnWidth : 0.5f;
+
+    const float2 uv = simd_make_float2( ( column + fmin( columnOffset, 0.999f ) ) / width, ( row + fmin( rowOffset, 0.999f ) ) / height );
+    const float sinTheta = sin( uv.y * M_PI );
+    if( sinTheta <= 0 )
+        return simd_make_float3( 0, 0, 0 );
+
+    // Density over the unit square, then over solid angle
+    const size_t index = (size_t)row * width + column;
+    const float uvPdf = _weights[ index ] * width * height / _totalWeight;
+    *pdf = uvPdf / ( 2.0 * M_PI * M_PI * sinTheta );
+    *direction = uvToDirection( uv );
+
+    return _intensity * texel( index );
+}
+
+float EnvironmentMap::pdf(const float3& direction) const
+{
+    if( _totalWeight <= 0 )
+        return 0;
+
+    const float2 uv = directionToUV( direction );
+    const float sinTheta = sin( uv.y * M_PI );
+    if( sinTheta <= 0 )
+        return 0;
+
+    const float uvPdf = _weights[ texelIndex( uv ) ] * _resolution.x * _resolution.y / _totalWeight;
+    return uvPdf / ( 2.0 * M_PI * M_PI * sinTheta );
+}
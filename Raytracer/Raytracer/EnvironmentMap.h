@@ -0,0 +1,74 @@
+//
+//  EnvironmentMap.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef EnvironmentMap_h
+#define EnvironmentMap_h
+
+#include <string>
+#include <vector>
+
+#include "VectorTypes.h"
+
+// Equirectangular HDR environment that lights the scene from infinitely far away.
+// Texels are kept as full floats, since a sun can be far brighter than compact
+// formats go, and importance sampled through a piecewise-constant 2D
+// distribution (marginal CDF over rows, conditional CDF per row), weighted by
+// luminance and by solid angle, so a bright sun gets found directly.
+class EnvironmentMap
+{
+public:
+
+    // Loads a Radiance .hdr, a .pfm or a .png, nullptr on failure
+    static EnvironmentMap* load(const std::string& path);
+
+    // Packed linear RGB, rows top (+y) to bottom (-y)
+    EnvironmentMap(int2 resolution, const std::vector< float >& pixels);
+
+    int2 resolution() const;
+
+    // Radiance multiplier
+    float intensity() const;
+    void setIntensity(float intensity);
+
+    // Degrees around +y
+    float rotation() const;
+    void setRotation(float degrees);
+
+    // Light arriving from the given direction
+    float3 radiance(const float3& direction) const;
+
+    // Picks a direction proportional to the map's brightness. Returns its radiance
+    // and writes the direction and its density per solid angle
+    float3 sample(float2 u, float3* direction, float* pdf) const;
+
+    // Density per solid angle that sample() returns the given direction
+    float pdf(const float3& direction) const;
+
+private:
+
+    int2 _resolution;
+    std::vector< float > _texels; // Packed RGB
+
+    // Sampling distribution: unnormalized texel weights, per-row conditional
+    // CDFs (width + 1 each) and the marginal CDF over rows (height + 1)
+    std::vector< float > _weights;
+    std::vector< float > _conditionalCdf;
+    std::vector< float > _marginalCdf;
+    float _totalWeight;
+
+    float _intensity = 1.0f;
+    float _rotation = 0.0f; // In [0, 1) of a turn
+
+    // Direction <-> [0, 1)^2 texture space
+    float2 directionToUV(const float3& direction) const;
+    float3 uvToDirection(float2 uv) const;
+    int texelIndex(float2 uv) const;
+    float3 texel(size_t index) const;
+};
+
+#endif /* EnvironmentMap_h */
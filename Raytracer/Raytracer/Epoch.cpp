@@ -0,0 +1,137 @@
+//
+//  Epoch.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "Epoch.h"
+
+#include <os/lock.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+// Threads reading at once; more than this wait for one to exit
+static const int kMaxReaderCount = 256;
+
+// Epoch each reading thread entered at, 0 when not reading. A cache line each,
+// so readers don't slow each other down
+struct alignas( 64 ) ReaderSlot
+{
+    std::atomic< uint64_t > epoch{ 0 };
+    std::atomic< bool > claimed{ false };
+};
+static ReaderSlot gReaderSlots[ kMaxReaderCount ];
+
+// Bumped on every retire; starts at 1 so 0 can mean "not reading"
+static std::atomic< uint64_t > gEpoch{ 1 };
+
+// Retired objects and the epoch readers had to be past for them to be safe
+struct Retired
+{
+    uint64_t epoch;
+    std::function<void()> reclaim;
+};
+static os_unfair_lock gRetiredLock = OS_UNFAIR_LOCK_INIT;
+static std::vector< Retired > gRetired;
+
+// The calling thread's slot, claimed on its first guard and given back when it exits
+struct ThreadReader
+{
+    int slot = -1;
+    int depth = 0;
+
+    ~ThreadReader()
+    {
+        if( slot >= 0 )
+            gReaderSlots[ slot ].claimed.store( false, std::memory_order_release );
+    }
+};
+static thread_local ThreadReader tReader;
+
+static int claimReaderSlot()
+{
+    while( true )
+    {
+        for( int slot = 0; slot < kMaxReaderCount; slot++ )
+        {
+            bool claimed = false;
+            if( gReaderSlots[ slot ].claimed.compare_exchange_strong( claimed, true ) )
+                return slot;
+        }
+        sched_yield();
+    }
+}
+
+Epoch::Guard::Guard()
+{
+    ThreadReader& reader = tReader;
+    if( reader.depth++ > 0 )
+        return;
+    if( reader.slot < 0 )
+        reader.slot = claimReaderSlot();
+
+    // Sequentially consistent, like the pointer loads that follow: a retire that
+    // scans slots before this store bumped the epoch first, so anything we load
+    // after it is already the new data
+    gReaderSlots[ reader.slot ].epoch.store( gEpoch.load() );
+}
+
+Epoch::Guard::~Guard()
+{
+    ThreadReader& reader = tReader;
+    if( --reader.depth == 0 )
+        gReaderSlots[ reader.slot ].epoch.store( 0, std::memory_order_release );
+}
+
+void Epoch::retire(std::function<void()> reclaim)
+{
+    // Readers that enter from here on can't reach the object any more
+    const uint64_t epoch = gEpoch.fetch_add( 1 ) + 1;
+
+    os_unfair_lock_lock( &gRetiredLock );
+    gRetired.push_back( Retired{ epoch, std::move( reclaim ) } );
+    os_unfair_lock_unlock( &gRetiredLock );
+
+    Epoch::reclaim();
+}
+
+size_t Epoch::reclaim()
+{
+    // Oldest epoch any reader is still in
+    uint64_t oldest = UINT64_MAX;
+    for( int slot = 0; slot < kMaxReaderCount; slot++ )
+    {
+        const uint64_t epoch = gReaderSlots[ slot ].epoch.load();
+        if( epoch != 0 && epoch < oldest )
+            oldest = epoch;
+    }
+
+    // Take the safe ones out, then free them outside the lock; a reclaim may well
+    // retire something itself
+    std::vector< Retired > safe;
+    os_unfair_lock_lock( &gRetiredLock );
+    for( size_t i = 0; i < gRetired.size(); )
+    {
+        if( gRetired[ i ].epoch <= oldest )
+        {
+            safe.push_back( std::move( gRetired[ i ] ) );
+            gRetired[ i ] = std::move( gRetired.back() );
+            gRetired.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+    const size_t waiting = gRetired.size();
+    os_unfair_lock_unlock( &gRetiredLock );
+
+    for( Retired& retired : safe )
+        retired.reclaim();
+    return waiting;
+}
@@ -0,0 +1,47 @@
+//
+//  Epoch.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef Epoch_h
+#define Epoch_h
+
+#include <stddef.h>
+#include <functional>
+
+// Epoch based reclamation, so readers can use data that writers swap out from
+// under them with no locks or reference counts. Readers hold a Guard while they
+// use anything they loaded through an atomic pointer; writers swap the pointer,
+// then retire() what it pointed to, and it gets freed once every reader that
+// could still have it has left its guard. Readers only ever store their epoch
+// to a slot of their own, so they never wait on writers or each other.
+class Epoch
+{
+public:
+
+    // Marks the thread as reading for its lifetime. Nests; cheap enough to take
+    // per work item, but not per ray
+    class Guard
+    {
+    public:
+
+        Guard();
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    // Call once the object is unreachable for new readers; reclaim runs later,
+    // on whichever thread finds it safe
+    static void retire(std::function<void()> reclaim);
+
+    // Runs the reclaims no reader can be in the way of any more; returns how many
+    // are still waiting. retire() does this too
+    static size_t reclaim();
+};
+
+#endif /* Epoch_h */
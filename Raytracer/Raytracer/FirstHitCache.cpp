@@ -0,0 +1,159 @@
+//
+//  FirstHitCache.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "FirstHitCache.h"
+
+#include <algorithm>
+
+#pragma mark TouchedShapes Struct
+
+TouchedShapes::TouchedShapes()
+{
+    std::fill( shapes, shapes + kTouchedShapeCount, -1 );
+}
+
+void TouchedShapes::add(int shapeIndex)
+{
+    if( shapeIndex < 0 )
+        return;
+
+    for( int i = 0; i < kTouchedShapeCount; i++ )
+    {
+        if( shapes[ i ] == shapeIndex )
+            return;
+        if( shapes[ i ] < 0 )
+        {
+            shapes[ i ] = shapeIndex;
+            return;
+        }
+    }
+    overflowMask |= object_mask_bit( shapeIndex );
+}
+
+void TouchedShapes::add(const TouchedShapes& other)
+{
+    for( int i = 0; i < kTouchedShapeCount && other.shapes[ i ] >= 0; i++ )
+        add( other.shapes[ i ] );
+    overflowMask |= other.overflowMask;
+}
+
+#pragma mark PathRecord Struct
+
+void PathRecord::touch(int shapeIndex)
+{
+    touched.add( shapeIndex );
+}
+
+#pragma mark FirstHitCache Class
+
+FirstHitCache::FirstHitCache(int2 resolution, bool wholePath)
+{
+    _resolution = resolution;
+    _wholePath = wholePath;
+
+    Record empty;
+    std::fill( empty.pos, empty.pos + 3, 0.0f );
+    std::fill( empty.norm, empty.norm + 3, 0.0f );
+    empty.material = nullptr;
+    empty.shape = -1;
+
+    _records.assign( (size_t)resolution.x * resolution.y, empty );
+    _invalid.assign( (size_t)resolution.x * resolution.y, 0 );
+}
+
+int2 FirstHitCache::resolution() const
+{
+    return _resolution;
+}
+
+bool FirstHitCache::recordsWholePath() const
+{
+    return _wholePath;
+}
+
+void FirstHitCache::store(int x, int y, const PathRecord& pathRecord)
+{
+    Record& record = _records[ (size_t)y * _resolution.x + x ];
+    record.pos[ 0 ] = pathRecord.firstHitPos.x;
+    record.pos[ 1 ] = pathRecord.firstHitPos.y;
+    record.pos[ 2 ] = pathRecord.firstHitPos.z;
+    record.norm[ 0 ] = pathRecord.firstHitNorm.x;
+    record.norm[ 1 ] = pathRecord.firstHitNorm.y;
+    record.norm[ 2 ] = pathRecord.firstHitNorm.z;
+    record.material = pathRecord.hasFirstHit ? pathRecord.firstHitMaterial : nullptr;
+    record.shape = pathRecord.hasFirstHit ? pathRecord.firstHitShape : -1;
+    record.touched = pathRecord.touched;
+}
+
+void FirstHitCache::merge(int x, int y, const PathRecord& pathRecord)
+{
+    Record& record = _records[ (size_t)y * _resolution.x + x ];
+    record.touched.add( pathRecord.touched );
+}
+
+const FirstHitCache::Record& FirstHitCache::record(int x, int y) const
+{
+    return _records[ (size_t)y * _resolution.x + x ];
+}
+
+int FirstHitCache::invalidate(const std::vector< int >& shapeIndices)
+{
+    // Lookup table over the shape indices, and their bits for overflowed pixels
+    std::vector< uint8_t > flagged;
+    uint64_t overflowBits = 0;
+    for( int shapeIndex : shapeIndices )
+    {
+        if( shapeIndex < 0 )
+            continue;
+        if( shapeIndex >= (int)flagged.size() )
+            flagged.resize( shapeIndex + 1, 0 );
+        flagged[ shapeIndex ] = 1;
+        overflowBits |= object_mask_bit( shapeIndex );
+    }
+    if( overflowBits == 0 )
+        return 0;
+
+    int count = 0;
+    for( size_t i = 0; i < _records.size(); i++ )
+    {
+        if( _invalid[ i ] )
+            continue;
+
+        const TouchedShapes& touched = _records[ i ].touched;
+        bool hit = ( touched.overflowMask & overflowBits ) != 0;
+        for( int j = 0; j < kTouchedShapeCount && hit == false && touched.shapes[ j ] >= 0; j++ )
+            hit = ( touched.shapes[ j ] < (int)flagged.size() && flagged[ touched.shapes[ j ] ] );
+
+        if( hit )
+        {
+            _invalid[ i ] = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+void FirstHitCache::invalidatePixel(int x, int y)
+{
+    _invalid[ (size_t)y * _resolution.x + x ] = 1;
+}
+
+bool FirstHitCache::isInvalid(int x, int y) const
+{
+    return _invalid[ (size_t)y * _resolution.x + x ] != 0;
+}
+
+int FirstHitCache::invalidCount() const
+{
+    return (int)std::count( _invalid.begin(), _invalid.end(), 1 );
+}
+
+void FirstHitCache::clearInvalid()
+{
+    std::fill( _invalid.begin(), _invalid.end(), 0 );
+}
@@ -0,0 +1,104 @@
+//
+//  FirstHitCache.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef FirstHitCache_h
+#define FirstHitCache_h
+
+#include <stdint.h>
+#include <vector>
+
+#include "VectorTypes.h"
+
+class IMaterial;
+
+// Shapes a pixel's samples touched: by index while they fit, the rest folded
+// into a 64-bit mask, where collisions only ever over-invalidate. Materials
+// aren't kept; a material edit flags the shapes that use it
+static const int kTouchedShapeCount = 6;
+struct TouchedShapes
+{
+    int32_t shapes[ kTouchedShapeCount ]; // -1 past the last one
+    uint64_t overflowMask = 0;
+
+    TouchedShapes();
+    void add(int shapeIndex);
+    void add(const TouchedShapes& other);
+};
+
+inline uint64_t object_mask_bit(int shapeIndex)
+{
+    return ( shapeIndex < 0 ) ? 0 : ( 1ull << ( shapeIndex & 63 ) );
+}
+
+// What one pixel's samples touched, gathered while tracing it
+struct PathRecord
+{
+    // Record every bounce (and shadow ray blocker), not just the primary hits
+    bool wholePath = false;
+
+    // Primary hit of the un-jittered first sample; recordFirstHit is cleared
+    // once that sample is traced
+    bool recordFirstHit = true;
+    bool hasFirstHit = false;
+    float3 firstHitPos;
+    float3 firstHitNorm;
+    const IMaterial* firstHitMaterial = nullptr;
+    int firstHitShape = -1;
+
+    // A later sample's primary ray saw another shape (or nothing): an edge
+    bool firstHitsDiffer = false;
+
+    TouchedShapes touched;
+
+    void touch(int shapeIndex);
+};
+
+// Per-pixel first hits and touched shapes of the last render, so a material or
+// object edit only re-renders the pixels it can have changed
+class FirstHitCache
+{
+public:
+
+    // Packed per-pixel entry; float3 would pad each vector to 16 bytes
+    struct Record
+    {
+        float pos[ 3 ];
+        float norm[ 3 ];
+        const IMaterial* material;
+        int32_t shape; // -1 if the primary ray missed
+        TouchedShapes touched;
+    };
+
+    FirstHitCache(int2 resolution, bool wholePath);
+
+    int2 resolution() const;
+    bool recordsWholePath() const;
+
+    void store(int x, int y, const PathRecord& record);
+
+    // Adds the shapes of more samples, keeping the first hit
+    void merge(int x, int y, const PathRecord& record);
+    const Record& record(int x, int y) const;
+
+    // Flag pixels that touched any of the given shapes; returns how many got flagged
+    int invalidate(const std::vector< int >& shapeIndices);
+    void invalidatePixel(int x, int y);
+
+    bool isInvalid(int x, int y) const;
+    int invalidCount() const;
+    void clearInvalid();
+
+private:
+
+    int2 _resolution;
+    bool _wholePath;
+    std::vector< Record > _records;
+    std::vector< uint8_t > _invalid;
+};
+
+#endif /* FirstHitCache_h */
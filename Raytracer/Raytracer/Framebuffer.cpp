@@ -0,0 +1,387 @@
+//
+//  Framebuffer.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "Framebuffer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#pragma mark EXR Helpers
+
+// Little helpers to build an OpenEXR header; we're on little-endian, like the file
+static void appendBytes(std::vector< uint8_t >& buffer, const void* data, size_t length)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    buffer.insert( buffer.end(), bytes, bytes + length );
+}
+
+template< typename T >
+static void appendValue(std::vector< uint8_t >& buffer, T value)
+{
+    appendBytes( buffer, &value, sizeof( value ) );
+}
+
+static void appendString(std::vector< uint8_t >& buffer, const char* string)
+{
+    appendBytes( buffer, string, strlen( string ) + 1 );
+}
+
+static void appendAttribute(std::vector< uint8_t >& buffer, const char* name, const char* type, const std::vector< uint8_t >& value)
+{
+    appendString( buffer, name );
+    appendString( buffer, type );
+    appendValue< int32_t >( buffer, (int32_t)value.size() );
+    appendBytes( buffer, value.data(), value.size() );
+}
+
+// EXR pixel type for our storage format: full floats stay floats, the rest go out as half
+static bool exrUsesFloat(PixelFormat format)
+{
+    return ( format == PixelFormatRGB32F );
+}
+
+#pragma mark Framebuffer Class
+
+Framebuffer::Framebuffer(int2 resolution, const Options& options)
+    : _tiles( 0 )
+{
+    _resolution = resolution;
+    _options = options;
+    _options.tileSize = std::max( _options.tileSize, 8 );
+    _tileCount = simd_make_int2( ( resolution.x + _options.tileSize - 1 ) / _options.tileSize,
+                                 ( resolution.y + _options.tileSize - 1 ) / _options.tileSize );
+    _pixelSize = pixel_format_size( _options.format );
+
+    _tiles = std::vector< std::atomic< uint8_t* > >( (size_t)_tileCount.x * _tileCount.y );
+    for( std::atomic< uint8_t* >& tile : _tiles )
+        tile = nullptr;
+
+    _residencyLock = OS_UNFAIR_LOCK_INIT;
+    _residentBytes = 0;
+    _peakResidentBytes = 0;
+
+    if( _options.streamPath.empty() == false && openStream() == false )
+    {
+        printf( "Failed to open framebuffer stream %s, keeping tiles in memory\n", _options.streamPath.c_str() );
+        _options.streamPath.clear();
+    }
+}
+
+Framebuffer::~Framebuffer()
+{
+    if( _streamFile >= 0 )
+        close( _streamFile );
+
+    for( std::atomic< uint8_t* >& tile : _tiles )
+        free( tile.load() );
+}
+
+int2 Framebuffer::resolution() const
+{
+    return _resolution;
+}
+
+int Framebuffer::tileSize() const
+{
+    return _options.tileSize;
+}
+
+int2 Framebuffer::tileCount() const
+{
+    return _tileCount;
+}
+
+PixelFormat Framebuffer::format() const
+{
+    return _options.format;
+}
+
+bool Framebuffer::isStreaming() const
+{
+    return ( _streamFile >= 0 );
+}
+
+int2 Framebuffer::tileExtent(int tileX, int tileY) const
+{
+    const int tileSize = _options.tileSize;
+    return simd_make_int2( std::min( tileSize, _resolution.x - tileX * tileSize ),
+                           std::min( tileSize, _resolution.y - tileY * tileSize ) );
+}
+
+uint8_t* Framebuffer::tileData(int tileX, int tileY, bool allocate)
+{
+    std::atomic< uint8_t* >& tile = _tiles[ (size_t)tileY * _tileCount.x + tileX ];
+    uint8_t* data = tile.load( std::memory_order_acquire );
+    if( data != nullptr || allocate == false )
+        return data;
+
+    // Race other writers of this tile to allocate it; loser frees its copy
+    const size_t tileBytes = (size_t)_options.tileSize * _options.tileSize * _pixelSize;
+    uint8_t* newData = (uint8_t*)calloc( 1, tileBytes );
+    if( tile.compare_exchange_strong( data, newData, std::memory_order_acq_rel ) == false )
+    {
+        free( newData );
+        return data;
+    }
+
+    const size_t resident = ( _residentBytes += tileBytes );
+    size_t peak = _peakResidentBytes.load();
+    while( resident > peak && _peakResidentBytes.compare_exchange_weak( peak, resident ) == false )
+        ;
+
+    return newData;
+}
+
+void Framebuffer::setPixel(int x, int y, float3 color)
+{
+    const int tileSize = _options.tileSize;
+    uint8_t* data = tileData( x / tileSize, y / tileSize, true );
+    const size_t offset = (size_t)( y % tileSize ) * tileSize + ( x % tileSize );
+    pixel_format_store( _options.format, data + offset * _pixelSize, color );
+}
+
+float3 Framebuffer::pixel(int x, int y) const
+{
+    const int tileSize = _options.tileSize;
+    const uint8_t* data = _tiles[ (size_t)( y / tileSize ) * _tileCount.x + ( x / tileSize ) ].load( std::memory_order_acquire );
+    if( data == nullptr )
+        return simd_make_float3( 0, 0, 0 );
+
+    const size_t offset = (size_t)( y % tileSize ) * tileSize + ( x % tileSize );
+    return pixel_format_load( _options.format, data + offset * _pixelSize );
+}
+
+bool Framebuffer::finishTile(int tileX, int tileY)
+{
+    if( isStreaming() == false )
+        return true;
+
+    // Evict first so previews stop reading it, then write it out at our leisure
+    os_unfair_lock_lock(&_residencyLock);
+    uint8_t* data = _tiles[ (size_t)tileY * _tileCount.x + tileX ].exchange( nullptr );
+    os_unfair_lock_unlock(&_residencyLock);
+
+    // Never-written tile: the stream is pre-sized, so it already reads as black
+    if( data == nullptr )
+        return true;
+
+    const bool success = writeTile( tileX, tileY, data );
+    free( data );
+    _residentBytes -= (size_t)_options.tileSize * _options.tileSize * _pixelSize;
+    return success;
+}
+
+void Framebuffer::clear()
+{
+    const size_t tileBytes = (size_t)_options.tileSize * _options.tileSize * _pixelSize;
+    os_unfair_lock_lock(&_residencyLock);
+    for( std::atomic< uint8_t* >& tile : _tiles )
+    {
+        uint8_t* data = tile.load();
+        if( data != nullptr )
+            memset( data, 0, tileBytes );
+    }
+    os_unfair_lock_unlock(&_residencyLock);
+}
+
+void Framebuffer::lockResidency()
+{
+    os_unfair_lock_lock(&_residencyLock);
+}
+
+void Framebuffer::unlockResidency()
+{
+    os_unfair_lock_unlock(&_residencyLock);
+}
+
+size_t Framebuffer::residentBytes() const
+{
+    return _residentBytes;
+}
+
+size_t Framebuffer::peakResidentBytes() const
+{
+    return _peakResidentBytes;
+}
+
+#pragma mark Streaming
+
+bool Framebuffer::openStream()
+{
+    _streamFile = open( _options.streamPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if( _streamFile < 0 )
+        return false;
+
+    const int tileSize = _options.tileSize;
+    const size_t tileCount = (size_t)_tileCount.x * _tileCount.y;
+    _streamOffsets.resize( tileCount );
+
+    std::vector< uint8_t > header;
+    uint64_t fileSize = 0;
+
+    if( _options.streamFormat == StreamFormatRawTiles )
+    {
+        // Fixed-size slots so any tile can be written independently
+        appendBytes( header, "RTTILES1", 8 );
+        appendValue< int32_t >( header, _resolution.x );
+        appendValue< int32_t >( header, _resolution.y );
+        appendValue< int32_t >( header, tileSize );
+        appendValue< int32_t >( header, (int32_t)_options.format );
+
+        const uint64_t slotSize = (uint64_t)tileSize * tileSize * _pixelSize;
+        for( size_t i = 0; i < tileCount; i++ )
+            _streamOffsets[ i ] = header.size() + i * slotSize;
+        fileSize = header.size() + tileCount * slotSize;
+    }
+    else
+    {
+        // Single-part tiled EXR, version 2
+        const uint32_t magic = 20000630;
+        appendValue< uint32_t >( header, magic );
+        appendValue< uint32_t >( header, 2 | 0x200 );
+
+        const int32_t pixelType = exrUsesFloat( _options.format ) ? 2 : 1;
+        std::vector< uint8_t > channels;
+        for( const char* name : { "B", "G", "R" } )
+        {
+            appendString( channels, name );
+            appendValue< int32_t >( channels, pixelType );
+            appendValue< uint32_t >( channels, 0 ); // pLinear + reserved
+            appendValue< int32_t >( channels, 1 );
+            appendValue< int32_t >( channels, 1 );
+        }
+        appendValue< uint8_t >( channels, 0 );
+        appendAttribute( header, "channels", "chlist", channels );
+
+        appendAttribute( header, "compression", "compression", { 0 } );
+
+        std::vector< uint8_t > window;
+        appendValue< int32_t >( window, 0 );
+        appendValue< int32_t >( window, 0 );
+        appendValue< int32_t >( window, _resolution.x - 1 );
+        appendValue< int32_t >( window, _resolution.y - 1 );
+        appendAttribute( header, "dataWindow", "box2i", window );
+        appendAttribute( header, "displayWindow", "box2i", window );
+
+        appendAttribute( header, "lineOrder", "lineOrder", { 0 } );
+
+        std::vector< uint8_t > one;
+        appendValue< float >( one, 1.0f );
+        appendAttribute( header, "pixelAspectRatio", "float", one );
+
+        std::vector< uint8_t > center;
+        appendValue< float >( center, 0.0f );
+        appendValue< float >( center, 0.0f );
+        appendAttribute( header, "screenWindowCenter", "v2f", center );
+        appendAttribute( header, "screenWindowWidth", "float", one );
+
+        std::vector< uint8_t > tiles;
+        appendValue< uint32_t >( tiles, tileSize );
+        appendValue< uint32_t >( tiles, tileSize );
+        appendValue< uint8_t >( tiles, 0 ); // ONE_LEVEL, round down
+        appendAttribute( header, "tiles", "tiledesc", tiles );
+
+        appendValue< uint8_t >( header, 0 );
+
+        // Chunks are laid out row-major right after the offset table, so every
+        // offset is known up front and tiles can land in any order
+        const size_t channelSize = exrUsesFloat( _options.format ) ? 4 : 2;
+        uint64_t offset = header.size() + tileCount * sizeof( uint64_t );
+        for( int tileY = 0; tileY < _tileCount.y; tileY++ )
+        {
+            for( int tileX = 0; tileX < _tileCount.x; tileX++ )
+            {
+                const int2 extent = tileExtent( tileX, tileY );
+                _streamOffsets[ (size_t)tileY * _tileCount.x + tileX ] = offset;
+                offset += 5 * sizeof( int32_t ) + (uint64_t)extent.x * extent.y * 3 * channelSize;
+            }
+        }
+        fileSize = offset;
+
+        appendBytes( header, _streamOffsets.data(), tileCount * sizeof( uint64_t ) );
+    }
+
+    // Pre-size so unwritten (e.g. cancelled) tiles read as zeros
+    if( ftruncate( _streamFile, fileSize ) != 0 || pwrite( _streamFile, header.data(), header.size(), 0 ) != (ssize_t)header.size() )
+    {
+        close( _streamFile );
+        _streamFile = -1;
+        return false;
+    }
+
+    // Every EXR chunk needs its tile header, even if the tile never gets rendered
+    if( _options.streamFormat == StreamFormatTiledEXR )
+    {
+        const size_t channelSize = exrUsesFloat( _options.format ) ? 4 : 2;
+        for( int tileY = 0; tileY < _tileCount.y; tileY++ )
+        {
+            for( int tileX = 0; tileX < _tileCount.x; tileX++ )
+            {
+                const int2 extent = tileExtent( tileX, tileY );
+                const int32_t chunkHeader[ 5 ] = { tileX, tileY, 0, 0, (int32_t)( extent.x * extent.y * 3 * channelSize ) };
+                const uint64_t offset = _streamOffsets[ (size_t)tileY * _tileCount.x + tileX ];
+                if( pwrite( _streamFile, chunkHeader, sizeof( chunkHeader ), offset ) != sizeof( chunkHeader ) )
+                {
+                    close( _streamFile );
+                    _streamFile = -1;
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Framebuffer::writeTile(int tileX, int tileY, const uint8_t* data)
+{
+    const int tileSize = _options.tileSize;
+    const uint64_t offset = _streamOffsets[ (size_t)tileY * _tileCount.x + tileX ];
+
+    if( _options.streamFormat == StreamFormatRawTiles )
+    {
+        const size_t slotSize = (size_t)tileSize * tileSize * _pixelSize;
+        return pwrite( _streamFile, data, slotSize, offset ) == (ssize_t)slotSize;
+    }
+
+    // EXR wants each scanline of the tile as planar B, G, R runs
+    const int2 extent = tileExtent( tileX, tileY );
+    const bool useFloat = exrUsesFloat( _options.format );
+    const size_t channelSize = useFloat ? 4 : 2;
+    std::vector< uint8_t > chunk( (size_t)extent.x * extent.y * 3 * channelSize );
+
+    uint8_t* destination = chunk.data();
+    for( int y = 0; y < extent.y; y++ )
+    {
+        for( int channel = 2; channel >= 0; channel-- )
+        {
+            for( int x = 0; x < extent.x; x++ )
+            {
+                const float3 color = pixel_format_load( _options.format, data + ( (size_t)y * tileSize + x ) * _pixelSize );
+                if( useFloat )
+                {
+                    const float value = color[ channel ];
+                    memcpy( destination, &value, sizeof( value ) );
+                }
+                else
+                {
+                    const uint16_t value = float_to_half( color[ channel ] );
+                    memcpy( destination, &value, sizeof( value ) );
+                }
+                destination += channelSize;
+            }
+        }
+    }
+
+    const uint64_t dataOffset = offset + 5 * sizeof( int32_t );
+    return pwrite( _streamFile, chunk.data(), chunk.size(), dataOffset ) == (ssize_t)chunk.size();
+}
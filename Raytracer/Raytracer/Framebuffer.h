@@ -0,0 +1,96 @@
+//
+//  Framebuffer.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef Framebuffer_h
+#define Framebuffer_h
+
+#include <os/lock.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "VectorTypes.h"
+#include "PixelFormat.h"
+
+// Tiled store of linear radiance. Tiles are allocated on first write, in a compact
+// pixel format. When streaming, finished tiles are written to disk and dropped, so
+// memory is bounded by the tiles in flight rather than by the frame size.
+class Framebuffer
+{
+public:
+
+    enum StreamFormat
+    {
+        StreamFormatTiledEXR,   // Uncompressed tiled OpenEXR (half or float channels)
+        StreamFormatRawTiles,   // Header + fixed-size tile slots in the pixel format
+    };
+
+    struct Options
+    {
+        PixelFormat format = PixelFormatRGB32F;
+        int tileSize = 64;
+
+        // If set, finished tiles go to this file and are evicted from memory
+        std::string streamPath;
+        StreamFormat streamFormat = StreamFormatTiledEXR;
+    };
+
+    Framebuffer(int2 resolution, const Options& options);
+    ~Framebuffer();
+
+    int2 resolution() const;
+    int tileSize() const;
+    int2 tileCount() const;
+    PixelFormat format() const;
+    bool isStreaming() const;
+
+    // Pixels of tiles that were streamed out (or never written) read as black
+    void setPixel(int x, int y, float3 color);
+    float3 pixel(int x, int y) const;
+
+    // Declare a tile done: when streaming, it's written out and evicted.
+    // Returns false if the write failed.
+    bool finishTile(int tileX, int tileY);
+
+    // Zero every resident tile
+    void clear();
+
+    // Readers that walk many pixels (previews) hold this so tiles aren't
+    // evicted under them. Writers never take it.
+    void lockResidency();
+    void unlockResidency();
+
+    size_t residentBytes() const;
+    size_t peakResidentBytes() const;
+
+private:
+
+    int2 _resolution;
+    Options _options;
+    int2 _tileCount;
+    size_t _pixelSize;
+
+    // Tile storage, nullptr until first write and again after eviction
+    std::vector< std::atomic< uint8_t* > > _tiles;
+
+    os_unfair_lock _residencyLock;
+    std::atomic< size_t > _residentBytes;
+    std::atomic< size_t > _peakResidentBytes;
+
+    // Stream output
+    int _streamFile = -1;
+    std::vector< uint64_t > _streamOffsets; // Per tile, into the stream file
+
+    uint8_t* tileData(int tileX, int tileY, bool allocate);
+    int2 tileExtent(int tileX, int tileY) const;
+
+    bool openStream();
+    bool writeTile(int tileX, int tileY, const uint8_t* data);
+};
+
+#endif /* Framebuffer_h */
@@ -0,0 +1,500 @@
+//
+//  ImageExporter.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "ImageExporter.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#pragma mark Export Job
+
+struct ImageExporter::Job
+{
+    std::shared_ptr< const ExportImage > image;
+    std::function<std::shared_ptr< const ExportImage >()> makeImage; // If not made yet
+    int2 resolution;
+    std::string path;
+    Format format;
+    std::function<void(bool)> completion;
+
+    int stripHeight = 0;
+    int stripCount = 0;
+    std::atomic< int > remainingStrips{ 0 };
+    std::atomic< bool > failed{ false };
+
+    // PFM / EXR: header (with EXR offset table) and the file strips write into
+    std::vector< uint8_t > header;
+    std::once_flag openOnce;
+    int file = -1;
+
+    // PNG: raw-deflated strips and their checksums, stitched together at the end
+    std::vector< std::vector< uint8_t > > compressedStrips;
+    std::vector< uLong > stripAdlers;
+    std::vector< uLong > stripLengths;
+};
+
+#pragma mark Format Helpers
+
+template< typename T >
+static void appendValue(std::vector< uint8_t >& buffer, T value)
+{
+    const uint8_t* bytes = (const uint8_t*)&value;
+    buffer.insert( buffer.end(), bytes, bytes + sizeof( value ) );
+}
+
+static void appendString(std::vector< uint8_t >& buffer, const char* string)
+{
+    buffer.insert( buffer.end(), string, string + strlen( string ) + 1 );
+}
+
+static void appendAttribute(std::vector< uint8_t >& buffer, const char* name, const char* type, const std::vector< uint8_t >& value)
+{
+    appendString( buffer, name );
+    appendString( buffer, type );
+    appendValue< int32_t >( buffer, (int32_t)value.size() );
+    buffer.insert( buffer.end(), value.begin(), value.end() );
+}
+
+// Bytes of one uncompressed EXR scanline chunk: y, size, then B, G, R floats
+static size_t exrLineChunkSize(int width)
+{
+    return 2 * sizeof( int32_t ) + (size_t)width * 3 * sizeof( float );
+}
+
+// Scanline OpenEXR header plus the offset table; uncompressed chunks have a fixed
+// size, so every offset is known before any strip is encoded
+static std::vector< uint8_t > exrHeader(int2 resolution)
+{
+    std::vector< uint8_t > header;
+    appendValue< uint32_t >( header, 20000630 );
+    appendValue< uint32_t >( header, 2 );
+
+    std::vector< uint8_t > channels;
+    for( const char* name : { "B", "G", "R" } )
+    {
+        appendString( channels, name );
+        appendValue< int32_t >( channels, 2 ); // FLOAT
+        appendValue< uint32_t >( channels, 0 );
+        appendValue< int32_t >( channels, 1 );
+        appendValue< int32_t >( channels, 1 );
+    }
+    appendValue< uint8_t >( channels, 0 );
+    appendAttribute( header, "channels", "chlist", channels );
+    appendAttribute( header, "compression", "compression", { 0 } );
+
+    std::vector< uint8_t > window;
+    appendValue< int32_t >( window, 0 );
+    appendValue< int32_t >( window, 0 );
+    appendValue< int32_t >( window, resolution.x - 1 );
+    appendValue< int32_t >( window, resolution.y - 1 );
+    appendAttribute( header, "dataWindow", "box2i", window );
+    appendAttribute( header, "displayWindow", "box2i", window );
+    appendAttribute( header, "lineOrder", "lineOrder", { 0 } );
+
+    std::vector< uint8_t > one;
+    appendValue< float >( one, 1.0f );
+    appendAttribute( header, "pixelAspectRatio", "float", one );
+
+    std::vector< uint8_t > center;
+    appendValue< float >( center, 0.0f );
+    appendValue< float >( center, 0.0f );
+    appendAttribute( header, "screenWindowCenter", "v2f", center );
+    appendAttribute( header, "screenWindowWidth", "float", one );
+    appendValue< uint8_t >( header, 0 );
+
+    const uint64_t firstChunk = header.size() + (uint64_t)resolution.y * sizeof( uint64_t );
+    for( int y = 0; y < resolution.y; y++ )
+        appendValue< uint64_t >( header, firstChunk + (uint64_t)y * exrLineChunkSize( resolution.x ) );
+
+    return header;
+}
+
+// PNG chunks are big-endian, with a CRC over type and data
+static void writePngChunk(FILE* file, const char* type, const uint8_t* data, size_t length, bool* success)
+{
+    const uint8_t lengthBytes[ 4 ] = { (uint8_t)( length >> 24 ), (uint8_t)( length >> 16 ), (uint8_t)( length >> 8 ), (uint8_t)length };
+    uLong crc = crc32( 0, (const Bytef*)type, 4 );
+    if( length > 0 )
+        crc = crc32( crc, data, (uInt)length );
+    const uint8_t crcBytes[ 4 ] = { (uint8_t)( crc >> 24 ), (uint8_t)( crc >> 16 ), (uint8_t)( crc >> 8 ), (uint8_t)crc };
+
+    *success &= ( fwrite( lengthBytes, 1, 4, file ) == 4 );
+    *success &= ( fwrite( type, 1, 4, file ) == 4 );
+    if( length > 0 )
+        *success &= ( fwrite( data, 1, length, file ) == length );
+    *success &= ( fwrite( crcBytes, 1, 4, file ) == 4 );
+}
+
+#pragma mark ImageExporter Class
+
+ImageExporter::ImageExporter()
+    : ImageExporter( Options() )
+{
+}
+
+ImageExporter::ImageExporter(const Options& options)
+{
+    _options = options;
+    _options.workerCount = std::max( _options.workerCount, 1 );
+    _options.maxPendingImages = std::max( _options.maxPendingImages, 1 );
+    _options.stripHeight = std::max( _options.stripHeight, 1 );
+
+    for( int i = 0; i < _options.workerCount; i++ )
+        _workers.emplace_back( &ImageExporter::workerMain, this );
+}
+
+ImageExporter::~ImageExporter()
+{
+    waitUntilIdle();
+
+    {
+        std::lock_guard< std::mutex > lock( _lock );
+        _shuttingDown = true;
+    }
+    _taskCondition.notify_all();
+
+    for( std::thread& worker : _workers )
+        worker.join();
+}
+
+ImageExporter::Format ImageExporter::formatForPath(const std::string& path)
+{
+    std::string extension = path.substr( path.find_last_of( '.' ) + 1 );
+    std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+
+    if( extension == "exr" )
+        return FormatEXR;
+    if( extension == "pfm" )
+        return FormatPFM;
+    return FormatPNG;
+}
+
+bool ImageExporter::exportImage(std::shared_ptr< const ExportImage > image, const std::string& path, Format format,
+                                bool dropIfBusy, std::function<void(bool)> completion)
+{
+    if( image == nullptr || image->resolution.x <= 0 || image->resolution.y <= 0 )
+        return false;
+
+    std::shared_ptr< Job > job = makeJob( image->resolution, path, format, completion );
+    job->image = image;
+    return queueJob( job, dropIfBusy );
+}
+
+bool ImageExporter::exportImage(int2 resolution, std::function<std::shared_ptr< const ExportImage >()> makeImage,
+                                const std::string& path, Format format,
+                                bool dropIfBusy, std::function<void(bool)> completion)
+{
+    if( makeImage == nullptr || resolution.x <= 0 || resolution.y <= 0 )
+        return false;
+
+    std::shared_ptr< Job > job = makeJob( resolution, path, format, completion );
+    job->makeImage = makeImage;
+    return queueJob( job, dropIfBusy );
+}
+
+std::shared_ptr< ImageExporter::Job > ImageExporter::makeJob(int2 resolution, const std::string& path, Format format, std::function<void(bool)> completion) const
+{
+    // Set up everything that doesn't touch the disk here, off the workers
+    std::shared_ptr< Job > job = std::make_shared< Job >();
+    job->resolution = resolution;
+    job->path = path;
+    job->format = format;
+    job->completion = completion;
+    job->stripHeight = _options.stripHeight;
+    job->stripCount = ( resolution.y + job->stripHeight - 1 ) / job->stripHeight;
+    job->remainingStrips = job->stripCount;
+
+    if( format == FormatPNG )
+    {
+        job->compressedStrips.resize( job->stripCount );
+        job->stripAdlers.resize( job->stripCount );
+        job->stripLengths.resize( job->stripCount );
+    }
+    else if( format == FormatPFM )
+    {
+        // Negative scale means little-endian
+        char header[ 64 ];
+        const int length = snprintf( header, sizeof( header ), "PF\n%d %d\n-1.0\n", resolution.x, resolution.y );
+        job->header.assign( header, header + length );
+    }
+    else
+    {
+        job->header = exrHeader( resolution );
+    }
+    return job;
+}
+
+bool ImageExporter::queueJob(const std::shared_ptr< Job >& job, bool dropIfBusy)
+{
+    std::unique_lock< std::mutex > lock( _lock );
+    while( _pendingImages >= _options.maxPendingImages )
+    {
+        if( dropIfBusy )
+            return false;
+        _spaceCondition.wait( lock );
+    }
+
+    _pendingImages++;
+    if( job->image == nullptr )
+    {
+        _tasks.push_back( { job, kMakeImage } );
+    }
+    else
+    {
+        for( int strip = 0; strip < job->stripCount; strip++ )
+            _tasks.push_back( { job, strip } );
+    }
+    lock.unlock();
+
+    _taskCondition.notify_all();
+    return true;
+}
+
+void ImageExporter::waitUntilIdle()
+{
+    std::unique_lock< std::mutex > lock( _lock );
+    _spaceCondition.wait( lock, [this]{ return _pendingImages == 0; } );
+}
+
+void ImageExporter::workerMain()
+{
+#if defined(__APPLE__)
+    // Encoding is background work; stay out of the way of render workers and UI
+    pthread_set_qos_class_self_np( QOS_CLASS_UTILITY, 0 );
+#endif
+
+    std::unique_lock< std::mutex > lock( _lock );
+    while( true )
+    {
+        _taskCondition.wait( lock, [this]{ return _shuttingDown || _tasks.empty() == false; } );
+        if( _tasks.empty() )
+            return;
+
+        Task task = _tasks.front();
+        _tasks.pop_front();
+        lock.unlock();
+
+        // Deferred image: make it, then its strips go in line like any other
+        if( task.strip == kMakeImage )
+        {
+            Job& job = *task.job;
+            job.image = job.makeImage();
+            job.makeImage = nullptr;
+            if( job.image == nullptr || job.image->resolution.x != job.resolution.x || job.image->resolution.y != job.resolution.y )
+            {
+                printf( "Failed to make image %s\n", job.path.c_str() );
+                endJob( job, false );
+            }
+            else
+            {
+                lock.lock();
+                for( int strip = 0; strip < job.stripCount; strip++ )
+                    _tasks.push_back( { task.job, strip } );
+                lock.unlock();
+                _taskCondition.notify_all();
+            }
+
+            lock.lock();
+            continue;
+        }
+
+        encodeStrip( *task.job, task.strip );
+
+        // Last strip out writes / closes the file
+        if( --task.job->remainingStrips == 0 )
+        {
+            const bool success = finishJob( *task.job ) && task.job->failed == false;
+            if( success == false )
+                printf( "Failed to write image %s\n", task.job->path.c_str() );
+            endJob( *task.job, success );
+        }
+
+        lock.lock();
+    }
+}
+
+void ImageExporter::endJob(Job& job, bool success)
+{
+    if( job.completion )
+        job.completion( success );
+
+    {
+        std::lock_guard< std::mutex > lock( _lock );
+        _pendingImages--;
+    }
+    _spaceCondition.notify_all();
+}
+
+void ImageExporter::encodeStrip(Job& job, int strip)
+{
+    const ExportImage& image = *job.image;
+    const int width = image.resolution.x;
+    const int firstRow = strip * job.stripHeight;
+    const int lastRow = std::min( firstRow + job.stripHeight, image.resolution.y );
+
+    if( job.format == FormatPNG )
+    {
+        // Gamma correct to 8 bits, "Sub" filter per row so strips stay independent
+        std::vector< uint8_t > raw( (size_t)( lastRow - firstRow ) * ( 1 + width * 3 ) );
+        uint8_t* row = raw.data();
+        for( int y = firstRow; y < lastRow; y++ )
+        {
+            row[ 0 ] = 1;
+            const float* source = &image.pixels[ (size_t)y * width * 3 ];
+            for( int i = 0; i < width * 3; i++ )
+                row[ 1 + i ] = clamp( sqrt( fmax( source[ i ], 0.0f ) ) * 255.0f, 0, 255 );
+            
+            // Back to front, so each byte still sees its unfiltered left neighbour
+            for( int i = width * 3 - 1; i >= 3; i-- )
+                row[ 1 + i ] -= row[ 1 + i - 3 ];
+            row += 1 + width * 3;
+        }
+
+        // Raw deflate; all but the last strip end on a byte-aligned sync flush so
+        // the pieces concatenate into one valid stream
+        z_stream stream;
+        memset( &stream, 0, sizeof( stream ) );
+        if( deflateInit2( &stream, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+        {
+            job.failed = true;
+            return;
+        }
+
+        std::vector< uint8_t >& compressed = job.compressedStrips[ strip ];
+        compressed.resize( deflateBound( &stream, raw.size() ) + 64 );
+        stream.next_in = raw.data();
+        stream.avail_in = (uInt)raw.size();
+        stream.next_out = compressed.data();
+        stream.avail_out = (uInt)compressed.size();
+
+        const bool lastStrip = ( strip == job.stripCount - 1 );
+        const int result = deflate( &stream, lastStrip ? Z_FINISH : Z_SYNC_FLUSH );
+        if( ( lastStrip && result != Z_STREAM_END ) || ( lastStrip == false && result != Z_OK ) || stream.avail_in != 0 )
+            job.failed = true;
+
+        compressed.resize( stream.total_out );
+        deflateEnd( &stream );
+
+        job.stripAdlers[ strip ] = adler32( adler32( 0, nullptr, 0 ), raw.data(), (uInt)raw.size() );
+        job.stripLengths[ strip ] = raw.size();
+        return;
+    }
+
+    // PFM and EXR write straight into the file, which the first strip opens
+    std::call_once( job.openOnce, [&job]() {
+        job.file = open( job.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        if( job.file < 0 || pwrite( job.file, job.header.data(), job.header.size(), 0 ) != (ssize_t)job.header.size() )
+            job.failed = true;
+    });
+    if( job.file < 0 )
+        return;
+
+    std::vector< uint8_t > data;
+    uint64_t offset = 0;
+    if( job.format == FormatPFM )
+    {
+        // PFM rows go bottom to top, so this strip's rows land reversed
+        const size_t rowBytes = (size_t)width * 3 * sizeof( float );
+        data.resize( rowBytes * ( lastRow - firstRow ) );
+        for( int y = firstRow; y < lastRow; y++ )
+            memcpy( &data[ ( lastRow - 1 - y ) * rowBytes ], &image.pixels[ (size_t)y * width * 3 ], rowBytes );
+        offset = job.header.size() + (uint64_t)( image.resolution.y - lastRow ) * rowBytes;
+    }
+    else
+    {
+        // One chunk per scanline: y, byte count, then planar B, G, R
+        const size_t chunkSize = exrLineChunkSize( width );
+        data.resize( chunkSize * ( lastRow - firstRow ) );
+        uint8_t* chunk = data.data();
+        for( int y = firstRow; y < lastRow; y++ )
+        {
+            const int32_t lineHeader[ 2 ] = { y, (int32_t)( chunkSize - 2 * sizeof( int32_t ) ) };
+            memcpy( chunk, lineHeader, sizeof( lineHeader ) );
+
+            float* channels = (float*)( chunk + sizeof( lineHeader ) );
+            const float* source = &image.pixels[ (size_t)y * width * 3 ];
+            for( int x = 0; x < width; x++ )
+            {
+                channels[ x ] = source[ x * 3 + 2 ];
+                channels[ width + x ] = source[ x * 3 + 1 ];
+                channels[ 2 * width + x ] = source[ x * 3 + 0 ];
+            }
+            chunk += chunkSize;
+        }
+        offset = job.header.size() + (uint64_t)firstRow * chunkSize;
+    }
+
+    if( pwrite( job.file, data.data(), data.size(), offset ) != (ssize_t)data.size() )
+        job.failed = true;
+}
+
+bool ImageExporter::finishJob(Job& job)
+{
+    if( job.format != FormatPNG )
+    {
+        if( job.file < 0 )
+            return false;
+        return ( close( job.file ) == 0 );
+    }
+
+    if( job.failed )
+        return false;
+
+    FILE* file = fopen( job.path.c_str(), "wb" );
+    if( file == nullptr )
+        return false;
+
+    bool success = true;
+    const uint8_t signature[ 8 ] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    success &= ( fwrite( signature, 1, sizeof( signature ), file ) == sizeof( signature ) );
+
+    // 8-bit RGB, deflate, adaptive filtering, no interlace
+    const int2 resolution = job.image->resolution;
+    const uint8_t header[ 13 ] = {
+        (uint8_t)( resolution.x >> 24 ), (uint8_t)( resolution.x >> 16 ), (uint8_t)( resolution.x >> 8 ), (uint8_t)resolution.x,
+        (uint8_t)( resolution.y >> 24 ), (uint8_t)( resolution.y >> 16 ), (uint8_t)( resolution.y >> 8 ), (uint8_t)resolution.y,
+        8, 2, 0, 0, 0 };
+    writePngChunk( file, "IHDR", header, sizeof( header ), &success );
+
+    // One IDAT per strip: zlib header up front, combined adler32 at the very end
+    uLong adler = job.stripAdlers[ 0 ];
+    for( int strip = 1; strip < job.stripCount; strip++ )
+        adler = adler32_combine( adler, job.stripAdlers[ strip ], job.stripLengths[ strip ] );
+
+    for( int strip = 0; strip < job.stripCount; strip++ )
+    {
+        std::vector< uint8_t > data;
+        if( strip == 0 )
+        {
+            data.push_back( 0x78 );
+            data.push_back( 0x9c );
+        }
+        data.insert( data.end(), job.compressedStrips[ strip ].begin(), job.compressedStrips[ strip ].end() );
+        if( strip == job.stripCount - 1 )
+        {
+            data.push_back( (uint8_t)( adler >> 24 ) );
+            data.push_back( (uint8_t)( adler >> 16 ) );
+            data.push_back( (uint8_t)( adler >> 8 ) );
+            data.push_back( (uint8_t)adler );
+        }
+        writePngChunk( file, "IDAT", data.data(), data.size(), &success );
+
+        // Free as we go, big frames have big strips
+        std::vector< uint8_t >().swap( job.compressedStrips[ strip ] );
+    }
+
+    writePngChunk( file, "IEND", nullptr, 0, &success );
+    success &= ( fclose( file ) == 0 );
+    return success;
+}
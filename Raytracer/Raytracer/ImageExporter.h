@@ -0,0 +1,117 @@
+//
+//  ImageExporter.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef ImageExporter_h
+#define ImageExporter_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "VectorTypes.h"
+
+// A linear-radiance image handed off for export. The exporter only reads it,
+// so one copy can go out in several formats at once.
+struct ExportImage
+{
+    int2 resolution;
+    std::vector< float > pixels; // Packed RGB, rows top to bottom
+};
+
+// Writes images on its own threads so neither the render workers nor the UI
+// ever wait on compression or disk. Each image is cut into strips of rows that
+// are encoded in parallel: PNG strips are deflated independently and stitched,
+// PFM and EXR strips land straight in the file at precomputed offsets.
+class ImageExporter
+{
+public:
+
+    enum Format
+    {
+        FormatPNG,  // 8-bit, gamma corrected like the preview
+        FormatPFM,  // 32-bit float, linear
+        FormatEXR,  // 32-bit float scanline OpenEXR, linear
+    };
+
+    struct Options
+    {
+        int workerCount = 2;
+
+        // Images queued or being written; beyond this, exports block or drop
+        int maxPendingImages = 4;
+
+        // Rows per strip (the unit of parallel encoding)
+        int stripHeight = 64;
+    };
+
+    ImageExporter();
+    ImageExporter(const Options& options);
+
+    // Finishes everything queued before returning
+    ~ImageExporter();
+
+    // Picks a format from the path extension, PNG if unknown
+    static Format formatForPath(const std::string& path);
+
+    // Queue an image to be written. If the queue is full, waits for room, or returns
+    // false straight away when dropIfBusy is set (for snapshots nobody needs).
+    // The completion gets called on an exporter thread with whether the write worked.
+    bool exportImage(std::shared_ptr< const ExportImage > image, const std::string& path, Format format,
+                     bool dropIfBusy = false, std::function<void(bool)> completion = nullptr);
+
+    // Same, but the image is only made once the queue has room for it, on an
+    // exporter thread, so a dropped snapshot costs the caller nothing. The image
+    // has to come out at the given resolution; the completion still gets called
+    // if it doesn't
+    bool exportImage(int2 resolution, std::function<std::shared_ptr< const ExportImage >()> makeImage,
+                     const std::string& path, Format format,
+                     bool dropIfBusy = false, std::function<void(bool)> completion = nullptr);
+
+    // Blocks until nothing is queued or being written
+    void waitUntilIdle();
+
+private:
+
+    struct Job;
+
+    struct Task
+    {
+        std::shared_ptr< Job > job;
+        int strip; // kMakeImage to make the image first
+    };
+    static const int kMakeImage = -1;
+
+    std::shared_ptr< Job > makeJob(int2 resolution, const std::string& path, Format format, std::function<void(bool)> completion) const;
+    bool queueJob(const std::shared_ptr< Job >& job, bool dropIfBusy);
+
+    void workerMain();
+
+    void encodeStrip(Job& job, int strip);
+    bool finishJob(Job& job);
+
+    // Calls the completion and frees up the job's place in the queue
+    void endJob(Job& job, bool success);
+
+    Options _options;
+    std::vector< std::thread > _workers;
+
+    std::mutex _lock;
+    std::condition_variable _taskCondition;  // Tasks available (or shutting down)
+    std::condition_variable _spaceCondition; // A pending image finished
+    std::deque< Task > _tasks;
+    int _pendingImages = 0;
+    bool _shuttingDown = false;
+};
+
+#endif /* ImageExporter_h */
@@ -0,0 +1,345 @@
+//
+//  ImageLoader.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "ImageLoader.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+// Most a deflate stream can expand by
+static const size_t kMaxDeflateRatio = 1032;
+
+// Bytes left in the file: whatever a header claims has to fit in them before we
+// allocate for it
+static size_t remainingBytes(FILE* file)
+{
+    const long position = ftell( file );
+    if( position < 0 || fseek( file, 0, SEEK_END ) != 0 )
+        return 0;
+    const long end = ftell( file );
+    if( fseek( file, position, SEEK_SET ) != 0 || end < position )
+        return 0;
+    return end - position;
+}
+
+#pragma mark Loaders
+
+// Radiance RGBE, flat or new-style run-length encoded scanlines
+static bool loadRadianceHDR(FILE* file, int2* resolution, std::vector< float >* pixels)
+{
+    char line[ 256 ];
+    if( fgets( line, sizeof( line ), file ) == nullptr || strncmp( line, "#?", 2 ) != 0 )
+        return false;
+
+    // Header runs until an empty line
+    while( fgets( line, sizeof( line ), file ) != nullptr )
+    {
+        if( strcmp( line, "\n" ) == 0 )
+            break;
+        if( strncmp( line, "FORMAT=", 7 ) == 0 && strstr( line, "32-bit_rle_rgbe" ) == nullptr )
+            return false;
+    }
+
+    int width = 0, height = 0;
+    if( fgets( line, sizeof( line ), file ) == nullptr || sscanf( line, "-Y %d +X %d", &height, &width ) != 2 || width <= 0 || height <= 0 )
+        return false;
+
+    // Run-length scanlines take at least a 2 byte run per 127 pixels per channel
+    const size_t minScanlineBytes = ( width >= 8 && width < 32768 ) ? 4 + 8 * (size_t)( ( width + 126 ) / 127 ) : (size_t)width * 4;
+    if( (size_t)height > remainingBytes( file ) / minScanlineBytes )
+        return false;
+
+    *resolution = simd_make_int2( width, height );
+    pixels->resize( (size_t)width * height * 3 );
+
+    std::vector< uint8_t > scanline( (size_t)width * 4 );
+    for( int y = 0; y < height; y++ )
+    {
+        uint8_t start[ 4 ];
+        if( fread( start, 1, 4, file ) != 4 )
+            return false;
+
+        const bool isRunLength = ( width >= 8 && width < 32768 && start[ 0 ] == 2 && start[ 1 ] == 2 && ( ( start[ 2 ] << 8 ) | start[ 3 ] ) == width );
+        if( isRunLength )
+        {
+            // Each of R, G, B, E is its own run of runs
+            for( int channel = 0; channel < 4; channel++ )
+            {
+                int x = 0;
+                while( x < width )
+                {
+                    int count = fgetc( file );
+                    if( count == EOF )
+                        return false;
+
+                    if( count > 128 )
+                    {
+                        count -= 128;
+                        const int value = fgetc( file );
+                        if( value == EOF || x + count > width )
+                            return false;
+                        for( int i = 0; i < count; i++ )
+                            scanline[ ( x++ ) * 4 + channel ] = (uint8_t)value;
+                    }
+                    else
+                    {
+                        if( count == 0 || x + count > width )
+                            return false;
+                        for( int i = 0; i < count; i++ )
+                        {
+                            const int value = fgetc( file );
+                            if( value == EOF )
+                                return false;
+                            scanline[ ( x++ ) * 4 + channel ] = (uint8_t)value;
+                        }
+                    }
+                }
+            }
+        }
+        else
+        {
+            memcpy( scanline.data(), start, 4 );
+            if( fread( scanline.data() + 4, 1, ( width - 1 ) * 4, file ) != (size_t)( width - 1 ) * 4 )
+                return false;
+        }
+
+        float* destination = &( *pixels )[ (size_t)y * width * 3 ];
+        for( int x = 0; x < width; x++ )
+        {
+            const uint8_t* rgbe = &scanline[ x * 4 ];
+            const float scale = ( rgbe[ 3 ] == 0 ) ? 0.0f : ldexp( 1.0f, rgbe[ 3 ] - ( 128 + 8 ) );
+            destination[ x * 3 + 0 ] = rgbe[ 0 ] * scale;
+            destination[ x * 3 + 1 ] = rgbe[ 1 ] * scale;
+            destination[ x * 3 + 2 ] = rgbe[ 2 ] * scale;
+        }
+    }
+
+    return true;
+}
+
+// Portable float map, color or grey; rows are stored bottom to top
+static bool loadPFM(FILE* file, int2* resolution, std::vector< float >* pixels)
+{
+    char type[ 3 ] = {};
+    int width = 0, height = 0;
+    float scale = 0;
+    if( fscanf( file, "%2s %d %d %f", type, &width, &height, &scale ) != 4 || width <= 0 || height <= 0 )
+        return false;
+    fgetc( file ); // Single whitespace before the data
+
+    const int channels = ( strcmp( type, "PF" ) == 0 ) ? 3 : ( strcmp( type, "Pf" ) == 0 ) ? 1 : 0;
+    if( channels == 0 || (size_t)height > remainingBytes( file ) / ( (size_t)width * channels * sizeof( float ) ) )
+        return false;
+
+    *resolution = simd_make_int2( width, height );
+    pixels->resize( (size_t)width * height * 3 );
+
+    const bool swapBytes = ( scale > 0 ); // Big-endian file, we're little-endian
+    std::vector< float > row( (size_t)width * channels );
+    for( int y = height - 1; y >= 0; y-- )
+    {
+        if( fread( row.data(), sizeof( float ), row.size(), file ) != row.size() )
+            return false;
+
+        float* destination = &( *pixels )[ (size_t)y * width * 3 ];
+        for( int x = 0; x < width; x++ )
+        {
+            for( int channel = 0; channel < 3; channel++ )
+            {
+                float value = row[ (size_t)x * channels + ( channels == 3 ? channel : 0 ) ];
+                if( swapBytes )
+                {
+                    uint32_t bits;
+                    memcpy( &bits, &value, sizeof( bits ) );
+                    bits = __builtin_bswap32( bits );
+                    memcpy( &value, &bits, sizeof( value ) );
+                }
+                destination[ x * 3 + channel ] = value;
+            }
+        }
+    }
+
+    return true;
+}
+
+static uint32_t readBigEndian32(const uint8_t* bytes)
+{
+    return ( (uint32_t)bytes[ 0 ] << 24 ) | ( (uint32_t)bytes[ 1 ] << 16 ) | ( (uint32_t)bytes[ 2 ] << 8 ) | bytes[ 3 ];
+}
+
+static float srgbToLinear(float value)
+{
+    return ( value <= 0.04045f ) ? value / 12.92f : pow( ( value + 0.055f ) / 1.055f, 2.4f );
+}
+
+// PNG, any color type at 8 or 16 bits per channel (palettes at 8), not interlaced
+static bool loadPNG(FILE* file, int2* resolution, std::vector< float >* pixels, bool srgb)
+{
+    static const uint8_t kSignature[ 8 ] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    uint8_t signature[ 8 ];
+    if( fread( signature, 1, 8, file ) != 8 || memcmp( signature, kSignature, 8 ) != 0 )
+        return false;
+
+    int width = 0, height = 0, bitDepth = 0, colorType = -1;
+    std::vector< uint8_t > palette;
+    std::vector< uint8_t > compressed;
+    while( true )
+    {
+        uint8_t chunkHeader[ 8 ];
+        if( fread( chunkHeader, 1, 8, file ) != 8 )
+            return false;
+
+        // Lengths come straight from the file: check before allocating
+        const uint32_t length = readBigEndian32( chunkHeader );
+        if( length > ( 1u << 30 ) || length > remainingBytes( file ) )
+            return false;
+        std::vector< uint8_t > data( length );
+        if( fread( data.data(), 1, length, file ) != length || fseek( file, 4, SEEK_CUR ) != 0 )
+            return false;
+
+        if( memcmp( chunkHeader + 4, "IHDR", 4 ) == 0 && length >= 13 )
+        {
+            width = (int)readBigEndian32( &data[ 0 ] );
+            height = (int)readBigEndian32( &data[ 4 ] );
+            bitDepth = data[ 8 ];
+            colorType = data[ 9 ];
+            if( data[ 12 ] != 0 ) // Interlaced
+                return false;
+        }
+        else if( memcmp( chunkHeader + 4, "PLTE", 4 ) == 0 )
+        {
+            palette = data;
+        }
+        else if( memcmp( chunkHeader + 4, "IDAT", 4 ) == 0 )
+        {
+            compressed.insert( compressed.end(), data.begin(), data.end() );
+        }
+        else if( memcmp( chunkHeader + 4, "IEND", 4 ) == 0 )
+        {
+            break;
+        }
+    }
+
+    int channels = 0;
+    switch( colorType )
+    {
+        case 0: channels = 1; break; // Grey
+        case 2: channels = 3; break; // RGB
+        case 3: channels = 1; break; // Palette
+        case 4: channels = 2; break; // Grey, alpha
+        case 6: channels = 4; break; // RGBA
+        default: return false;
+    }
+    if( width <= 0 || height <= 0 || ( bitDepth != 8 && bitDepth != 16 ) || ( colorType == 3 && bitDepth != 8 ) )
+        return false;
+
+    // Every row starts with its filter type
+    const int bytesPerPixel = channels * bitDepth / 8;
+    const size_t rowBytes = (size_t)width * bytesPerPixel;
+    if( (size_t)height > ( compressed.size() * kMaxDeflateRatio + 64 ) / ( rowBytes + 1 ) )
+        return false;
+    std::vector< uint8_t > raw( ( rowBytes + 1 ) * height );
+    uLongf rawSize = raw.size();
+    if( uncompress( raw.data(), &rawSize, compressed.data(), compressed.size() ) != Z_OK || rawSize != raw.size() )
+        return false;
+
+    *resolution = simd_make_int2( width, height );
+    pixels->resize( (size_t)width * height * 3 );
+
+    std::vector< uint8_t > previous( rowBytes, 0 );
+    std::vector< uint8_t > row( rowBytes );
+    const float maxValue = ( bitDepth == 16 ) ? 65535.0f : 255.0f;
+    for( int y = 0; y < height; y++ )
+    {
+        const uint8_t filter = raw[ y * ( rowBytes + 1 ) ];
+        const uint8_t* source = &raw[ y * ( rowBytes + 1 ) + 1 ];
+        for( size_t i = 0; i < rowBytes; i++ )
+        {
+            const int left = ( i >= (size_t)bytesPerPixel ) ? row[ i - bytesPerPixel ] : 0;
+            const int up = previous[ i ];
+            const int upLeft = ( i >= (size_t)bytesPerPixel ) ? previous[ i - bytesPerPixel ] : 0;
+            int predictor = 0;
+            switch( filter )
+            {
+                case 0: predictor = 0; break;
+                case 1: predictor = left; break;
+                case 2: predictor = up; break;
+                case 3: predictor = ( left + up ) / 2; break;
+                case 4:
+                {
+                    // Paeth: whichever neighbour is closest to left + up - upLeft
+                    const int estimate = left + up - upLeft;
+                    const int toLeft = abs( estimate - left );
+                    const int toUp = abs( estimate - up );
+                    const int toUpLeft = abs( estimate - upLeft );
+                    predictor = ( toLeft <= toUp && toLeft <= toUpLeft ) ? left : ( toUp <= toUpLeft ) ? up : upLeft;
+                    break;
+                }
+                default: return false;
+            }
+            row[ i ] = (uint8_t)( source[ i ] + predictor );
+        }
+
+        float* destination = &( *pixels )[ (size_t)y * width * 3 ];
+        for( int x = 0; x < width; x++ )
+        {
+            float rgb[ 3 ];
+            if( colorType == 3 )
+            {
+                const size_t entry = row[ x ] * 3;
+                if( entry + 2 >= palette.size() )
+                    return false;
+                for( int channel = 0; channel < 3; channel++ )
+                    rgb[ channel ] = palette[ entry + channel ] / maxValue;
+            }
+            else
+            {
+                for( int channel = 0; channel < 3; channel++ )
+                {
+                    // Grey repeats its one channel; alpha is skipped
+                    const int sourceChannel = ( channels >= 3 ) ? channel : 0;
+                    const uint8_t* value = &row[ (size_t)x * bytesPerPixel + sourceChannel * ( bitDepth / 8 ) ];
+                    rgb[ channel ] = ( ( bitDepth == 16 ) ? ( ( value[ 0 ] << 8 ) | value[ 1 ] ) : value[ 0 ] ) / maxValue;
+                }
+            }
+
+            for( int channel = 0; channel < 3; channel++ )
+                destination[ x * 3 + channel ] = srgb ? srgbToLinear( rgb[ channel ] ) : rgb[ channel ];
+        }
+
+        previous.swap( row );
+    }
+
+    return true;
+}
+
+#pragma mark Loading
+
+bool loadImage(const std::string& path, int2* resolution, std::vector< float >* pixels, bool srgb)
+{
+    FILE* file = fopen( path.c_str(), "rb" );
+    if( file == nullptr )
+        return false;
+
+    std::string extension = path.substr( path.find_last_of( '.' ) + 1 );
+    std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+
+    bool loaded = false;
+    if( extension == "pfm" )
+        loaded = loadPFM( file, resolution, pixels );
+    else if( extension == "png" )
+        loaded = loadPNG( file, resolution, pixels, srgb );
+    else
+        loaded = loadRadianceHDR( file, resolution, pixels );
+    fclose( file );
+
+    return loaded;
+}
@@ -0,0 +1,23 @@
+//
+//  ImageLoader.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef ImageLoader_h
+#define ImageLoader_h
+
+#include <string>
+#include <vector>
+
+#include "VectorTypes.h"
+
+// Reads a Radiance .hdr, a .pfm or a .png (8 or 16 bit, not interlaced) into
+// packed linear RGB, rows top to bottom. PNGs hold display values: they get
+// the sRGB curve taken off, unless they hold data (roughness, masks..) and
+// srgb is false. Alpha is dropped. False on failure.
+bool loadImage(const std::string& path, int2* resolution, std::vector< float >* pixels, bool srgb = true);
+
+#endif /* ImageLoader_h */
@@ -0,0 +1,433 @@
+//
+//  PathGuide.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "PathGuide.h"
+
+#include <sched.h>
+
+#include <algorithm>
+
+// Deeper than this and regions just stop splitting
+static const int kMaxSpatialDepth = 48;
+
+// Keeps u strictly below 1 after remapping
+static const float kOneMinusEpsilon = 0.99999994f;
+
+// Threads recording at once; more than this wait for one to exit
+static const int kMaxRecorderCount = 256;
+
+// Which recorder each thread uses, in every guide; claimed on its first record
+// and given back when it exits
+static std::atomic< bool > gRecorderClaimed[ kMaxRecorderCount ];
+
+struct ThreadRecorder
+{
+    int slot = -1;
+
+    ~ThreadRecorder()
+    {
+        if( slot >= 0 )
+            gRecorderClaimed[ slot ].store( false, std::memory_order_release );
+    }
+};
+static thread_local ThreadRecorder tRecorder;
+
+static int recorderSlot()
+{
+    ThreadRecorder& recorder = tRecorder;
+    while( recorder.slot < 0 )
+    {
+        for( int slot = 0; slot < kMaxRecorderCount && recorder.slot < 0; slot++ )
+        {
+            bool claimed = false;
+            if( gRecorderClaimed[ slot ].compare_exchange_strong( claimed, true, std::memory_order_acquire ) )
+                recorder.slot = slot;
+        }
+        if( recorder.slot < 0 )
+            sched_yield();
+    }
+    return recorder.slot;
+}
+
+static float2 directionToSquare(const float3& direction)
+{
+    const float3 dir = simd_normalize( direction );
+    const float cosTheta = std::min( std::max( dir.z, -1.0f ), 1.0f );
+    float phi = atan2( dir.y, dir.x );
+    if( phi < 0 )
+        phi += 2.0 * M_PI;
+
+    return simd_make_float2( ( cosTheta + 1.0f ) * 0.5f, std::min( phi / (float)( 2.0 * M_PI ), kOneMinusEpsilon ) );
+}
+
+static float3 squareToDirection(float2 p)
+{
+    const float cosTheta = 2.0f * p.x - 1.0f;
+    const float sinTheta = sqrt( std::max( 0.0f, 1.0f - cosTheta * cosTheta ) );
+    const float phi = 2.0 * M_PI * p.y;
+    return simd_make_float3( sinTheta * cos( phi ), sinTheta * sin( phi ), cosTheta );
+}
+
+#pragma mark DTree Class
+
+PathGuide::DTree::Node::Node()
+{
+    for( int i = 0; i < 4; i++ )
+    {
+        sums[ i ] = 0;
+        children[ i ] = 0;
+    }
+}
+
+PathGuide::DTree::DTree()
+{
+    _nodes.resize( 1 );
+}
+
+float PathGuide::DTree::total() const
+{
+    const Node& root = _nodes[ 0 ];
+    return root.sums[ 0 ] + root.sums[ 1 ] + root.sums[ 2 ] + root.sums[ 3 ];
+}
+
+int PathGuide::DTree::nodeCount() const
+{
+    return (int)_nodes.size();
+}
+
+int PathGuide::DTree::leafAt(float2 p) const
+{
+    int index = 0;
+    while( true )
+    {
+        const int xHalf = ( p.x >= 0.5f ) ? 1 : 0;
+        const int yHalf = ( p.y >= 0.5f ) ? 1 : 0;
+        const int quadrant = yHalf * 2 + xHalf;
+
+        const int child = _nodes[ index ].children[ quadrant ];
+        if( child == 0 )
+            return index * 4 + quadrant;
+
+        index = child;
+        p = simd_make_float2( p.x * 2 - xHalf, p.y * 2 - yHalf );
+    }
+}
+
+void PathGuide::DTree::merge(const std::vector< float >& leafSums)
+{
+    for( size_t leaf = 0; leaf < leafSums.size(); leaf++ )
+        _nodes[ leaf / 4 ].sums[ leaf % 4 ] += leafSums[ leaf ];
+}
+
+void PathGuide::DTree::sumInnerNodes()
+{
+    // Children always come after their parents, so going backwards every child is done first
+    for( int index = (int)_nodes.size() - 1; index >= 0; index-- )
+    {
+        Node& node = _nodes[ index ];
+        for( int quadrant = 0; quadrant < 4; quadrant++ )
+        {
+            const int child = node.children[ quadrant ];
+            if( child != 0 )
+            {
+                const Node& childNode = _nodes[ child ];
+                node.sums[ quadrant ] = childNode.sums[ 0 ] + childNode.sums[ 1 ] + childNode.sums[ 2 ] + childNode.sums[ 3 ];
+            }
+        }
+    }
+}
+
+float2 PathGuide::DTree::sample(float2 u) const
+{
+    float2 origin = simd_make_float2( 0, 0 );
+    float size = 1;
+    int index = 0;
+    while( true )
+    {
+        const Node& node = _nodes[ index ];
+        const float sums[ 4 ] = { node.sums[ 0 ], node.sums[ 1 ], node.sums[ 2 ], node.sums[ 3 ] };
+        const float total = sums[ 0 ] + sums[ 1 ] + sums[ 2 ] + sums[ 3 ];
+        if( total <= 0 )
+            return origin + u * size;
+
+        // Pick the column, then the row within it, reusing u each time
+        int xHalf = 0;
+        const float left = ( sums[ 0 ] + sums[ 2 ] ) / total;
+        if( u.x < left )
+        {
+            u.x = u.x / left;
+        }
+        else
+        {
+            xHalf = 1;
+            u.x = ( u.x - left ) / ( 1.0f - left );
+        }
+
+        int yHalf = 0;
+        const float columnTotal = sums[ xHalf ] + sums[ 2 + xHalf ];
+        const float bottom = sums[ xHalf ] / columnTotal;
+        if( u.y < bottom )
+        {
+            u.y = u.y / bottom;
+        }
+        else
+        {
+            yHalf = 1;
+            u.y = ( u.y - bottom ) / ( 1.0f - bottom );
+        }
+        u = simd_make_float2( std::min( u.x, kOneMinusEpsilon ), std::min( u.y, kOneMinusEpsilon ) );
+
+        size *= 0.5f;
+        origin += simd_make_float2( xHalf, yHalf ) * size;
+
+        const int child = node.children[ yHalf * 2 + xHalf ];
+        if( child == 0 )
+            return origin + u * size;
+        index = child;
+    }
+}
+
+float PathGuide::DTree::pdf(float2 p) const
+{
+    float pdf = 1;
+    int index = 0;
+    while( true )
+    {
+        const Node& node = _nodes[ index ];
+        const float total = node.sums[ 0 ] + node.sums[ 1 ] + node.sums[ 2 ] + node.sums[ 3 ];
+        if( total <= 0 )
+            return pdf;
+
+        const int xHalf = ( p.x >= 0.5f ) ? 1 : 0;
+        const int yHalf = ( p.y >= 0.5f ) ? 1 : 0;
+        const int quadrant = yHalf * 2 + xHalf;
+        pdf *= 4.0f * node.sums[ quadrant ] / total;
+
+        const int child = node.children[ quadrant ];
+        if( child == 0 || pdf <= 0 )
+            return pdf;
+
+        index = child;
+        p = simd_make_float2( p.x * 2 - xHalf, p.y * 2 - yHalf );
+    }
+}
+
+PathGuide::DTree PathGuide::DTree::refined(float threshold, int maxDepth) const
+{
+    DTree tree;
+    const float total = this->total();
+    if( total <= 0 )
+        return tree;
+
+    const Node& root = _nodes[ 0 ];
+    const float energy[ 4 ] = { root.sums[ 0 ], root.sums[ 1 ], root.sums[ 2 ], root.sums[ 3 ] };
+    refineNode( tree, 0, 0, energy, total, threshold, 1, maxDepth );
+    return tree;
+}
+
+void PathGuide::DTree::refineNode(DTree& tree, int index, int oldIndex, const float energy[ 4 ], float total,
+                                  float threshold, int depth, int maxDepth) const
+{
+    for( int quadrant = 0; quadrant < 4; quadrant++ )
+    {
+        if( energy[ quadrant ] <= threshold * total || depth >= maxDepth )
+            continue;
+
+        // Split: take the energy of the old children, or spread it evenly where
+        // the old tree stopped
+        float childEnergy[ 4 ];
+        int oldChild = ( oldIndex >= 0 ) ? _nodes[ oldIndex ].children[ quadrant ] : 0;
+        for( int i = 0; i < 4; i++ )
+            childEnergy[ i ] = ( oldChild != 0 ) ? _nodes[ oldChild ].sums[ i ] : energy[ quadrant ] * 0.25f;
+
+        const int child = (int)tree._nodes.size();
+        tree._nodes.emplace_back();
+        tree._nodes[ index ].children[ quadrant ] = child;
+        refineNode( tree, child, ( oldChild != 0 ) ? oldChild : -1, childEnergy, total, threshold, depth + 1, maxDepth );
+    }
+}
+
+#pragma mark PathGuide Class
+
+PathGuide::PathGuide(const AABB& bounds, const Options& options)
+{
+    _options = options;
+
+    // Cubic, so every split halves a cube-ish box
+    const float3 extent = bounds.max - bounds.min;
+    _size = std::max( extent.x, std::max( extent.y, extent.z ) ) * 1.01f;
+    _origin = bounds.center() - simd_make_float3( _size, _size, _size ) * 0.5f;
+
+    SpatialNode root;
+    root.children[ 0 ] = 0;
+    root.children[ 1 ] = 0;
+    root.region = 0;
+    root.depth = 0;
+    _spatialNodes.push_back( root );
+    _regions.emplace_back( new Region() );
+    _recorders.resize( kMaxRecorderCount );
+}
+
+PathGuide::~PathGuide()
+{
+}
+
+float PathGuide::bsdfSamplingFraction() const
+{
+    return _options.bsdfSamplingFraction;
+}
+
+void PathGuide::beginPasses()
+{
+    _iteration = 0;
+
+    // A render cut short may have recorded a pass it never refined from
+    for( Recorder& recorder : _recorders )
+    {
+        recorder.sampleCounts.clear();
+        recorder.leafSums.clear();
+    }
+}
+
+int PathGuide::regionAt(const float3& position) const
+{
+    float3 p = ( position - _origin ) / _size;
+    p = simd_clamp( p, simd_make_float3( 0, 0, 0 ), simd_make_float3( 1, 1, 1 ) );
+
+    int index = 0;
+    while( _spatialNodes[ index ].children[ 0 ] != 0 )
+    {
+        const SpatialNode& node = _spatialNodes[ index ];
+        const int axis = node.depth % 3;
+        if( p[ axis ] < 0.5f )
+        {
+            p[ axis ] *= 2;
+            index = node.children[ 0 ];
+        }
+        else
+        {
+            p[ axis ] = p[ axis ] * 2 - 1;
+            index = node.children[ 1 ];
+        }
+    }
+    return _spatialNodes[ index ].region;
+}
+
+float3 PathGuide::sample(int region, float2 u) const
+{
+    return squareToDirection( _regions[ region ]->sampling.sample( u ) );
+}
+
+float PathGuide::pdf(int region, const float3& direction) const
+{
+    // The square maps to the sphere with constant area scaling
+    return _regions[ region ]->sampling.pdf( directionToSquare( direction ) ) / ( 4.0 * M_PI );
+}
+
+void PathGuide::record(int region, const float3& direction, float value)
+{
+    // Non-finite estimates would poison the whole region
+    if( isfinite( value ) == false || value < 0 )
+        return;
+
+    // Only this thread touches its recorder until refine()
+    Recorder& recorder = _recorders[ recorderSlot() ];
+    if( recorder.sampleCounts.size() < _regions.size() )
+    {
+        recorder.sampleCounts.resize( _regions.size(), 0 );
+        recorder.leafSums.resize( _regions.size() );
+    }
+
+    recorder.sampleCounts[ region ]++;
+    if( value > 0 )
+    {
+        const DTree& building = _regions[ region ]->building;
+        std::vector< float >& leafSums = recorder.leafSums[ region ];
+        if( leafSums.empty() )
+            leafSums.resize( building.nodeCount() * 4, 0.0f );
+        leafSums[ building.leafAt( directionToSquare( direction ) ) ] += value;
+    }
+}
+
+void PathGuide::refine()
+{
+    // Gather every thread's records
+    for( Recorder& recorder : _recorders )
+    {
+        for( size_t region = 0; region < recorder.sampleCounts.size(); region++ )
+        {
+            _regions[ region ]->sampleCount += recorder.sampleCounts[ region ];
+            if( recorder.leafSums[ region ].empty() == false )
+                _regions[ region ]->building.merge( recorder.leafSums[ region ] );
+        }
+        recorder.sampleCounts.clear();
+        recorder.leafSums.clear();
+    }
+    for( std::unique_ptr< Region >& region : _regions )
+        region->building.sumInnerNodes();
+
+    // What was learned becomes what gets sampled; regions that saw nothing keep theirs
+    for( std::unique_ptr< Region >& region : _regions )
+    {
+        if( region->building.total() <= 0 )
+            continue;
+
+        DTree next = region->building.refined( _options.directionalThreshold, _options.maxDirectionalDepth );
+        region->sampling = region->building;
+        region->building = next;
+    }
+
+    // Split busy regions; passes double in samples, so the bar goes up by sqrt(2)
+    const float threshold = _options.spatialThreshold * sqrt( pow( 2.0, _iteration ) );
+    const size_t leafCount = _spatialNodes.size();
+    for( size_t index = 0; index < leafCount; index++ )
+    {
+        if( _spatialNodes[ index ].children[ 0 ] == 0 )
+            splitRegion( (int)index, _regions[ _spatialNodes[ index ].region ]->sampleCount, threshold );
+    }
+
+    for( std::unique_ptr< Region >& region : _regions )
+        region->sampleCount = 0;
+
+    _iteration++;
+}
+
+void PathGuide::splitRegion(int nodeIndex, float sampleCount, float threshold)
+{
+    if( sampleCount <= threshold || _spatialNodes[ nodeIndex ].depth >= kMaxSpatialDepth )
+        return;
+
+    // Both halves start from the parent's distributions; assume the samples split evenly
+    const int regionIndex = _spatialNodes[ nodeIndex ].region;
+    Region* copy = new Region();
+    copy->sampling = _regions[ regionIndex ]->sampling;
+    copy->building = _regions[ regionIndex ]->building;
+    _regions.emplace_back( copy );
+
+    SpatialNode child;
+    child.children[ 0 ] = 0;
+    child.children[ 1 ] = 0;
+    child.depth = _spatialNodes[ nodeIndex ].depth + 1;
+
+    const int firstChild = (int)_spatialNodes.size();
+    child.region = regionIndex;
+    _spatialNodes.push_back( child );
+    child.region = (int)_regions.size() - 1;
+    _spatialNodes.push_back( child );
+
+    _spatialNodes[ nodeIndex ].children[ 0 ] = firstChild;
+    _spatialNodes[ nodeIndex ].children[ 1 ] = firstChild + 1;
+
+    splitRegion( firstChild, sampleCount * 0.5f, threshold );
+    splitRegion( firstChild + 1, sampleCount * 0.5f, threshold );
+}
+
+int PathGuide::regionCount() const
+{
+    return (int)_regions.size();
+}
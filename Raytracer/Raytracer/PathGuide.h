@@ -0,0 +1,148 @@
+//
+//  PathGuide.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef PathGuide_h
+#define PathGuide_h
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "BVH.h"
+#include "VectorTypes.h"
+
+// Learned incident radiance for guiding bounces ("practical path guiding" SD-tree).
+// A binary tree splits space, and each of its leaves (a region) keeps a quadtree
+// over directions. During a pass, renders sample from the regions' sampling
+// quadtrees while recording what they find into the building quadtrees; between
+// passes, refine() swaps them over and adapts both trees to where the samples
+// and the energy went. Each thread records into sums of its own, which refine()
+// merges, so threads don't all fight over the same few tree nodes.
+class PathGuide
+{
+public:
+
+    struct Options
+    {
+        // Share of bounces that still sample the material: keeps the estimate
+        // unbiased where the guide has learned nothing (or the wrong thing)
+        float bsdfSamplingFraction = 0.5f;
+
+        // A region splits once it got more than this many samples (times
+        // sqrt(2^pass), as passes double their samples)
+        int spatialThreshold = 4000;
+
+        // Directions split where a quadrant holds more than this share of a region's energy
+        float directionalThreshold = 0.01f;
+        int maxDirectionalDepth = 20;
+    };
+
+    PathGuide(const AABB& bounds, const Options& options);
+    ~PathGuide();
+
+    float bsdfSamplingFraction() const;
+
+    // Before the first pass of a render: keeps what was learned, but the split
+    // threshold starts over from the first pass's
+    void beginPasses();
+
+    // Region containing the position; valid until the next refine()
+    int regionAt(const float3& position) const;
+
+    // Unit direction from the region's learned distribution, and its density per solid angle
+    float3 sample(int region, float2 u) const;
+    float pdf(int region, const float3& direction) const;
+
+    // An estimate of radiance arriving from the direction, already divided by the
+    // density it was sampled with. Safe from any number of threads (up to 256 at once)
+    void record(int region, const float3& direction, float value);
+
+    // Between passes, with no one sampling or recording
+    void refine();
+
+    int regionCount() const;
+
+private:
+
+    // Directional quadtree over the square of ( ( cos theta + 1 ) / 2, phi / 2 pi ),
+    // which maps to the sphere with equal area
+    class DTree
+    {
+    public:
+
+        DTree();
+
+        float total() const;
+        int nodeCount() const;
+
+        // Leaf holding p, as node index * 4 + quadrant
+        int leafAt(float2 p) const;
+
+        // Adds sums recorded per leaf (indexed like leafAt()) in, then redoes the
+        // inner nodes' sums from their children
+        void merge(const std::vector< float >& leafSums);
+        void sumInnerNodes();
+
+        float2 sample(float2 u) const;
+        float pdf(float2 p) const; // Over the unit square
+
+        // New tree split where this one's energy is, all sums zero
+        DTree refined(float threshold, int maxDepth) const;
+
+    private:
+
+        // Quadrant q covers x half ( q & 1 ), y half ( q >> 1 ); child 0 means a leaf
+        struct Node
+        {
+            float sums[ 4 ];
+            int children[ 4 ];
+
+            Node();
+        };
+
+        std::vector< Node > _nodes;
+
+        void refineNode(DTree& tree, int index, int oldIndex, const float energy[ 4 ], float total,
+                        float threshold, int depth, int maxDepth) const;
+    };
+
+    struct Region
+    {
+        DTree sampling;
+        DTree building;
+        uint32_t sampleCount = 0;
+    };
+
+    // One thread's records since the last refine(), allocated as regions get hit
+    struct Recorder
+    {
+        std::vector< std::vector< float > > leafSums; // Per region, indexed like DTree::leafAt()
+        std::vector< uint32_t > sampleCounts;         // Per region
+    };
+
+    // Binary tree over the (cubic) bounds, splitting axes x, y, z in turn
+    struct SpatialNode
+    {
+        int children[ 2 ]; // 0 for leaves
+        int region;
+        int depth;
+    };
+
+    Options _options;
+    float3 _origin;
+    float _size;
+    int _iteration = 0;
+
+    std::vector< SpatialNode > _spatialNodes;
+    std::vector< std::unique_ptr< Region > > _regions;
+    std::vector< Recorder > _recorders; // By thread slot
+
+    void splitRegion(int nodeIndex, float sampleCount, float threshold);
+};
+
+#endif /* PathGuide_h */
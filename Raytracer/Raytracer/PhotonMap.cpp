@@ -0,0 +1,160 @@
+//
+//  PhotonMap.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "PhotonMap.h"
+
+#include <algorithm>
+
+// Neighbours the automatic radius aims for, and photons it measures around
+static const int kRadiusNeighbourCount = 32;
+static const int kRadiusProbeCount = 64;
+
+PhotonMap::PhotonMap(const Options& options)
+{
+    _options = options;
+    reset();
+}
+
+const PhotonMap::Options& PhotonMap::options() const
+{
+    return _options;
+}
+
+void PhotonMap::reset()
+{
+    _radius = std::max( _options.initialRadius, 0.0f );
+    _passIndex = 0;
+}
+
+uint32_t PhotonMap::bucket(int x, int y, int z) const
+{
+    return ( (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u ) & _bucketMask;
+}
+
+float PhotonMap::estimateRadius() const
+{
+    // Median over a spread of photons of the distance to their Nth nearest neighbour
+    const size_t count = _photons.size();
+    const size_t neighbour = std::min( (size_t)kRadiusNeighbourCount, count - 1 );
+    std::vector< float > radii;
+    std::vector< float > distances( count );
+    for( int probe = 0; probe < kRadiusProbeCount; probe++ )
+    {
+        const Photon& center = _photons[ probe * count / kRadiusProbeCount ];
+        for( size_t i = 0; i < count; i++ )
+        {
+            const float dx = _photons[ i ].pos[ 0 ] - center.pos[ 0 ];
+            const float dy = _photons[ i ].pos[ 1 ] - center.pos[ 1 ];
+            const float dz = _photons[ i ].pos[ 2 ] - center.pos[ 2 ];
+            distances[ i ] = dx * dx + dy * dy + dz * dz;
+        }
+        std::nth_element( distances.begin(), distances.begin() + neighbour, distances.end() );
+        radii.push_back( sqrt( distances[ neighbour ] ) );
+    }
+    std::nth_element( radii.begin(), radii.begin() + radii.size() / 2, radii.end() );
+    return radii[ radii.size() / 2 ];
+}
+
+void PhotonMap::build(std::vector< Photon > photons)
+{
+    _photons = std::move( photons );
+
+    // Shrink from the last pass' radius, or pick the first one
+    if( _radius > 0 && _passIndex > 0 )
+        _radius *= sqrt( ( _passIndex + _options.alpha ) / ( _passIndex + 1 ) );
+    else if( _radius <= 0 && _photons.size() > 1 )
+        _radius = estimateRadius();
+    if( _radius > 0 )
+        _passIndex++;
+
+    // Counting sort into power of two buckets, about one photon each
+    _cellSize = std::max( _radius * 2.01f, 1e-6f );
+    uint32_t bucketCount = 1;
+    while( bucketCount < _photons.size() && bucketCount < ( 1u << 30 ) )
+        bucketCount <<= 1;
+    _bucketMask = bucketCount - 1;
+    _bucketStarts.assign( bucketCount + 1, 0 );
+
+    std::vector< uint32_t > buckets( _photons.size() );
+    for( size_t i = 0; i < _photons.size(); i++ )
+    {
+        const Photon& photon = _photons[ i ];
+        buckets[ i ] = bucket( (int)floor( photon.pos[ 0 ] / _cellSize ), (int)floor( photon.pos[ 1 ] / _cellSize ), (int)floor( photon.pos[ 2 ] / _cellSize ) );
+        _bucketStarts[ buckets[ i ] + 1 ]++;
+    }
+    for( uint32_t b = 0; b < bucketCount; b++ )
+        _bucketStarts[ b + 1 ] += _bucketStarts[ b ];
+
+    std::vector< Photon > sorted( _photons.size() );
+    std::vector< uint32_t > next( _bucketStarts.begin(), _bucketStarts.end() - 1 );
+    for( size_t i = 0; i < _photons.size(); i++ )
+        sorted[ next[ buckets[ i ] ]++ ] = _photons[ i ];
+    _photons.swap( sorted );
+}
+
+float PhotonMap::radius() const
+{
+    return _radius;
+}
+
+size_t PhotonMap::photonCount() const
+{
+    return _photons.size();
+}
+
+float3 PhotonMap::gather(const float3& position, const float3& normal) const
+{
+    float3 flux = simd_make_float3( 0, 0, 0 );
+    if( _photons.empty() || _radius <= 0 )
+        return flux;
+
+    // Cells are a bit over twice the radius wide, so the sphere overlaps at most
+    // 2 per axis, even with rounding
+    const float radius2 = _radius * _radius;
+    int low[ 3 ], high[ 3 ];
+    for( int axis = 0; axis < 3; axis++ )
+    {
+        low[ axis ] = (int)floor( ( position[ axis ] - _radius ) / _cellSize );
+        high[ axis ] = std::min( (int)floor( ( position[ axis ] + _radius ) / _cellSize ), low[ axis ] + 1 );
+    }
+
+    // Different cells can share a bucket: visit each bucket once
+    uint32_t visited[ 8 ];
+    int visitedCount = 0;
+    for( int z = low[ 2 ]; z <= high[ 2 ]; z++ )
+    {
+        for( int y = low[ 1 ]; y <= high[ 1 ]; y++ )
+        {
+            for( int x = low[ 0 ]; x <= high[ 0 ]; x++ )
+            {
+                const uint32_t b = bucket( x, y, z );
+                if( std::find( visited, visited + visitedCount, b ) != visited + visitedCount )
+                    continue;
+                visited[ visitedCount++ ] = b;
+
+                for( uint32_t i = _bucketStarts[ b ]; i < _bucketStarts[ b + 1 ]; i++ )
+                {
+                    const Photon& photon = _photons[ i ];
+                    const float dx = photon.pos[ 0 ] - position.x;
+                    const float dy = photon.pos[ 1 ] - position.y;
+                    const float dz = photon.pos[ 2 ] - position.z;
+                    if( dx * dx + dy * dy + dz * dz > radius2 )
+                        continue;
+
+                    // Only light arriving at this side
+                    if( photon.dir[ 0 ] * normal.x + photon.dir[ 1 ] * normal.y + photon.dir[ 2 ] * normal.z >= 0 )
+                        continue;
+
+                    flux += simd_make_float3( photon.power[ 0 ], photon.power[ 1 ], photon.power[ 2 ] );
+                }
+            }
+        }
+    }
+
+    return flux / (float)( M_PI * radius2 );
+}
@@ -0,0 +1,85 @@
+//
+//  PhotonMap.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef PhotonMap_h
+#define PhotonMap_h
+
+#include <stdint.h>
+#include <vector>
+
+#include "VectorTypes.h"
+
+// Light that got to a diffuse surface through glass or mirrors. Packed: float3
+// would pad each vector to 16 bytes
+struct Photon
+{
+    float pos[ 3 ];
+    float power[ 3 ]; // Flux
+    float dir[ 3 ];   // Travelling, unit length
+};
+
+// Caustic photons of one pass, for progressive photon mapping. Photons get
+// sorted into a spatial hash of cells just over twice the gather radius wide,
+// so a lookup touches at most 8 contiguous runs of photons. Each build() after
+// reset() shrinks the radius a little ((i + alpha) / (i + 1) in area), which
+// makes the average over passes converge on the right answer.
+class PhotonMap
+{
+public:
+
+    struct Options
+    {
+        // Photons emitted (not stored) per pass, split over every emitter by power
+        int photonsPerPass = 200000;
+
+        // Samples per pixel between photon passes; guided renders keep their own passes
+        int samplesPerPass = 4;
+
+        // Gather radius of the first pass; 0 picks one that holds about 32
+        // photons around a typical caustic photon
+        float initialRadius = 0;
+
+        // Share of photons kept as the radius shrinks; lower shrinks faster
+        float alpha = 0.7f;
+    };
+
+    PhotonMap(const Options& options);
+
+    const Options& options() const;
+
+    // Back to the first pass' radius, for a new render
+    void reset();
+
+    // Replaces the photons, for the next pass
+    void build(std::vector< Photon > photons);
+
+    float radius() const;
+    size_t photonCount() const;
+
+    // Flux per area arriving at the front of a surface around the position
+    // (irradiance); times the BRDF, that's the caustic radiance. Read only, so
+    // safe from any number of threads
+    float3 gather(const float3& position, const float3& normal) const;
+
+private:
+
+    Options _options;
+    float _radius = 0;
+    int _passIndex = 0;
+
+    // Photons grouped by hash bucket; bucket b is [ _bucketStarts[ b ], _bucketStarts[ b + 1 ] )
+    std::vector< Photon > _photons;
+    std::vector< uint32_t > _bucketStarts;
+    uint32_t _bucketMask = 0;
+    float _cellSize = 1;
+
+    uint32_t bucket(int x, int y, int z) const;
+    float estimateRadius() const;
+};
+
+#endif /* PhotonMap_h */
@@ -0,0 +1,200 @@
+//
+//  PixelFormat.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef PixelFormat_h
+#define PixelFormat_h
+
+#include <stdint.h>
+#include <string.h>
+
+#include "VectorTypes.h"
+
+// Compact storage for linear RGB. float3 is padded to 16 bytes, so none of
+// these store it directly.
+enum PixelFormat
+{
+    PixelFormatRGB32F,  // 12 bytes, full precision
+    PixelFormatRGB16F,  // 6 bytes, half floats
+    PixelFormatRGB9E5,  // 4 bytes, shared exponent; fine for previews
+};
+
+inline size_t pixel_format_size(PixelFormat format)
+{
+    switch( format )
+    {
+        case PixelFormatRGB32F: return 3 * sizeof( float );
+        case PixelFormatRGB16F: return 3 * sizeof( uint16_t );
+        case PixelFormatRGB9E5: return sizeof( uint32_t );
+    }
+    return 0;
+}
+
+// IEEE half from float, round to nearest even. Handles inf / nan / denormals
+inline uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+
+    const uint32_t sign = ( bits >> 16 ) & 0x8000;
+    const int32_t exponent = (int32_t)( ( bits >> 23 ) & 0xff ) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // Nan or inf
+    if( ( ( bits >> 23 ) & 0xff ) == 0xff )
+        return sign | 0x7c00 | ( mantissa ? 0x200 : 0 );
+
+    // Overflow to inf
+    if( exponent >= 31 )
+        return sign | 0x7c00;
+
+    // Denormal or zero
+    if( exponent <= 0 )
+    {
+        if( exponent < -10 )
+            return sign;
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t remainder = mantissa & ( ( 1u << shift ) - 1 );
+        const uint32_t halfway = 1u << ( shift - 1 );
+        if( remainder > halfway || ( remainder == halfway && ( half & 1 ) ) )
+            half++;
+        return sign | half;
+    }
+
+    uint32_t half = sign | ( exponent << 10 ) | ( mantissa >> 13 );
+    const uint32_t remainder = mantissa & 0x1fff;
+    if( remainder > 0x1000 || ( remainder == 0x1000 && ( half & 1 ) ) )
+        half++; // May carry into the exponent, which is still correct
+    return half;
+}
+
+inline float half_to_float(uint16_t half)
+{
+    const uint32_t sign = ( half & 0x8000 ) << 16;
+    uint32_t exponent = ( half >> 10 ) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+
+    uint32_t bits;
+    if( exponent == 0 )
+    {
+        if( mantissa == 0 )
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Renormalize denormal
+            exponent = 127 - 15 + 1;
+            while( ( mantissa & 0x400 ) == 0 )
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            mantissa &= 0x3ff;
+            bits = sign | ( exponent << 23 ) | ( mantissa << 13 );
+        }
+    }
+    else if( exponent == 31 )
+    {
+        bits = sign | 0x7f800000 | ( mantissa << 13 );
+    }
+    else
+    {
+        bits = sign | ( ( exponent - 15 + 127 ) << 23 ) | ( mantissa << 13 );
+    }
+
+    float value;
+    memcpy( &value, &bits, sizeof( value ) );
+    return value;
+}
+
+// Shared-exponent RGB9E5 (as in GL_EXT_texture_shared_exponent). Negative values clamp to 0
+inline uint32_t float3_to_rgb9e5(float3 color)
+{
+    const float maxValue = 65408.0f; // (2^9 - 1) / 2^9 * 2^16
+    const float r = fmin( fmax( color.x, 0.0f ), maxValue );
+    const float g = fmin( fmax( color.y, 0.0f ), maxValue );
+    const float b = fmin( fmax( color.z, 0.0f ), maxValue );
+    const float maxComponent = fmax( r, fmax( g, b ) );
+    if( maxComponent <= 0.0f )
+        return 0;
+
+    int exponent = (int)fmax( -16.0f, floor( log2( maxComponent ) ) ) + 1 + 15;
+    float scale = exp2( (float)( exponent - 15 - 9 ) );
+    if( (int)floor( maxComponent / scale + 0.5f ) == 512 )
+    {
+        exponent++;
+        scale *= 2.0f;
+    }
+
+    const uint32_t rm = (uint32_t)floor( r / scale + 0.5f );
+    const uint32_t gm = (uint32_t)floor( g / scale + 0.5f );
+    const uint32_t bm = (uint32_t)floor( b / scale + 0.5f );
+    return rm | ( gm << 9 ) | ( bm << 18 ) | ( (uint32_t)exponent << 27 );
+}
+
+inline float3 rgb9e5_to_float3(uint32_t packed)
+{
+    const float scale = exp2( (float)( (int)( packed >> 27 ) - 15 - 9 ) );
+    return simd_make_float3( ( packed & 0x1ff ) * scale, ( ( packed >> 9 ) & 0x1ff ) * scale, ( ( packed >> 18 ) & 0x1ff ) * scale );
+}
+
+// Store / load one pixel in the given format
+inline void pixel_format_store(PixelFormat format, void* destination, float3 color)
+{
+    switch( format )
+    {
+        case PixelFormatRGB32F:
+        {
+            const float values[ 3 ] = { color.x, color.y, color.z };
+            memcpy( destination, values, sizeof( values ) );
+            break;
+        }
+        case PixelFormatRGB16F:
+        {
+            const uint16_t values[ 3 ] = { float_to_half( color.x ), float_to_half( color.y ), float_to_half( color.z ) };
+            memcpy( destination, values, sizeof( values ) );
+            break;
+        }
+        case PixelFormatRGB9E5:
+        {
+            const uint32_t value = float3_to_rgb9e5( color );
+            memcpy( destination, &value, sizeof( value ) );
+            break;
+        }
+    }
+}
+
+inline float3 pixel_format_load(PixelFormat format, const void* source)
+{
+    switch( format )
+    {
+        case PixelFormatRGB32F:
+        {
+            float values[ 3 ];
+            memcpy( values, source, sizeof( values ) );
+            return simd_make_float3( values[ 0 ], values[ 1 ], values[ 2 ] );
+        }
+        case PixelFormatRGB16F:
+        {
+            uint16_t values[ 3 ];
+            memcpy( values, source, sizeof( values ) );
+            return simd_make_float3( half_to_float( values[ 0 ] ), half_to_float( values[ 1 ] ), half_to_float( values[ 2 ] ) );
+        }
+        case PixelFormatRGB9E5:
+        {
+            uint32_t value;
+            memcpy( &value, source, sizeof( value ) );
+            return rgb9e5_to_float3( value );
+        }
+    }
+    return simd_make_float3( 0, 0, 0 );
+}
+
+#endif /* PixelFormat_h */
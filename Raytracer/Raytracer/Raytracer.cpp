@@ -11,6 +11,7 @@
 #include <limits>
 #include <random>
 #include <algorithm>
+#include <chrono>
 #include <iterator>
 
 #pragma mark Ray Struct
@@ -20,18 +21,88 @@ float3 Ray::at(float t) const
     return pos + simd_normalize(dir) * t;
 }
 
+float Ray::coneWidthAt(float t) const
+{
+    return coneWidth + coneSpread * t;
+}
+
 #pragma mark Material Classes
 
+float IMaterial::scatterPdf(const Ray& ray, const Hit& hit, const float3& direction) const
+{
+    // Delta lobe by default
+    return 0;
+}
+
+bool IMaterial::isDelta() const
+{
+    return true;
+}
+
+float3 IMaterial::diffuseReflectance(const Hit& hit) const
+{
+    return simd_make_float3( 0, 0, 0 );
+}
+
+bool IMaterial::isTextured() const
+{
+    return false;
+}
+
+// Cone spread a non-delta bounce adds; ~6 degrees, enough to drop indirect
+// texture lookups a few mip levels
+static const float kScatterConeSpread = 0.1f;
+
+// Power heuristic, beta = 2
+static float misWeight(float pdf, float otherPdf)
+{
+    const float pdf2 = pdf * pdf;
+    const float otherPdf2 = otherPdf * otherPdf;
+    return ( pdf2 + otherPdf2 > 0 ) ? pdf2 / ( pdf2 + otherPdf2 ) : 0;
+}
+
 LambertianMaterial::LambertianMaterial(const float3& albedo)
 {
     _albedo = albedo;
 }
 
+float3 LambertianMaterial::albedo() const
+{
+    return _albedo;
+}
+
+void LambertianMaterial::setAlbedo(const float3& albedo)
+{
+    _albedo = albedo;
+}
+
+std::shared_ptr< Texture > LambertianMaterial::albedoTexture() const
+{
+    return _albedoTexture;
+}
+
+void LambertianMaterial::setAlbedoTexture(std::shared_ptr< Texture > texture)
+{
+    _albedoTexture = texture;
+}
+
+float3 LambertianMaterial::albedoAt(const Hit& hit) const
+{
+    if( _albedoTexture == nullptr )
+        return _albedo;
+    return _albedo * _albedoTexture->sample( hit.uv, hit.uvFootprint );
+}
+
+IMaterial* LambertianMaterial::clone() const
+{
+    return new LambertianMaterial( *this );
+}
+
 bool LambertianMaterial::scatter(const Ray& ray, const Hit& hit, float3* attenuation, Ray* scattered) const
 {
     scattered->pos = hit.pos;
     scattered->dir = hit.norm + random_unit_float3();
-    *attenuation = _albedo;
+    *attenuation = albedoAt( hit );
     return true;
 }
 
@@ -40,18 +111,100 @@ float3 LambertianMaterial::emitted(float2 uv, const Hit& hit) const
     return simd_make_float3( 0, 0, 0 );
 }
 
+float LambertianMaterial::scatterPdf(const Ray& ray, const Hit& hit, const float3& direction) const
+{
+    // Normal + unit sphere point is cosine distributed
+    const float cosine = simd_dot( hit.norm, simd_normalize( direction ) );
+    return ( cosine > 0 ) ? cosine / M_PI : 0;
+}
+
+bool LambertianMaterial::isDelta() const
+{
+    return false;
+}
+
+float3 LambertianMaterial::diffuseReflectance(const Hit& hit) const
+{
+    return albedoAt( hit );
+}
+
+bool LambertianMaterial::isTextured() const
+{
+    return ( _albedoTexture != nullptr );
+}
+
 MetalMaterial::MetalMaterial(const float3& albedo, float roughness)
 {
     _albedo = albedo;
     _roughness = clamp( roughness, 0, 1 );
 }
 
+float3 MetalMaterial::albedo() const
+{
+    return _albedo;
+}
+
+void MetalMaterial::setAlbedo(const float3& albedo)
+{
+    _albedo = albedo;
+}
+
+float MetalMaterial::roughness() const
+{
+    return _roughness;
+}
+
+void MetalMaterial::setRoughness(float roughness)
+{
+    _roughness = clamp( roughness, 0, 1 );
+}
+
+std::shared_ptr< Texture > MetalMaterial::albedoTexture() const
+{
+    return _albedoTexture;
+}
+
+void MetalMaterial::setAlbedoTexture(std::shared_ptr< Texture > texture)
+{
+    _albedoTexture = texture;
+}
+
+std::shared_ptr< Texture > MetalMaterial::roughnessTexture() const
+{
+    return _roughnessTexture;
+}
+
+void MetalMaterial::setRoughnessTexture(std::shared_ptr< Texture > texture)
+{
+    _roughnessTexture = texture;
+}
+
+float3 MetalMaterial::albedoAt(const Hit& hit) const
+{
+    if( _albedoTexture == nullptr )
+        return _albedo;
+    return _albedo * _albedoTexture->sample( hit.uv, hit.uvFootprint );
+}
+
+float MetalMaterial::roughnessAt(const Hit& hit) const
+{
+    if( _roughnessTexture == nullptr || _roughness <= 0 )
+        return _roughness;
+    const float roughness = _roughness * _roughnessTexture->sample( hit.uv, hit.uvFootprint ).x;
+    return std::min( std::max( roughness, 0.01f ), 1.0f );
+}
+
+IMaterial* MetalMaterial::clone() const
+{
+    return new MetalMaterial( *this );
+}
+
 bool MetalMaterial::scatter(const Ray& ray, const Hit& hit, float3* attenuation, Ray* scattered) const
 {
     float3 reflected = reflect( simd_normalize( ray.dir), hit.norm );
     scattered->pos = hit.pos;
-    scattered->dir = reflected + _roughness * random_unit_float3();
-    *attenuation = _albedo;
+    scattered->dir = reflected + roughnessAt( hit ) * random_unit_float3();
+    *attenuation = albedoAt( hit );
     return ( simd_dot( scattered->dir, hit.norm ) > 0 );
 }
 
@@ -60,11 +213,56 @@ float3 MetalMaterial::emitted(float2 uv, const Hit& hit) const
     return simd_make_float3( 0, 0, 0 );
 }
 
+float MetalMaterial::scatterPdf(const Ray& ray, const Hit& hit, const float3& direction) const
+{
+    // Perfect mirror can't be light sampled
+    const float roughness = roughnessAt( hit );
+    if( roughness <= 0 )
+        return 0;
+    
+    // scatter() picks a point uniformly on a sphere of radius roughness around the
+    // (unit) mirror direction. Map that area density to solid angle: for each
+    // point where the direction's ray pierces the sphere, dA = t^2 dw / |cos|
+    const float3 dir = simd_normalize( direction );
+    if( simd_dot( dir, hit.norm ) <= 0 )
+        return 0;
+    
+    const float3 reflected = reflect( simd_normalize( ray.dir ), hit.norm );
+    const float b = simd_dot( dir, reflected );
+    const float discrim = b * b - 1.0f + roughness * roughness;
+    if( discrim <= 0 )
+        return 0;
+    
+    const float root = sqrt( discrim );
+    float pdf = 0;
+    for( float t : { b - root, b + root } )
+    {
+        if( t > 0 )
+            pdf += t * t / ( 4.0 * M_PI * roughness * root );
+    }
+    return pdf;
+}
+
+bool MetalMaterial::isDelta() const
+{
+    return ( _roughness <= 0 );
+}
+
+bool MetalMaterial::isTextured() const
+{
+    return ( _albedoTexture != nullptr || _roughnessTexture != nullptr );
+}
+
 DielectricMaterial::DielectricMaterial(float ri)
 {
     _ri = ri;
 }
 
+IMaterial* DielectricMaterial::clone() const
+{
+    return new DielectricMaterial( *this );
+}
+
 bool DielectricMaterial::scatter(const Ray& ray, const Hit& hit, float3* attenuation, Ray* scattered) const
 {
     *attenuation = simd_make_float3( 1, 1, 1 );
@@ -112,6 +310,26 @@ DiffuseLightMaterial::DiffuseLightMaterial(float3 light)
     _light = light;
 }
 
+float3 DiffuseLightMaterial::light() const
+{
+    return _light;
+}
+
+std::shared_ptr< Texture > DiffuseLightMaterial::emissionTexture() const
+{
+    return _emissionTexture;
+}
+
+void DiffuseLightMaterial::setEmissionTexture(std::shared_ptr< Texture > texture)
+{
+    _emissionTexture = texture;
+}
+
+IMaterial* DiffuseLightMaterial::clone() const
+{
+    return new DiffuseLightMaterial( *this );
+}
+
 bool DiffuseLightMaterial::scatter(const Ray& ray, const Hit& hit, float3* attenuation, Ray* scattered) const
 {
     // Light material itself doesn't re-scatter anything
@@ -121,7 +339,14 @@ bool DiffuseLightMaterial::scatter(const Ray& ray, const Hit& hit, float3* atten
 float3 DiffuseLightMaterial::emitted(float2 uv, const Hit& hit) const
 {
     // Light does emit!
-    return _light;
+    if( _emissionTexture == nullptr )
+        return _light;
+    return _light * _emissionTexture->sample( uv, hit.uvFootprint );
+}
+
+bool DiffuseLightMaterial::isTextured() const
+{
+    return ( _emissionTexture != nullptr );
 }
 
 #pragma mark Sphere Class
@@ -186,16 +411,8 @@ bool Sphere::hitTest(const Ray& ray, float tmin, float tmax, Hit* hit) const
     float t = ( -half_b - sqrt( discrim ) ) / a;
     if( t >= tmin && t <= tmax )
     {
-        float3 position = ray.at( t );
-        float3 normal = simd_normalize( position - _position );
-        
         if( hit != nullptr )
-        {
-            hit->pos = position;
-            hit->material = _material;
-            hit->isFrontFace = ( simd_dot( ray.dir, normal ) < 0.0 );
-            hit->norm = hit->isFrontFace ? normal : -normal;
-        }
+            fillHit( ray, t, hit );
         
         return true;
     }
@@ -204,16 +421,8 @@ bool Sphere::hitTest(const Ray& ray, float tmin, float tmax, Hit* hit) const
     t = ( -half_b + sqrt( discrim ) ) / a;
     if( t >= tmin && t <= tmax )
     {
-        float3 position = ray.at( t );
-        float3 normal = simd_normalize( position - _position );
-        
         if( hit != nullptr )
-        {
-            hit->pos = position;
-            hit->material = _material;
-            hit->isFrontFace = ( simd_dot( ray.dir, normal ) < 0.0 );
-            hit->norm = hit->isFrontFace ? normal : -normal;
-        }
+            fillHit( ray, t, hit );
         
         return true;
     }
@@ -222,32 +431,167 @@ bool Sphere::hitTest(const Ray& ray, float tmin, float tmax, Hit* hit) const
     return false;
 }
 
+void Sphere::fillHit(const Ray& ray, float t, Hit* hit) const
+{
+    float3 position = ray.at( t );
+    float3 normal = simd_normalize( position - _position );
+    
+    hit->pos = position;
+    hit->material = _material;
+    hit->isFrontFace = ( simd_dot( ray.dir, normal ) < 0.0 );
+    hit->norm = hit->isFrontFace ? normal : -normal;
+    hit->coneWidth = ray.coneWidthAt( t );
+}
+
+void Sphere::fillTextureCoordinates(const Ray& ray, Hit* hit) const
+{
+    // Longitude and latitude
+    const float3 normal = hit->isFrontFace ? hit->norm : -hit->norm;
+    const float theta = acos( std::min( std::max( normal.y, -1.0f ), 1.0f ) );
+    const float phi = atan2( -normal.z, normal.x ) + M_PI;
+    hit->uv = simd_make_float2( phi / ( 2.0 * M_PI ), theta / M_PI );
+    
+    // Cone width where it lands, stretched by how glancing the hit is; u lines
+    // bunch up towards the poles
+    const float cosine = fabs( simd_dot( simd_normalize( ray.dir ), normal ) );
+    const float width = hit->coneWidth / std::max( cosine, 0.1f );
+    const float ringRadius = _radius * std::max( (float)sin( theta ), 0.05f );
+    hit->uvFootprint = simd_make_float2( width / ( 2.0 * M_PI * ringRadius ), width / ( M_PI * _radius ) );
+}
+
+AABB Sphere::bounds() const
+{
+    const float3 extent = simd_make_float3( _radius, _radius, _radius );
+    
+    AABB box;
+    box.min = _position - extent;
+    box.max = _position + extent;
+    return box;
+}
+
+IHittable* Sphere::clone() const
+{
+    Sphere* sphere = new Sphere( _radius );
+    sphere->_position = _position;
+    sphere->setMaterial( _material->clone() );
+    return sphere;
+}
+
 #pragma mark Scene Class
 
 bool Scene::hitTest(const Ray& ray, float tmin, float tmax, Hit* hit) const
 {
-    // For each shape in the scene...
-    float bestDistance = std::numeric_limits<float>::max();
     bool didHit = false;
-    for( const IHittable* shape : shapes )
+    if( bvh != nullptr && bvh->shapeCount() == shapes.size() )
     {
-        Hit candidate;
-        if( shape->hitTest( ray, tmin, tmax, &candidate ) )
+        didHit = bvh->hitTest( shapes, ray, tmin, tmax, hit );
+    }
+    else
+    {
+        // For each shape in the scene...
+        float bestDistance = std::numeric_limits<float>::max();
+        for( int shapeIndex = 0; shapeIndex < (int)shapes.size(); shapeIndex++ )
         {
-            float hitDistance = simd_length( candidate.pos - ray.pos );
-            if( hitDistance < bestDistance )
+            Hit candidate;
+            if( shapes[ shapeIndex ]->hitTest( ray, tmin, tmax, &candidate ) )
             {
-                bestDistance = hitDistance;
-                didHit = true;
-                if( hit != nullptr )
-                    *hit = candidate;
+                float hitDistance = simd_length( candidate.pos - ray.pos );
+                if( hitDistance < bestDistance )
+                {
+                    bestDistance = hitDistance;
+                    didHit = true;
+                    if( hit != nullptr )
+                    {
+                        *hit = candidate;
+                        hit->shapeIndex = shapeIndex;
+                    }
+                }
             }
         }
     }
     
+    // Just for the closest hit, and only if something will sample a texture there
+    if( didHit && hit != nullptr && hit->material->isTextured() )
+        shapes[ hit->shapeIndex ]->fillTextureCoordinates( ray, hit );
+    
     return didHit;
 }
 
+#pragma mark Scene Snapshot Class
+
+SceneSnapshot* SceneSnapshot::capture(const Scene& scene, uint64_t version)
+{
+    SceneSnapshot* snapshot = new SceneSnapshot();
+    snapshot->_version = version;
+    snapshot->_source = scene;
+    snapshot->_scene.environment = scene.environment;
+    for( const IHittable* shape : scene.shapes )
+    {
+        snapshot->_scene.shapes.push_back( shape->clone() );
+        snapshot->_sourceMaterials.push_back( shape->material() );
+    }
+    
+    // The scene's own BVH may be stale, but its tree still fits the copies: a
+    // refit is linear, a build isn't
+    if( scene.bvh != nullptr && scene.bvh->shapeCount() == scene.shapes.size() )
+    {
+        snapshot->_scene.bvh = std::make_shared< BVH >( *scene.bvh );
+        snapshot->_scene.bvh->refit( snapshot->_scene.shapes );
+    }
+    else if( scene.bvh != nullptr )
+    {
+        snapshot->_scene.bvh = std::make_shared< BVH >( snapshot->_scene.shapes );
+    }
+    return snapshot;
+}
+
+SceneSnapshot::~SceneSnapshot()
+{
+    for( IHittable* shape : _scene.shapes )
+        delete shape;
+}
+
+const Scene& SceneSnapshot::scene() const
+{
+    return _scene;
+}
+
+uint64_t SceneSnapshot::version() const
+{
+    return _version;
+}
+
+const Scene& SceneSnapshot::source() const
+{
+    return _source;
+}
+
+int SceneSnapshot::indexOf(const IHittable* shape) const
+{
+    const auto found = std::find( _source.shapes.begin(), _source.shapes.end(), shape );
+    return ( found != _source.shapes.end() ) ? (int)( found - _source.shapes.begin() ) : -1;
+}
+
+std::vector< int > SceneSnapshot::indicesWithMaterial(const IMaterial* material) const
+{
+    // The material it was copied with, or one set on the caller's shape since
+    // (only asked while not rendering, so the caller isn't editing)
+    std::vector< int > indices;
+    for( size_t i = 0; i < _source.shapes.size(); i++ )
+    {
+        if( _sourceMaterials[ i ] == material || _source.shapes[ i ]->material() == material )
+            indices.push_back( (int)i );
+    }
+    return indices;
+}
+
+const IMaterial* SceneSnapshot::sourceMaterial(const Hit& hit) const
+{
+    if( hit.shapeIndex >= 0 && hit.shapeIndex < (int)_sourceMaterials.size() )
+        return _sourceMaterials[ hit.shapeIndex ];
+    return hit.material;
+}
+
 #pragma mark Camera Class
 
 Camera::Camera(int2 resolution, float3 position, float3 target, float3 up, float fovy,
@@ -270,6 +614,7 @@ Camera::Camera(int2 resolution, float3 position, float3 target, float3 up, float
     lowerLeftCornerPosition = position - halfWidth * focusDistance * u - halfHeight * focusDistance * v - focusDistance * w;
     horizontalVector = 2.0 * halfWidth * focusDistance * u;
     verticalVector = 2.0 * halfHeight * focusDistance * v;
+    _pixelSpread = 2.0 * halfHeight / _resolution.y;
 }
 
 int2 Camera::resolution() const
@@ -315,31 +660,86 @@ Ray Camera::getRay(float2 uv) const
     Ray ray;
     ray.pos = _position + offset;
     ray.dir = lowerLeftCornerPosition + uv.x * horizontalVector + uv.y * verticalVector - _position - offset;
+    ray.coneSpread = _pixelSpread;
     return ray;
 }
 
+bool Camera::project(const float3& point, float2* uv) const
+{
+    // Along the ray to the focus plane, then across it
+    const float3 direction = point - _position;
+    const float forward = -simd_dot( direction, w );
+    if( forward <= 0 )
+        return false;
+    
+    const float3 corner = lowerLeftCornerPosition - _position;
+    const float focusDistance = -simd_dot( corner, w );
+    const float3 onPlane = direction * ( focusDistance / forward ) - corner;
+    *uv = simd_make_float2( simd_dot( onPlane, u ) / simd_length( horizontalVector ),
+                            simd_dot( onPlane, v ) / simd_length( verticalVector ) );
+    return true;
+}
+
 #pragma mark Raytracer Class
 
-Raytracer::Raytracer(const Camera& camera, const Scene& scene)
+// Side of the pixel blocks in-memory renders hand out as work items: big enough
+// that the work list is a small fraction of the frame, small enough that blocks
+// still come online all over the image
+static const int kWorkBlockSize = 8;
+
+// Block rows (or columns) over [low, high): start and length, cut at block
+// multiples and at tile edges, so no block straddles two tiles
+static std::vector< int2 > blockSpans(int low, int high, int tileSize)
+{
+    std::vector< int2 > spans;
+    for( int start = low; start < high; )
+    {
+        const int end = std::min( std::min( ( start / kWorkBlockSize + 1 ) * kWorkBlockSize, ( start / tileSize + 1 ) * tileSize ), high );
+        spans.push_back( simd_make_int2( start, end - start ) );
+        start = end;
+    }
+    return spans;
+}
+
+Raytracer::Raytracer(const Camera& camera, const Scene& scene, RenderThreadPool* pool,
+                     const Framebuffer::Options& framebufferOptions)
 {
     _camera = camera;
-    _scene = scene;
+    _snapshot = SceneSnapshot::capture( scene, 0 );
+    _publishLock = OS_UNFAIR_LOCK_INIT;
     
-    _backingBuffer = new float3[ camera.resolution().x * camera.resolution().y ];
-    _backingBufferLock = OS_UNFAIR_LOCK_INIT;
+    _framebuffer = new Framebuffer( camera.resolution(), framebufferOptions );
     
-    _workQueue = dispatch_queue_create( "Raytracer queue", dispatch_queue_attr_make_with_qos_class( 0, QOS_CLASS_DEFAULT, 0 ) );
+    _pool = ( pool != nullptr ) ? pool : RenderThreadPool::shared();
     _workLock = OS_UNFAIR_LOCK_INIT;
+    _orderLock = OS_UNFAIR_LOCK_INIT;
     
     _state = Setup;
     _finalImage = nullptr;
+    _finalImageStride = 0;
 }
 
 Raytracer::~Raytracer()
 {
-    delete[] _backingBuffer;
+    // Workers point back at us, so stop them and wait for the in-flight pixels;
+    // queued snapshots read our framebuffer too
+    cancel();
+    waitUntilComplete();
+    if( _snapshotsInFlight > 0 )
+        _snapshotExporter->waitUntilIdle();
+    
+    delete _framebuffer;
+    delete _firstHitCache;
+    delete _pathGuide;
+    delete _photonMap;
+    delete _temporalHistory;
+    delete _workOrder.load();
     if( _finalImage != nullptr )
         CGImageRelease( _finalImage );
+    
+    // No workers left to read it; older ones go as soon as other renders allow
+    delete _snapshot.load();
+    Epoch::reclaim();
 }
 
 void Raytracer::renderAsync()
@@ -351,148 +751,1226 @@ void Raytracer::renderAsync()
     // Declare we're going to be doing the work
     _state = Active;
     
-    // Async all the work
-    dispatch_async(_workQueue, ^{
-
-        // Clear our backing buffer
-        const size_t backingBufferLength = sizeof( float3 ) * _camera.resolution().x * _camera.resolution().y;
-        memset( _backingBuffer, 0, backingBufferLength );
+    submitWork( [this]() {
         
-        // Create all the work we want to complete
-        printf( "Setting up render work...\n" );
-        for( int y = 0; y < _camera.resolution().y; y++ )
+        // Clear our backing buffer
+        _framebuffer->clear();
+        if( _sharedFramebuffer != nullptr )
+            _sharedFramebuffer->clear();
+        if( _temporalHistory != nullptr )
+            _temporalHistory->discard();
+        _rerendering = false;
+        prepareFrameWorkItems();
+        beginPasses( _pathGuide != nullptr );
+    });
+}
+
+void Raytracer::prepareFrameWorkItems()
+{
+    _workItems.clear();
+    _partialWorkItems = false;
+    
+    int2 low, high;
+    frameBounds( &low, &high );
+    
+    // Create all the work we want to complete
+    printf( "Setting up render work...\n" );
+    if( _framebuffer->isStreaming() )
+    {
+        // Whole tiles (cropped) in scanline order: the pool hands them out in
+        // order, so only about one tile per worker is ever resident
+        const int tileSize = _framebuffer->tileSize();
+        for( int tileY = 0; tileY < _framebuffer->tileCount().y; tileY++ )
         {
-            for( int x = 0; x < _camera.resolution().x; x++ )
+            for( int tileX = 0; tileX < _framebuffer->tileCount().x; tileX++ )
             {
-                // Declare work on the pixel (and save UV...)
-                WorkItem workItem;
-                workItem.pixelPos = simd_make_int2(x, y);
+                const int2 start = simd_make_int2( std::max( tileX * tileSize, low.x ), std::max( tileY * tileSize, low.y ) );
+                const int2 end = simd_make_int2( std::min( ( tileX + 1 ) * tileSize, high.x ), std::min( ( tileY + 1 ) * tileSize, high.y ) );
+                if( start.x >= end.x || start.y >= end.y )
+                    continue;
                 
-                // Push work
+                WorkItem workItem;
+                workItem.pixelPos = start;
+                workItem.size = end - start;
+                _workItems.push_back(workItem);
+            }
+        }
+    }
+    else
+    {
+        const std::vector< int2 > rows = blockSpans( low.y, high.y, _framebuffer->tileSize() );
+        const std::vector< int2 > columns = blockSpans( low.x, high.x, _framebuffer->tileSize() );
+        for( const int2& row : rows )
+        {
+            for( const int2& column : columns )
+            {
+                WorkItem workItem;
+                workItem.pixelPos = simd_make_int2( column.x, row.x );
+                workItem.size = simd_make_int2( column.y, row.y );
                 _workItems.push_back(workItem);
             }
         }
         
-        // Shuffle so we see random points come online across the image..
+        // Shuffle so we see random blocks come online across the image..
         // This helps us preview what's going on faster
         std::random_device rd;
         std::mt19937 g(rd());
         std::shuffle(_workItems.begin(), _workItems.end(), g);
-        
-        // Do the rendering work:
-        printf( "Starting render work...\n" );
-        dispatch_apply(_workItems.size(), NULL, ^(size_t) {
-            
-            // Get work
-            os_unfair_lock_lock(&_workLock);
-            const WorkItem workItem = _workItems.back();
-            _workItems.pop_back();
-            os_unfair_lock_unlock(&_workLock);
-            
-            // Do work
-            float3 color = simd_make_float3( 0, 0, 0 );
-
-            // Helpful constant
-            const float2 f2Resolution = simd_make_float2( _camera.resolution().x, _camera.resolution().y );
-            
-            // For sample count..
-            for( int sampleIndex = 0; sampleIndex < _camera.sampleCount(); sampleIndex++ )
-            {
-                // Compute UV with possible offset
-                float2 uv = simd_make_float2( workItem.pixelPos.x, workItem.pixelPos.y );
-                uv.x += ( sampleIndex == 0 ) ? 0 : random_float();
-                uv.y += ( sampleIndex == 0 ) ? 0 : random_float();
-                
-                // Normalize
-                uv /= f2Resolution;
-                
-                // Generate ray through camera with this
-                Ray ray = _camera.getRay( uv );
-                
-                // Do work!
-                color += rayTest(ray);
-            }
-            
-            // Normalize color to both the sample count *and* be gamma corrected
-            color.x = sqrt( color.x / _camera.sampleCount() );
-            color.y = sqrt( color.y / _camera.sampleCount() );
-            color.z = sqrt( color.z / _camera.sampleCount() );
-            
-            // Store to our backing buffer
-            os_unfair_lock_lock(&_backingBufferLock);
-            const int x = workItem.pixelPos.x;
-            const int y = workItem.pixelPos.y;
-            _backingBuffer[ y * _camera.resolution().x + x ] = color;
-            os_unfair_lock_unlock(&_backingBufferLock);
-        });
-        
-        // All work complete, post update on main thread. I'm aware of how nasty
-        // this is with C++ code because nothing is retaining this object.. This is
-        // also making a big assumption that the caller is always on the main thread.
-        // Ew ew ew
-        dispatch_async(dispatch_get_main_queue(), ^{
-            printf( "Complete!\n" );
-            _state = Complete;
-        });
-    });
+    }
 }
 
-bool Raytracer::isComplete()
+void Raytracer::frameBounds(int2* low, int2* high) const
 {
-    return ( _state == Complete && _finalImage != nullptr );
+    // The whole frame, or what of the crop window is on it
+    *low = simd_make_int2( 0, 0 );
+    *high = _camera.resolution();
+    if( _cropSize.x > 0 && _cropSize.y > 0 )
+    {
+        *low = simd_make_int2( std::max( _cropOrigin.x, 0 ), std::max( _cropOrigin.y, 0 ) );
+        *high = simd_make_int2( std::min( _cropOrigin.x + _cropSize.x, high->x ), std::min( _cropOrigin.y + _cropSize.y, high->y ) );
+    }
 }
 
-CGImageRef Raytracer::copyRenderImage()
+void Raytracer::waitUntilComplete()
 {
-    // If we're already done rendering *and* we have a cached final image...
-    if( isComplete() )
+    // The setup job may hand off to the render job while we wait, so follow it
+    std::shared_ptr< RenderJob > job;
+    while( true )
     {
-        // Retain per "copy" contract via function signature
-        CGImageRetain( _finalImage );
-        return _finalImage;
+        os_unfair_lock_lock(&_workLock);
+        std::shared_ptr< RenderJob > currentJob = _job;
+        os_unfair_lock_unlock(&_workLock);
+        
+        if( currentJob == job )
+            break;
+        
+        job = currentJob;
+        job->wait();
     }
+}
+
+bool Raytracer::renderFrameAsync(const Camera& camera)
+{
+    if( _state != Complete || camera.resolution().x != _camera.resolution().x || camera.resolution().y != _camera.resolution().y )
+        return false;
     
-    // Create our image backing buffer.
-    int2 resolution = _camera.resolution();
-    uint32_t* imageBuffer = new uint32_t[ resolution.x * resolution.y ];
+    // A cancelled frame still completes, and the next one starts over
+    os_unfair_lock_lock(&_workLock);
+    _cancelled = false;
+    _renderSubmitted = false;
+    os_unfair_lock_unlock(&_workLock);
     
-    // Convert float float4 to int4
-    os_unfair_lock_lock(&_backingBufferLock);
-    for( int y = 0; y < _camera.resolution().y; y++ )
-    {
-        for( int x = 0; x < _camera.resolution().x; x++ )
-        {
-            // Convert from normalized color to
-            const int pixelIndex = y * _camera.resolution().x + x;
-            
-            float3 sourceColor = _backingBuffer[ pixelIndex ];
-            
-            uint8_t r = clamp( sourceColor.x * 255.0f, 0, 255 );
-            uint8_t g = clamp( sourceColor.y * 255.0f, 0, 255 );
-            uint8_t b = clamp( sourceColor.z * 255.0f, 0, 255 );
-            uint8_t a = 255;
-            
-            // Back backwards: we're on little-endian architecture
+    _camera = camera;
+    if( _finalImage != nullptr )
+        CGImageRelease( _finalImage );
+    _finalImage = nullptr;
+    
+    _state = Active;
+    
+    // Same pixels as last frame, so the work list stays as it is, unless a
+    // re-render cut it down to just some pixels, or a cancel came before the
+    // first render got to make it
+    submitWork( [this]() {
+        _framebuffer->clear();
+        if( _sharedFramebuffer != nullptr )
+            _sharedFramebuffer->clear();
+        if( _firstHitCache != nullptr )
+            _firstHitCache->clearInvalid();
+        _rerendering = false;
+        if( _partialWorkItems || _workItems.empty() )
+            prepareFrameWorkItems();
+        if( _temporalHistory != nullptr )
+        {
+            _temporalHistory->beginFrame();
+            splatHistory();
+        }
+        beginPasses( _pathGuide != nullptr );
+    });
+    return true;
+}
+
+void Raytracer::rerenderAsync()
+{
+    // Only once the last render is done, and only if we kept its first hits
+    if( _state != Complete || _firstHitCache == nullptr )
+        return;
+    
+    os_unfair_lock_lock(&_workLock);
+    _cancelled = false;
+    _renderSubmitted = false;
+    os_unfair_lock_unlock(&_workLock);
+    
+    // The cached final image is stale now
+    if( _finalImage != nullptr )
+        CGImageRelease( _finalImage );
+    _finalImage = nullptr;
+    if( _sceneEdited )
+        recaptureScene();
+    
+    _state = Active;
+    
+    submitWork( [this]() {
+        
+        // Just the blocks with flagged pixels, shuffled like a full render; the
+        // flags stay up until it completes, so every pass skips the rest
+        printf( "Setting up re-render of %d pixels...\n", _firstHitCache->invalidCount() );
+        _workItems.clear();
+        _partialWorkItems = true;
+        _rerendering = true;
+        if( _sharedFramebuffer != nullptr )
+            _sharedFramebuffer->setState( SharedFramebufferRendering );
+        const std::vector< int2 > rows = blockSpans( 0, _camera.resolution().y, _framebuffer->tileSize() );
+        const std::vector< int2 > columns = blockSpans( 0, _camera.resolution().x, _framebuffer->tileSize() );
+        for( const int2& row : rows )
+        {
+            for( const int2& column : columns )
+            {
+                int flaggedCount = 0;
+                for( int y = row.x; y < row.x + row.y; y++ )
+                {
+                    for( int x = column.x; x < column.x + column.y; x++ )
+                        flaggedCount += _firstHitCache->isInvalid( x, y ) ? 1 : 0;
+                }
+                if( flaggedCount == 0 )
+                    continue;
+                
+                WorkItem workItem;
+                workItem.pixelPos = simd_make_int2( column.x, row.x );
+                workItem.size = simd_make_int2( column.y, row.y );
+                _workItems.push_back(workItem);
+                
+                // Viewers count these pixels' samples again from zero
+                if( _sharedFramebuffer != nullptr )
+                    _sharedFramebuffer->discardSamples( column.x, row.x, (uint64_t)flaggedCount * _camera.sampleCount() );
+            }
+        }
+        if( _temporalHistory != nullptr )
+            _temporalHistory->discard();
+        beginPasses( false );
+        
+        std::random_device rd;
+        std::mt19937 g(rd());
+        std::shuffle(_workItems.begin(), _workItems.end(), g);
+    });
+}
+
+void Raytracer::submitWork(std::function<void()> prepareWorkItems)
+{
+    // Setup is a one-item job on the pool too, so big frames don't stall the caller
+    os_unfair_lock_lock(&_workLock);
+    _job = _pool->submit( 1, _priority, [this, prepareWorkItems](size_t) {
+        
+        prepareWorkItems();
+        
+        os_unfair_lock_lock(&_workLock);
+        if( _cancelled == false )
+            submitPass();
+        os_unfair_lock_unlock(&_workLock);
+        
+    }, [this]() {
+        
+        // Cancelled before the render job existed: nothing else will finish us off
+        os_unfair_lock_lock(&_workLock);
+        if( _renderSubmitted == false )
+            _state = Complete;
+        os_unfair_lock_unlock(&_workLock);
+    });
+    os_unfair_lock_unlock(&_workLock);
+}
+
+void Raytracer::beginPasses(bool progressive)
+{
+    // Guided renders go in passes of 1, 2, 4.. samples, each learning from the last;
+    // photon mapped ones in even passes, each with fresh photons; the rest (and
+    // re-renders without photons) do all their samples at once
+    _pass.sampleStart = 0;
+    _pass.doubling = progressive;
+    if( progressive )
+        _pass.sampleCount = 1;
+    else if( _photonMap != nullptr )
+        _pass.sampleCount = std::min( std::max( _photonMap->options().samplesPerPass, 1 ), _camera.sampleCount() );
+    else
+        _pass.sampleCount = _camera.sampleCount();
+    _pass.train = progressive && ( _pass.sampleCount < _camera.sampleCount() );
+    
+    if( _photonMap != nullptr )
+        _photonMap->reset();
+    if( _pathGuide != nullptr )
+        _pathGuide->beginPasses();
+}
+
+void Raytracer::submitPass()
+{
+    if( _photonMap != nullptr )
+        submitPhotonPass();
+    else
+        submitRenderPass();
+}
+
+void Raytracer::submitPhotonPass()
+{
+    bool hasEmitters = false;
+    {
+        Epoch::Guard guard;
+        hasEmitters = ( photonEmitters( _snapshot.load()->scene() ).empty() == false );
+    }
+    
+    // Chunks of photons per pool item, so tracing spreads over the workers
+    const int photonCount = hasEmitters ? std::max( _photonMap->options().photonsPerPass, 0 ) : 0;
+    const int chunkCount = std::max( std::min( 64, photonCount / 1024 ), 1 );
+    _photonChunks.assign( chunkCount, std::vector< Photon >() );
+    
+    _renderSubmitted = true;
+    _job = _pool->submit( chunkCount, _priority, [this, photonCount, chunkCount](size_t index) {
+        const int start = (int)( (int64_t)photonCount * index / chunkCount );
+        const int end = (int)( (int64_t)photonCount * ( index + 1 ) / chunkCount );
+        Epoch::Guard guard;
+        tracePhotons( *_snapshot.load(), end - start, &_photonChunks[ index ] );
+        
+        // Flux is shared out over every photon emitted, stored or not
+        for( Photon& photon : _photonChunks[ index ] )
+        {
+            for( int channel = 0; channel < 3; channel++ )
+                photon.power[ channel ] /= photonCount;
+        }
+    }, [this]() {
+        
+        std::vector< Photon > photons;
+        for( std::vector< Photon >& chunk : _photonChunks )
+            photons.insert( photons.end(), chunk.begin(), chunk.end() );
+        _photonChunks.clear();
+        _photonMap->build( std::move( photons ) );
+        printf( "Photon pass: %zu caustic photons, radius %g\n", _photonMap->photonCount(), _photonMap->radius() );
+        
+        os_unfair_lock_lock(&_workLock);
+        const bool cancelled = _cancelled;
+        if( cancelled == false )
+            submitRenderPass();
+        os_unfair_lock_unlock(&_workLock);
+        
+        if( cancelled )
+            completeRender();
+    });
+}
+
+std::vector< Raytracer::PhotonEmitter > Raytracer::photonEmitters(const Scene& scene)
+{
+    // Emitters where they are now, weighted by power
+    std::vector< PhotonEmitter > emitters;
+    float totalPower = 0;
+    for( const IHittable* shape : scene.shapes )
+    {
+        const Sphere* sphere = dynamic_cast< const Sphere* >( shape );
+        const DiffuseLightMaterial* light = ( sphere != nullptr ) ? dynamic_cast< const DiffuseLightMaterial* >( sphere->material() ) : nullptr;
+        if( light == nullptr )
+            continue;
+        
+        const float power = luminance( light->light() ) * sphere->radius() * sphere->radius();
+        if( power <= 0 )
+            continue;
+        
+        totalPower += power;
+        emitters.push_back( PhotonEmitter{ sphere, totalPower } );
+    }
+    for( PhotonEmitter& emitter : emitters )
+        emitter.cdf /= totalPower;
+    return emitters;
+}
+
+void Raytracer::tracePhotons(const SceneSnapshot& snapshot, int count, std::vector< Photon >* photons) const
+{
+    const Scene& scene = snapshot.scene();
+    const std::vector< PhotonEmitter > emitters = photonEmitters( scene );
+    if( emitters.empty() )
+        return;
+    
+    for( int photonIndex = 0; photonIndex < count; photonIndex++ )
+    {
+        // Emitter by power, a point uniformly on it, a cosine distributed direction
+        const float pick = random_float();
+        size_t emitterIndex = 0;
+        while( emitterIndex + 1 < emitters.size() && emitters[ emitterIndex ].cdf < pick )
+            emitterIndex++;
+        const Sphere* sphere = emitters[ emitterIndex ].sphere;
+        const float emitterPdf = emitters[ emitterIndex ].cdf - ( emitterIndex > 0 ? emitters[ emitterIndex - 1 ].cdf : 0 );
+        
+        // Hit the point from outside, for the emission texture's UVs
+        const float3 normal = random_unit_float3();
+        Ray probe;
+        probe.pos = sphere->position() + normal * sphere->radius() * 2.0f;
+        probe.dir = -normal;
+        Hit surface;
+        if( sphere->hitTest( probe, 0, std::numeric_limits<float>::max(), &surface ) == false )
+            continue;
+        if( surface.material->isTextured() )
+            sphere->fillTextureCoordinates( probe, &surface );
+        
+        // Radiance * pi * area is the flux leaving a Lambertian emitter
+        const float area = 4.0 * M_PI * sphere->radius() * sphere->radius();
+        float3 power = surface.material->emitted( surface.uv, surface ) * ( M_PI * area / emitterPdf );
+        
+        Ray ray;
+        ray.pos = surface.pos;
+        ray.dir = simd_normalize( normal + random_unit_float3() );
+        
+        // Only paths through glass and mirrors onto something diffuse make caustics;
+        // the rest the path tracer finds on its own
+        bool throughSpecular = false;
+        for( int depth = 0; depth < _camera.maxBounceCount(); depth++ )
+        {
+            Hit hit;
+            if( scene.hitTest( ray, 0.001, std::numeric_limits<float>::max(), &hit ) == false )
+                break;
+            
+            if( hit.material->isDelta() == false )
+            {
+                if( throughSpecular && simd_reduce_max( hit.material->diffuseReflectance( hit ) ) > 0 )
+                {
+                    const float3 dir = simd_normalize( ray.dir );
+                    photons->push_back( Photon{ { hit.pos.x, hit.pos.y, hit.pos.z }, { power.x, power.y, power.z }, { dir.x, dir.y, dir.z } } );
+                }
+                break;
+            }
+            
+            float3 attenuation;
+            Ray scattered;
+            if( hit.material->scatter( ray, hit, &attenuation, &scattered ) == false )
+                break;
+            
+            power *= attenuation;
+            ray.pos = scattered.pos;
+            ray.dir = scattered.dir;
+            throughSpecular = true;
+        }
+    }
+}
+
+void Raytracer::submitRenderPass()
+{
+    // Do the rendering work: one pool item per block (or tile), interleaved with
+    // whatever other renders share the pool
+    if( _pass.sampleStart == 0 )
+        printf( "Starting render work...\n" );
+    _renderSubmitted = true;
+    resetWorkOrder();
+    _job = _pool->submit( _workItems.size(), _priority, [this](size_t) {
+        renderItem( _workItems[ claimNextWorkItem() ] );
+    }, [this]() {
+        finishRenderPass();
+    });
+}
+
+void Raytracer::finishRenderPass()
+{
+    // Scenes published during the pass were likely still in use when retired
+    Epoch::reclaim();
+    
+    // More samples to go: learn from this pass, then start the next
+    const int samplesDone = _pass.sampleStart + _pass.sampleCount;
+    if( samplesDone < _camera.sampleCount() )
+    {
+        if( _pass.train )
+            _pathGuide->refine();
+        
+        // Twice the samples; when what's left after the next pass couldn't make a
+        // bigger one, do it all now
+        const int remaining = _camera.sampleCount() - samplesDone;
+        _pass.sampleStart = samplesDone;
+        if( _pass.doubling )
+        {
+            _pass.sampleCount = std::min( _pass.sampleCount * 2, remaining );
+            if( remaining - _pass.sampleCount < _pass.sampleCount * 2 )
+                _pass.sampleCount = remaining;
+        }
+        else
+        {
+            _pass.sampleCount = std::min( _pass.sampleCount, remaining );
+        }
+        _pass.train = _pass.doubling && ( _pass.sampleCount < remaining );
+        
+        os_unfair_lock_lock(&_workLock);
+        const bool cancelled = _cancelled;
+        if( cancelled == false )
+        {
+            if( _pathGuide != nullptr )
+                printf( "Pass of %d samples (%d done, %d guiding regions)...\n", _pass.sampleCount, samplesDone, _pathGuide->regionCount() );
+            else
+                printf( "Pass of %d samples (%d done)...\n", _pass.sampleCount, samplesDone );
+            submitPass();
+        }
+        os_unfair_lock_unlock(&_workLock);
+        
+        if( cancelled == false )
+            return;
+    }
+    
+    completeRender();
+}
+
+void Raytracer::completeRender()
+{
+    // Re-rendered pixels are good again
+    if( _rerendering )
+    {
+        _firstHitCache->clearInvalid();
+        _rerendering = false;
+    }
+    
+    // A finished frame is the next one's history; a cancelled one is patchy
+    if( _temporalHistory != nullptr )
+    {
+        os_unfair_lock_lock(&_workLock);
+        const bool cancelled = _cancelled;
+        os_unfair_lock_unlock(&_workLock);
+        
+        if( cancelled )
+        {
+            _temporalHistory->discard();
+        }
+        else
+        {
+            const int2 resolution = _camera.resolution();
+            if( _temporalHistory->hasHistory() )
+                printf( "Reprojected %.0f%% of pixels from the last frame\n", 100.0 * _temporalHistory->reusedCount() / ( resolution.x * resolution.y ) );
+            _temporalHistory->endFrame( *_framebuffer, _camera.sampleCount() );
+            _historyCamera = _camera;
+        }
+    }
+    
+    if( _framebuffer->isStreaming() )
+        printf( "Peak framebuffer memory: %.1f MB\n", _framebuffer->peakResidentBytes() / ( 1024.0 * 1024.0 ) );
+    printf( "Complete!\n" );
+    if( _sharedFramebuffer != nullptr )
+        _sharedFramebuffer->setState( SharedFramebufferComplete );
+    _state = Complete;
+}
+
+void Raytracer::renderItem(const WorkItem& workItem)
+{
+    // Newest scene at every item; the guard keeps it alive till we're done
+    Epoch::Guard guard;
+    const SceneSnapshot& snapshot = *_snapshot.load();
+    
+    int renderedCount = 0;
+    for( int y = workItem.pixelPos.y; y < workItem.pixelPos.y + workItem.size.y; y++ )
+    {
+        for( int x = workItem.pixelPos.x; x < workItem.pixelPos.x + workItem.size.x; x++ )
+        {
+            // A re-render's blocks also hold pixels that are still good
+            if( _rerendering && _firstHitCache->isInvalid( x, y ) == false )
+                continue;
+            renderedCount++;
+            
+            float3 color;
+            PathRecord record;
+            if( _firstHitCache != nullptr )
+            {
+                // Later passes only add to what the first one touched
+                record.wholePath = _firstHitCache->recordsWholePath();
+                record.recordFirstHit = ( _pass.sampleStart == 0 );
+                color = renderPixel( snapshot, simd_make_int2( x, y ), &record );
+                if( _pass.sampleStart == 0 )
+                    _firstHitCache->store( x, y, record );
+                else
+                    _firstHitCache->merge( x, y, record );
+            }
+            else
+            {
+                // Temporal reuse needs the first pass' first hits too
+                const bool recordFirstHit = ( _temporalHistory != nullptr && _pass.sampleStart == 0 );
+                color = renderPixel( snapshot, simd_make_int2( x, y ), recordFirstHit ? &record : nullptr );
+            }
+            
+            // Samples the pixel already holds: last frame's, reprojected when the
+            // first pass gets to it, then those of earlier passes
+            float historyWeight = 0;
+            if( _temporalHistory != nullptr && _pass.sampleStart == 0 )
+            {
+                const float3 history = reprojectHistory( x, y, record, &historyWeight );
+                if( historyWeight > 0 )
+                    color = ( history * historyWeight + color * _pass.sampleCount ) / ( historyWeight + _pass.sampleCount );
+            }
+            else if( _temporalHistory != nullptr )
+            {
+                historyWeight = _temporalHistory->historyWeight( x, y );
+            }
+            
+            // Fold into the earlier passes' mean
+            if( _pass.sampleStart > 0 )
+            {
+                const float done = _pass.sampleStart + historyWeight;
+                color = ( _framebuffer->pixel( x, y ) * done + color * _pass.sampleCount ) / ( done + _pass.sampleCount );
+            }
+            
+            _framebuffer->setPixel( x, y, color );
+        }
+    }
+    
+    // Viewers get the item copied over from the framebuffer, before a streamed tile goes
+    if( _sharedFramebuffer != nullptr )
+        _sharedFramebuffer->publish( *_framebuffer, workItem.pixelPos, workItem.size, (uint64_t)renderedCount * _pass.sampleCount );
+    
+    // Streamed tiles go to disk now; a no-op when the frame stays in memory
+    if( _framebuffer->isStreaming() )
+    {
+        const int tileSize = _framebuffer->tileSize();
+        if( _framebuffer->finishTile( workItem.pixelPos.x / tileSize, workItem.pixelPos.y / tileSize ) == false )
+            printf( "Failed to write tile at %d, %d\n", workItem.pixelPos.x, workItem.pixelPos.y );
+    }
+    
+    takeSnapshotIfDue();
+}
+
+float3 Raytracer::reprojectHistory(int x, int y, const PathRecord& record, float* weight) const
+{
+    // Misses match misses, as a point far along the un-jittered ray
+    const float2 f2Resolution = simd_make_float2( _camera.resolution().x, _camera.resolution().y );
+    float3 pos = record.firstHitPos;
+    float3 norm = record.firstHitNorm;
+    if( record.hasFirstHit == false )
+    {
+        const Ray ray = _camera.getRay( simd_make_float2( x, y ) / f2Resolution );
+        pos = _camera.position() + simd_normalize( ray.dir ) * 1e4f;
+        norm = simd_make_float3( 0, 0, 0 );
+    }
+    
+    // Pixels sit at their un-jittered sample, so the old view's UV is in pixels as
+    // is. Edge pixels average over more than the first hit's surface, so they
+    // neither take nor give history
+    *weight = 0;
+    float3 history = simd_make_float3( 0, 0, 0 );
+    float2 uv;
+    if( record.firstHitsDiffer == false && _temporalHistory->hasHistory() && _historyCamera.project( pos, &uv ) )
+    {
+        const float depth = simd_length( pos - _camera.position() );
+        history = _temporalHistory->lookup( uv * f2Resolution, record.hasFirstHit, pos, norm, depth, weight );
+    }
+    
+    _temporalHistory->storeHit( x, y, record.hasFirstHit, pos, norm, record.firstHitsDiffer, *weight );
+    return history;
+}
+
+void Raytracer::splatHistory()
+{
+    if( _temporalHistory->hasHistory() == false )
+        return;
+    
+    int2 low, high;
+    frameBounds( &low, &high );
+    const float2 f2Resolution = simd_make_float2( _camera.resolution().x, _camera.resolution().y );
+    _temporalHistory->splat( *_framebuffer, low, high, [this, f2Resolution](const float3& pos, float2* pixel, float* depth) {
+        float2 uv;
+        if( _camera.project( pos, &uv ) == false )
+            return false;
+        *pixel = uv * f2Resolution;
+        *depth = simd_length( pos - _camera.position() );
+        return true;
+    });
+    
+    // Viewers see it too, as tiles without samples yet
+    if( _sharedFramebuffer != nullptr )
+    {
+        const int tileSize = _sharedFramebuffer->tileSize();
+        for( int tileY = low.y / tileSize; tileY * tileSize < high.y; tileY++ )
+        {
+            for( int tileX = low.x / tileSize; tileX * tileSize < high.x; tileX++ )
+            {
+                const int2 start = simd_make_int2( std::max( tileX * tileSize, low.x ), std::max( tileY * tileSize, low.y ) );
+                const int2 end = simd_make_int2( std::min( ( tileX + 1 ) * tileSize, high.x ), std::min( ( tileY + 1 ) * tileSize, high.y ) );
+                _sharedFramebuffer->publish( *_framebuffer, start, end - start, 0 );
+            }
+        }
+    }
+}
+
+void Raytracer::takeSnapshotIfDue()
+{
+    if( _snapshotExporter == nullptr )
+        return;
+    
+    const int64_t now = std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+    int64_t due = _nextSnapshotTime;
+    if( now < due )
+        return;
+    
+    // One worker wins the snapshot, the rest carry on rendering
+    if( _nextSnapshotTime.compare_exchange_strong( due, now + _snapshotInterval ) == false )
+        return;
+    
+    // The first check only arms the timer
+    if( due == 0 )
+        return;
+    
+    // Copied on an exporter thread, and only if it has room; a dropped snapshot
+    // costs this worker nothing
+    char path[ 1024 ];
+    snprintf( path, sizeof( path ), _snapshotPathFormat.c_str(), _snapshotIndex++ );
+    _snapshotsInFlight++;
+    const bool queued = _snapshotExporter->exportImage( _camera.resolution(), [this]() {
+        return copyLinearImage();
+    }, path, ImageExporter::formatForPath( path ), true, [this](bool) {
+        _snapshotsInFlight--;
+    });
+    if( queued == false )
+        _snapshotsInFlight--;
+}
+
+float3 Raytracer::renderPixel(const SceneSnapshot& snapshot, int2 pixelPos, PathRecord* record) const
+{
+    // Do work
+    float3 color = simd_make_float3( 0, 0, 0 );
+
+    // Helpful constant
+    const float2 f2Resolution = simd_make_float2( _camera.resolution().x, _camera.resolution().y );
+    
+    // For this pass' samples..
+    for( int sampleIndex = _pass.sampleStart; sampleIndex < _pass.sampleStart + _pass.sampleCount; sampleIndex++ )
+    {
+        // Compute UV with possible offset
+        float2 uv = simd_make_float2( pixelPos.x, pixelPos.y );
+        uv.x += ( sampleIndex == 0 ) ? 0 : random_float();
+        uv.y += ( sampleIndex == 0 ) ? 0 : random_float();
+        
+        // Normalize
+        uv /= f2Resolution;
+        
+        // Generate ray through camera with this
+        Ray ray = _camera.getRay( uv );
+        
+        // Do work! The un-jittered sample is the one whose first hit gets cached
+        color += rayTest( snapshot, ray, 0, 0, record );
+        if( record != nullptr )
+            record->recordFirstHit = false;
+    }
+    
+    // Normalize to the sample count; gamma is applied when making images
+    return color / _pass.sampleCount;
+}
+
+void Raytracer::cancel()
+{
+    os_unfair_lock_lock(&_workLock);
+    _cancelled = true;
+    if( _job != nullptr )
+        _job->cancel();
+    os_unfair_lock_unlock(&_workLock);
+}
+
+int Raytracer::priority() const
+{
+    return _priority;
+}
+
+void Raytracer::setPriority(int priority)
+{
+    os_unfair_lock_lock(&_workLock);
+    _priority = std::max( priority, 1 );
+    if( _job != nullptr )
+        _job->setPriority( _priority );
+    os_unfair_lock_unlock(&_workLock);
+}
+
+bool Raytracer::isComplete()
+{
+    return ( _state == Complete && _finalImage != nullptr );
+}
+
+const Framebuffer& Raytracer::framebuffer() const
+{
+    return *_framebuffer;
+}
+
+std::shared_ptr< ExportImage > Raytracer::copyLinearImage()
+{
+    const int2 resolution = _camera.resolution();
+    std::shared_ptr< ExportImage > image = std::make_shared< ExportImage >();
+    image->resolution = resolution;
+    image->pixels.resize( (size_t)resolution.x * resolution.y * 3 );
+    
+    // A row of tiles at a time, so streamed tiles wait on at most that to be evicted
+    float* destination = image->pixels.data();
+    for( int tileY = 0; tileY < _framebuffer->tileCount().y; tileY++ )
+    {
+        _framebuffer->lockResidency();
+        const int lastRow = std::min( ( tileY + 1 ) * _framebuffer->tileSize(), resolution.y );
+        for( int y = tileY * _framebuffer->tileSize(); y < lastRow; y++ )
+        {
+            for( int x = 0; x < resolution.x; x++ )
+            {
+                const float3 color = _framebuffer->pixel( x, y );
+                destination[ 0 ] = color.x;
+                destination[ 1 ] = color.y;
+                destination[ 2 ] = color.z;
+                destination += 3;
+            }
+        }
+        _framebuffer->unlockResidency();
+    }
+    
+    return image;
+}
+
+void Raytracer::setFirstHitCacheEnabled(bool enabled, InvalidationScope scope)
+{
+    // Only before rendering; streamed tiles are gone by the time we'd re-render
+    if( _state != Setup )
+        return;
+    
+    delete _firstHitCache;
+    _firstHitCache = nullptr;
+    
+    if( enabled && _framebuffer->isStreaming() == false )
+        _firstHitCache = new FirstHitCache( _camera.resolution(), scope == InvalidateWholePaths );
+}
+
+void Raytracer::setPathGuidingEnabled(bool enabled, const PathGuide::Options& options)
+{
+    // Passes need the earlier passes' pixels, so not when streaming tiles out
+    if( _state != Setup )
+        return;
+    
+    delete _pathGuide;
+    _pathGuide = nullptr;
+    
+    if( enabled == false || _framebuffer->isStreaming() )
+        return;
+    
+    Epoch::Guard guard;
+    const Scene& scene = _snapshot.load()->scene();
+    if( scene.shapes.empty() )
+        return;
+    
+    AABB bounds;
+    for( const IHittable* shape : scene.shapes )
+        bounds.grow( shape->bounds() );
+    _pathGuide = new PathGuide( bounds, options );
+}
+
+void Raytracer::setCausticPhotonsEnabled(bool enabled, const PhotonMap::Options& options)
+{
+    // Passes need the earlier passes' pixels, so not when streaming tiles out
+    if( _state != Setup )
+        return;
+    
+    delete _photonMap;
+    _photonMap = nullptr;
+    
+    if( enabled && _framebuffer->isStreaming() == false )
+        _photonMap = new PhotonMap( options );
+}
+
+void Raytracer::setTemporalReuseEnabled(bool enabled, const TemporalHistory::Options& options)
+{
+    // Needs the last frame's pixels, so not when streaming tiles out
+    if( _state != Setup )
+        return;
+    
+    delete _temporalHistory;
+    _temporalHistory = nullptr;
+    
+    if( enabled && _framebuffer->isStreaming() == false )
+        _temporalHistory = new TemporalHistory( _camera.resolution(), options );
+}
+
+const FirstHitCache* Raytracer::firstHitCache() const
+{
+    return _firstHitCache;
+}
+
+int Raytracer::invalidateShape(const IHittable* shape)
+{
+    if( _firstHitCache == nullptr || _state == Active )
+        return 0;
+    
+    int shapeIndex = -1;
+    {
+        Epoch::Guard guard;
+        shapeIndex = _snapshot.load()->indexOf( shape );
+    }
+    if( shapeIndex < 0 )
+        return 0;
+    _sceneEdited = true;
+    
+    // Everywhere it was seen...
+    int count = _firstHitCache->invalidate( std::vector< int >( 1, shapeIndex ) );
+    
+    // ...and everywhere it now shows up. Testing the pixel center and corners
+    // catches all but slivers thinner than a pixel
+    const int2 resolution = _camera.resolution();
+    const float2 f2Resolution = simd_make_float2( resolution.x, resolution.y );
+    const float2 offsets[] = {
+        simd_make_float2( 0.5, 0.5 ), simd_make_float2( 0, 0 ), simd_make_float2( 1, 0 ),
+        simd_make_float2( 0, 1 ), simd_make_float2( 1, 1 ),
+    };
+    for( int y = 0; y < resolution.y; y++ )
+    {
+        for( int x = 0; x < resolution.x; x++ )
+        {
+            if( _firstHitCache->isInvalid( x, y ) )
+                continue;
+            
+            for( const float2& offset : offsets )
+            {
+                // Same lens jitter as rendering, so depth of field blur wider
+                // than a pixel can still slip through
+                const float2 uv = ( simd_make_float2( x, y ) + offset ) / f2Resolution;
+                Ray ray = _camera.getRay( uv );
+                if( shape->hitTest( ray, 0.001, std::numeric_limits<float>::max(), nullptr ) )
+                {
+                    _firstHitCache->invalidatePixel( x, y );
+                    count++;
+                    break;
+                }
+            }
+        }
+    }
+    
+    return count;
+}
+
+int Raytracer::invalidateMaterial(const IMaterial* material)
+{
+    if( _firstHitCache == nullptr || _state == Active )
+        return 0;
+    
+    // Wherever a shape wearing it was seen
+    std::vector< int > shapeIndices;
+    {
+        Epoch::Guard guard;
+        shapeIndices = _snapshot.load()->indicesWithMaterial( material );
+    }
+    _sceneEdited = true;
+    return _firstHitCache->invalidate( shapeIndices );
+}
+
+void Raytracer::setSnapshotOutput(ImageExporter* exporter, const std::string& pathFormat, double intervalSeconds)
+{
+    _snapshotPathFormat = pathFormat;
+    _snapshotInterval = (int64_t)( intervalSeconds * 1e9 );
+    _nextSnapshotTime = 0;
+    _snapshotExporter = exporter;
+}
+
+uint64_t Raytracer::publishScene(const Scene& scene)
+{
+    // Only publishers take the lock, so versions go out in order; workers never wait on it
+    os_unfair_lock_lock(&_publishLock);
+    SceneSnapshot* old = _snapshot.load();
+    const uint64_t version = old->version() + 1;
+    _snapshot = SceneSnapshot::capture( scene, version );
+    os_unfair_lock_unlock(&_publishLock);
+    
+    Epoch::retire( [old]() { delete old; } );
+    return version;
+}
+
+void Raytracer::recaptureScene()
+{
+    _sceneEdited = false;
+    
+    // Copied out first: a publish from another thread could retire the snapshot
+    Scene source;
+    {
+        Epoch::Guard guard;
+        source = _snapshot.load()->source();
+    }
+    publishScene( source );
+}
+
+uint64_t Raytracer::sceneVersion() const
+{
+    Epoch::Guard guard;
+    return _snapshot.load()->version();
+}
+
+void Raytracer::setSharedFramebuffer(SharedFramebuffer* sharedFramebuffer)
+{
+    // Only before rendering, and only if it fits
+    if( _state != Setup )
+        return;
+    if( sharedFramebuffer != nullptr && ( sharedFramebuffer->resolution().x != _camera.resolution().x ||
+                                          sharedFramebuffer->resolution().y != _camera.resolution().y ||
+                                          sharedFramebuffer->tileSize() != _framebuffer->tileSize() ) )
+        return;
+    
+    _sharedFramebuffer = sharedFramebuffer;
+}
+
+void Raytracer::setCropWindow(int2 origin, int2 size)
+{
+    if( _state == Active )
+        return;
+    
+    _cropOrigin = origin;
+    _cropSize = size;
+    
+    // The next frame builds its work list again
+    _partialWorkItems = true;
+}
+
+void Raytracer::setFocusPoint(int2 pixel, float radius)
+{
+    os_unfair_lock_lock(&_orderLock);
+    _priorities.hasFocus = true;
+    _priorities.focusPoint = pixel;
+    _priorities.focusRadius = std::max( radius, 1.0f );
+    _prioritiesVersion++;
+    os_unfair_lock_unlock(&_orderLock);
+    
+    reorderRemainingWork();
+}
+
+void Raytracer::setPriorityMap(const std::vector< float >& priorities)
+{
+    if( priorities.size() != (size_t)_camera.resolution().x * _camera.resolution().y )
+        return;
+    
+    os_unfair_lock_lock(&_orderLock);
+    _priorities.map = priorities;
+    _prioritiesVersion++;
+    os_unfair_lock_unlock(&_orderLock);
+    
+    reorderRemainingWork();
+}
+
+void Raytracer::clearPriorities()
+{
+    os_unfair_lock_lock(&_orderLock);
+    _priorities = Priorities();
+    _prioritiesVersion++;
+    os_unfair_lock_unlock(&_orderLock);
+    
+    reorderRemainingWork();
+}
+
+bool Raytracer::Priorities::isSet() const
+{
+    return hasFocus || map.empty() == false;
+}
+
+float Raytracer::Priorities::of(const WorkItem& workItem, int2 resolution) const
+{
+    // A block goes as early as its most urgent pixel
+    if( map.empty() == false )
+    {
+        float priority = 0;
+        for( int y = workItem.pixelPos.y; y < workItem.pixelPos.y + workItem.size.y; y++ )
+        {
+            for( int x = workItem.pixelPos.x; x < workItem.pixelPos.x + workItem.size.x; x++ )
+                priority = std::max( priority, map[ (size_t)y * resolution.x + x ] );
+        }
+        return priority;
+    }
+    
+    // Pixels within the radius go ~1000x as likely as the rest, so they're about
+    // all done before much else is; beyond it that fades out over another radius
+    if( hasFocus )
+    {
+        const int2 center = workItem.pixelPos + workItem.size / 2;
+        const float dx = center.x - focusPoint.x;
+        const float dy = center.y - focusPoint.y;
+        const float outside = std::max( sqrt( dx * dx + dy * dy ) - focusRadius, 0.0f ) / focusRadius;
+        return 1.0f + 999.0f * exp( -8.0f * outside * outside );
+    }
+    return 1;
+}
+
+std::vector< uint32_t > Raytracer::priorityOrder(std::vector< uint32_t > items, const Priorities& priorities) const
+{
+    std::random_device rd;
+    std::mt19937 g(rd());
+    std::uniform_real_distribution< float > uniform( std::numeric_limits< float >::min(), 1.0f );
+    
+    // Weighted sampling without replacement: sorting by -log(u) / weight picks
+    // items in proportion to their weight, one after the other
+    std::vector< std::pair< float, uint32_t > > keyed;
+    keyed.reserve( items.size() );
+    for( uint32_t item : items )
+    {
+        const float weight = priorities.of( _workItems[ item ], _camera.resolution() );
+        const float key = ( weight > 0 ) ? -log( uniform( g ) ) / weight : std::numeric_limits< float >::max();
+        keyed.push_back( std::make_pair( key, item ) );
+    }
+    std::sort( keyed.begin(), keyed.end() );
+    
+    for( size_t i = 0; i < keyed.size(); i++ )
+        items[ i ] = keyed[ i ].second;
+    return items;
+}
+
+void Raytracer::resetWorkOrder()
+{
+    // Items were shuffled when made, so without priorities they go as they are;
+    // streamed tiles always do. Priorities changed during the sort would be lost
+    // (the reorder they trigger only sees the last pass' order), so sort again
+    while( true )
+    {
+        std::vector< uint32_t > order( _workItems.size() );
+        for( size_t i = 0; i < order.size(); i++ )
+            order[ i ] = (uint32_t)i;
+        
+        os_unfair_lock_lock(&_orderLock);
+        const Priorities priorities = _priorities;
+        const uint64_t version = _prioritiesVersion;
+        os_unfair_lock_unlock(&_orderLock);
+        
+        if( priorities.isSet() && _framebuffer->isStreaming() == false )
+            order = priorityOrder( std::move( order ), priorities );
+        
+        os_unfair_lock_lock(&_orderLock);
+        const bool current = ( version == _prioritiesVersion );
+        if( current )
+        {
+            // No claims between passes, so the flags can go
+            _itemClaimed = std::vector< std::atomic< uint8_t > >( _workItems.size() );
+            swapWorkOrder( std::move( order ) );
+        }
+        os_unfair_lock_unlock(&_orderLock);
+        
+        if( current )
+            return;
+    }
+}
+
+void Raytracer::reorderRemainingWork()
+{
+    if( _framebuffer->isStreaming() )
+        return;
+    
+    // Sorting a big frame takes a moment, so workers carry on meanwhile; items
+    // they claim in the meantime get skipped. Should a new pass (or another
+    // reorder) get in first, start again from that
+    while( true )
+    {
+        os_unfair_lock_lock(&_orderLock);
+        const uint64_t generation = _orderGeneration;
+        const Priorities priorities = _priorities;
+        std::vector< uint32_t > remaining;
+        const WorkOrder* order = _workOrder.load();
+        if( order != nullptr )
+        {
+            // Items before the cursor are claimed, or about to be by whoever drew them
+            for( size_t i = std::min( order->cursor.load(), order->items.size() ); i < order->items.size(); i++ )
+            {
+                if( _itemClaimed[ order->items[ i ] ] == 0 )
+                    remaining.push_back( order->items[ i ] );
+            }
+        }
+        os_unfair_lock_unlock(&_orderLock);
+        
+        if( remaining.empty() )
+            return;
+        
+        // Back to an even spread if priorities were cleared
+        if( priorities.isSet() )
+        {
+            remaining = priorityOrder( std::move( remaining ), priorities );
+        }
+        else
+        {
+            std::random_device rd;
+            std::mt19937 g(rd());
+            std::shuffle( remaining.begin(), remaining.end(), g );
+        }
+        
+        os_unfair_lock_lock(&_orderLock);
+        const bool current = ( generation == _orderGeneration );
+        if( current )
+            swapWorkOrder( std::move( remaining ) );
+        os_unfair_lock_unlock(&_orderLock);
+        
+        if( current )
+            return;
+    }
+}
+
+void Raytracer::swapWorkOrder(std::vector< uint32_t > items)
+{
+    WorkOrder* order = new WorkOrder();
+    order->items = std::move( items );
+    WorkOrder* old = _workOrder.exchange( order );
+    _orderGeneration++;
+    
+    // Workers may still be drawing from it
+    if( old != nullptr )
+        Epoch::retire( [old]() { delete old; } );
+}
+
+size_t Raytracer::claimNextWorkItem()
+{
+    // The pool makes one call per item, so there's always one left to claim: in
+    // the current order past its cursor, or drawn from an older one by a worker
+    // that will claim it. An order runs out only once it's been swapped, and
+    // then the next load gets the new one
+    Epoch::Guard guard;
+    while( true )
+    {
+        WorkOrder* order = _workOrder.load();
+        const size_t index = order->cursor++;
+        if( index >= order->items.size() )
+            continue;
+        
+        const uint32_t item = order->items[ index ];
+        if( _itemClaimed[ item ].exchange( 1 ) == 0 )
+            return item;
+    }
+}
+
+CGImageRef Raytracer::copyRenderImage(int maxDimension)
+{
+    // Point-sample every stride-th pixel to fit within maxDimension
+    const int2 resolution = _camera.resolution();
+    int stride = 1;
+    if( maxDimension > 0 )
+        stride = std::max( 1, std::max( ( resolution.x + maxDimension - 1 ) / maxDimension, ( resolution.y + maxDimension - 1 ) / maxDimension ) );
+    
+    // If we're already done rendering *and* we have a cached final image...
+    if( isComplete() && _finalImageStride == stride )
+    {
+        // Retain per "copy" contract via function signature
+        CGImageRetain( _finalImage );
+        return _finalImage;
+    }
+    
+    // Create our image backing buffer.
+    const int2 size = simd_make_int2( ( resolution.x + stride - 1 ) / stride, ( resolution.y + stride - 1 ) / stride );
+    std::vector< uint32_t > imageBuffer( (size_t)size.x * size.y );
+    
+    // Convert linear float to gamma corrected 8-bit
+    _framebuffer->lockResidency();
+    for( int y = 0; y < size.y; y++ )
+    {
+        for( int x = 0; x < size.x; x++ )
+        {
+            float3 sourceColor = _framebuffer->pixel( x * stride, y * stride );
+            
+            uint8_t r = clamp( sqrt( sourceColor.x ) * 255.0f, 0, 255 );
+            uint8_t g = clamp( sqrt( sourceColor.y ) * 255.0f, 0, 255 );
+            uint8_t b = clamp( sqrt( sourceColor.z ) * 255.0f, 0, 255 );
+            uint8_t a = 255;
+            
+            // Back backwards: we're on little-endian architecture
             uint32_t destColor = ( r << 0 ) | ( g << 8 ) | ( b << 16 ) | ( a << 24 );
             
-            imageBuffer[ pixelIndex ] = destColor;
+            imageBuffer[ (size_t)y * size.x + x ] = destColor;
         }
     }
-    os_unfair_lock_unlock(&_backingBufferLock);
+    _framebuffer->unlockResidency();
     
     // Could be done directly via CGImageCreate(...) but I prefer this method..
     CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName( kCGColorSpaceSRGB );
-    CGContextRef context = CGBitmapContextCreate( imageBuffer, resolution.x, resolution.y, 8, resolution.x * 4, colorSpace, kCGImageAlphaNoneSkipLast );
+    CGContextRef context = CGBitmapContextCreate( imageBuffer.data(), size.x, size.y, 8, size.x * 4, colorSpace, kCGImageAlphaNoneSkipLast );
     CGImageRef image = CGBitmapContextCreateImage( context );
+    CGContextRelease( context );
     CGColorSpaceRelease( colorSpace );
     
-    // Done with backing buffer
-    free( imageBuffer );
-    
     // If we're now complete, retain the final image
     if( _state == Complete )
     {
+        if( _finalImage != nullptr )
+            CGImageRelease( _finalImage );
         _finalImage = image;
+        _finalImageStride = stride;
         CGImageRetain( _finalImage );
     }
     
@@ -500,43 +1978,183 @@ CGImageRef Raytracer::copyRenderImage()
     return image;
 }
 
-float3 Raytracer::rayTest(const Ray& ray, int depth) const
+float3 Raytracer::rayTest(const SceneSnapshot& snapshot, const Ray& ray, int depth, float scatterPdf, PathRecord* record, CausticPath causticPath) const
 {
+    const Scene& scene = snapshot.scene();
+    
     // Ignore if reached max depth: no light
     if( depth >= _camera.maxBounceCount() )
         return simd_make_float3( 0, 0, 0 );
     
     // Run hit test
     Hit candidate;
-    bool didHit = _scene.hitTest( ray, 0.001, std::numeric_limits<float>::max(), &candidate );
+    bool didHit = scene.hitTest( ray, 0.001, std::numeric_limits<float>::max(), &candidate );
+    
+    // Primary rays that see something else than the first one: the pixel is on an edge
+    if( record != nullptr && depth == 0 && record->recordFirstHit == false && ( didHit ? candidate.shapeIndex : -1 ) != record->firstHitShape )
+        record->firstHitsDiffer = true;
     
     // Hit nothing... Return background
     if( didHit == false )
     {
-        float3 dir = simd_normalize(ray.dir);
-        float t = 0.5 * ( dir.y + 1.0 );
-        
         // Skylight via gradient:
+        //float3 dir = simd_normalize(ray.dir);
+        //float t = 0.5 * ( dir.y + 1.0 );
         //return ( 1.0 - t ) * simd_make_float3( 1, 1, 1 ) + t * simd_make_float3( 0.5, 0.7, 1.0 );
         
         // No light from sky:
-        return simd_make_float3(0, 0, 0);
+        if( scene.environment == nullptr )
+            return simd_make_float3(0, 0, 0);
+        
+        // Environment light; if the bounce could also have light sampled this
+        // direction, only take our MIS share of it
+        float3 radiance = scene.environment->radiance( ray.dir );
+        if( scatterPdf > 0 )
+            radiance *= misWeight( scatterPdf, scene.environment->pdf( ray.dir ) );
+        return radiance;
+    }
+    
+    // Note what we hit, for re-rendering after edits
+    if( record != nullptr )
+    {
+        if( depth == 0 && record->recordFirstHit )
+        {
+            record->hasFirstHit = true;
+            record->firstHitPos = candidate.pos;
+            record->firstHitNorm = candidate.norm;
+            record->firstHitMaterial = snapshot.sourceMaterial( candidate );
+            record->firstHitShape = candidate.shapeIndex;
+        }
+        if( depth == 0 || record->wholePath )
+            record->touch( candidate.shapeIndex );
     }
     
     // Hit something! Test how it bounces...
     Ray scatteredRay;
-    float3 attenuation;
-    float3 emitted = candidate.material->emitted( simd_make_float2(0, 0), candidate );
+    float3 attenuation = simd_make_float3( 0, 0, 0 );
+    float3 emitted = candidate.material->emitted( candidate.uv, candidate );
+    
+    // Caustics: diffuse surfaces take light from the photon map, and an emitter
+    // reached from one through glass or mirrors alone is then already counted
+    CausticPath nextCausticPath = CausticNone;
+    if( _photonMap != nullptr )
+    {
+        if( causticPath == CausticThroughSpecular )
+            emitted = simd_make_float3( 0, 0, 0 );
+        
+        const float3 reflectance = candidate.material->diffuseReflectance( candidate );
+        if( simd_reduce_max( reflectance ) > 0 )
+        {
+            emitted += reflectance * ( 1.0 / M_PI ) * _photonMap->gather( candidate.pos, candidate.norm );
+            nextCausticPath = CausticGathered;
+        }
+        else if( candidate.material->isDelta() && causticPath != CausticNone )
+        {
+            nextCausticPath = CausticThroughSpecular;
+        }
+    }
     bool didScatter = candidate.material->scatter( ray, candidate, &attenuation, &scatteredRay );
     
+    // Path guiding: pick between the material's direction and one from the learned
+    // distribution (one-sample MIS), and weight by the density of the mix
+    const int guideRegion = ( _pathGuide != nullptr && candidate.material->isDelta() == false ) ? _pathGuide->regionAt( candidate.pos ) : -1;
+    float3 throughput = attenuation;
+    float nextScatterPdf = 0;
+    if( guideRegion >= 0 )
+    {
+        if( random_float() >= _pathGuide->bsdfSamplingFraction() )
+        {
+            scatteredRay.pos = candidate.pos;
+            scatteredRay.dir = _pathGuide->sample( guideRegion, simd_make_float2( random_float(), random_float() ) );
+            didScatter = true;
+        }
+        
+        if( didScatter )
+        {
+            const float materialPdf = candidate.material->scatterPdf( ray, candidate, scatteredRay.dir );
+            nextScatterPdf = guidedScatterPdf( guideRegion, scatteredRay.dir, materialPdf );
+            didScatter = ( materialPdf > 0 && nextScatterPdf > 0 );
+            if( didScatter )
+                throughput = attenuation * ( materialPdf / nextScatterPdf );
+        }
+    }
+    else if( didScatter && scene.environment != nullptr )
+    {
+        nextScatterPdf = candidate.material->scatterPdf( ray, candidate, scatteredRay.dir );
+    }
+    
+    // The cone carries on from where it hit; rough bounces spread it out, since
+    // neighbouring pixels' rays scatter in all sorts of directions
+    scatteredRay.coneWidth = candidate.coneWidth;
+    scatteredRay.coneSpread = ray.coneSpread + ( candidate.material->isDelta() ? 0 : kScatterConeSpread );
+    
+    // Directly sample the environment; comes back black for delta materials. Done
+    // even if the scatter got absorbed: that's independent of the light sample.
+    // The last bounce's continuation can't see the environment, so there the
+    // light sample takes all of it rather than its MIS share
+    float3 direct = simd_make_float3( 0, 0, 0 );
+    if( scene.environment != nullptr )
+    {
+        const bool lastBounce = ( depth + 1 >= _camera.maxBounceCount() );
+        direct = sampleEnvironment( snapshot, ray, candidate, attenuation, guideRegion, lastBounce, record );
+    }
+    
     // If scattering..
     if( didScatter )
     {
-        return emitted + attenuation * rayTest( scatteredRay, depth + 1 );
+        const float3 incoming = rayTest( snapshot, scatteredRay, depth + 1, nextScatterPdf, record, nextCausticPath );
+        if( guideRegion >= 0 && _pass.train )
+            _pathGuide->record( guideRegion, scatteredRay.dir, luminance( incoming ) / nextScatterPdf );
+        return emitted + direct + throughput * incoming;
     }
     // Not scattering: just emissive..
     else
     {
-        return emitted;
+        return emitted + direct;
+    }
+}
+
+float3 Raytracer::sampleEnvironment(const SceneSnapshot& snapshot, const Ray& ray, const Hit& hit, const float3& attenuation, int guideRegion, bool lastBounce, PathRecord* record) const
+{
+    const Scene& scene = snapshot.scene();
+    float3 direction;
+    float lightPdf;
+    const float3 radiance = scene.environment->sample( simd_make_float2( random_float(), random_float() ), &direction, &lightPdf );
+    if( lightPdf <= 0 )
+        return simd_make_float3( 0, 0, 0 );
+    
+    const float materialPdf = hit.material->scatterPdf( ray, hit, direction );
+    if( materialPdf <= 0 )
+        return simd_make_float3( 0, 0, 0 );
+    
+    // Weighted against however the bounce would have found this direction
+    const float scatterPdf = ( guideRegion >= 0 ) ? guidedScatterPdf( guideRegion, direction, materialPdf ) : materialPdf;
+    
+    // Shadow ray: anything in the way blocks the environment. Whole-path records
+    // keep the blocker, since moving it changes this pixel too
+    Ray shadowRay;
+    shadowRay.pos = hit.pos;
+    shadowRay.dir = direction;
+    const bool recordBlocker = ( record != nullptr && record->wholePath );
+    Hit blocker;
+    if( scene.hitTest( shadowRay, 0.001, std::numeric_limits<float>::max(), recordBlocker ? &blocker : nullptr ) )
+    {
+        if( recordBlocker )
+            record->touch( blocker.shapeIndex );
+        return simd_make_float3( 0, 0, 0 );
     }
+    
+    // The guide learns from light samples too, with the same MIS weight
+    const float weight = lastBounce ? 1.0f : misWeight( lightPdf, scatterPdf );
+    if( guideRegion >= 0 && _pass.train )
+        _pathGuide->record( guideRegion, direction, luminance( radiance ) * weight / lightPdf );
+    
+    // BRDF * cosine is attenuation * materialPdf for our materials
+    return attenuation * radiance * ( materialPdf / lightPdf * weight );
+}
+
+float Raytracer::guidedScatterPdf(int guideRegion, const float3& direction, float materialPdf) const
+{
+    const float bsdfFraction = _pathGuide->bsdfSamplingFraction();
+    return bsdfFraction * materialPdf + ( 1.0f - bsdfFraction ) * _pathGuide->pdf( guideRegion, direction );
 }
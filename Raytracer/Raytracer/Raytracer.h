@@ -10,11 +10,24 @@
 #define Raytracer_h
 
 #include <CoreGraphics/CoreGraphics.h>
-#include <dispatch/dispatch.h>
 #include <os/lock.h>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 #include "VectorTypes.h"
+#include "RenderThreadPool.h"
+#include "Framebuffer.h"
+#include "ImageExporter.h"
+#include "EnvironmentMap.h"
+#include "FirstHitCache.h"
+#include "BVH.h"
+#include "SharedFramebuffer.h"
+#include "PathGuide.h"
+#include "Texture.h"
+#include "PhotonMap.h"
+#include "Epoch.h"
+#include "TemporalHistory.h"
 
 // Ray has origin and direction
 struct Ray
@@ -22,7 +35,13 @@ struct Ray
     float3 pos;
     float3 dir;
     
+    // Ray cone, for picking texture mip levels: width at the origin, and how
+    // much wider it gets per unit of distance (radians, roughly)
+    float coneWidth = 0;
+    float coneSpread = 0;
+    
     float3 at(float t) const;
+    float coneWidthAt(float t) const;
 };
 
 // Forward declare material: a hit will always have a reference
@@ -36,6 +55,12 @@ struct Hit
     float3 norm;
     IMaterial* material = nullptr;
     bool isFrontFace;
+    int shapeIndex = -1; // Index into Scene::shapes, set by the scene
+    
+    // Surface coordinates, and how much of them the ray cone covers here
+    float2 uv = simd_make_float2( 0, 0 );
+    float2 uvFootprint = simd_make_float2( 0, 0 );
+    float coneWidth = 0; // World units
 };
 
 // Interface to do collision testing: any shape class should conform tothis
@@ -43,8 +68,22 @@ class IHittable
 {
 public:
     
+    virtual ~IHittable() = default;
+    
     virtual bool hitTest(const Ray& ray, float tmin, float tmax, Hit* hit = nullptr) const = 0;
     
+    // Fill in uv and uvFootprint for a hit hitTest() found. Kept out of hitTest(),
+    // since most hits lose to a closer one or land on untextured materials
+    virtual void fillTextureCoordinates(const Ray& ray, Hit* hit) const = 0;
+    
+    // World space box around the shape, for the BVH
+    virtual AABB bounds() const = 0;
+    
+    virtual IMaterial* material() const = 0;
+    
+    // Independent copy, material included, for scene snapshots
+    virtual IHittable* clone() const = 0;
+    
 };
 
 // Materials define how rays scatter: diffuse materials randomze rays a ton,
@@ -55,10 +94,30 @@ public:
     
     virtual ~IMaterial() = default;
     
+    virtual IMaterial* clone() const = 0;
+    
     virtual bool scatter(const Ray& ray, const Hit& hit, float3* attenuation, Ray* scattered) const = 0;
     
     virtual float3 emitted(float2 uv, const Hit& hit) const = 0;
     
+    // Density (per solid angle) of scatter() picking the given direction, so lights
+    // can be sampled directly and weighted against it. Materials that return
+    // non-zero must set attenuation in scatter() even when it returns false, and
+    // their attenuation * pdf must be their BRDF * cosine. Zero means a delta
+    // lobe (mirror, glass) that light sampling can't hit.
+    virtual float scatterPdf(const Ray& ray, const Hit& hit, const float3& direction) const;
+    
+    // False if scatterPdf() fully describes scatter(), so bounce directions may also
+    // come from somewhere else (path guiding) and get weighted by it
+    virtual bool isDelta() const;
+    
+    // Albedo of the material's Lambertian part, so estimates that need the BRDF
+    // itself (photon gathering) can use it; zero if it has none
+    virtual float3 diffuseReflectance(const Hit& hit) const;
+    
+    // True if it samples a texture, so its hits need texture coordinates
+    virtual bool isTextured() const;
+    
 };
 
 // Concrete Lambertian material
@@ -68,12 +127,27 @@ public:
     
     LambertianMaterial(const float3& albedo);
     
+    float3 albedo() const;
+    void setAlbedo(const float3& albedo);
+    
+    // Multiplies the albedo, if set
+    std::shared_ptr< Texture > albedoTexture() const;
+    void setAlbedoTexture(std::shared_ptr< Texture > texture);
+    
+    IMaterial* clone() const override;
     bool scatter(const Ray& ray, const Hit& hit, float3* attenuation, Ray* scattered) const override;
     float3 emitted(float2 uv, const Hit& hit) const override;
+    float scatterPdf(const Ray& ray, const Hit& hit, const float3& direction) const override;
+    bool isDelta() const override;
+    float3 diffuseReflectance(const Hit& hit) const override;
+    bool isTextured() const override;
     
 private:
     
     float3 _albedo;
+    std::shared_ptr< Texture > _albedoTexture;
+    
+    float3 albedoAt(const Hit& hit) const;
     
 };
 
@@ -85,13 +159,36 @@ public:
     // 0 roughness = super shiney, 1 roughness = blyrr
     MetalMaterial(const float3& albedo, float roughness);
     
+    float3 albedo() const;
+    void setAlbedo(const float3& albedo);
+    
+    float roughness() const;
+    void setRoughness(float roughness);
+    
+    // Multiply the albedo / roughness (red channel), if set. Textured roughness
+    // stays at 0.01 or above, so light sampling and guiding still work on it;
+    // a roughness of 0 stays a mirror
+    std::shared_ptr< Texture > albedoTexture() const;
+    void setAlbedoTexture(std::shared_ptr< Texture > texture);
+    std::shared_ptr< Texture > roughnessTexture() const;
+    void setRoughnessTexture(std::shared_ptr< Texture > texture);
+    
+    IMaterial* clone() const override;
     bool scatter(const Ray& ray, const Hit& hit, float3* attenuation, Ray* scattered) const override;
     float3 emitted(float2 uv, const Hit& hit) const override;
+    float scatterPdf(const Ray& ray, const Hit& hit, const float3& direction) const override;
+    bool isDelta() const override;
+    bool isTextured() const override;
     
 private:
     
     float3 _albedo;
     float _roughness;
+    std::shared_ptr< Texture > _albedoTexture;
+    std::shared_ptr< Texture > _roughnessTexture;
+    
+    float3 albedoAt(const Hit& hit) const;
+    float roughnessAt(const Hit& hit) const;
 };
 
 // Concrete glass material
@@ -101,6 +198,7 @@ public:
 
     DielectricMaterial(float ri);
     
+    IMaterial* clone() const override;
     bool scatter(const Ray& ray, const Hit& hit, float3* attenuation, Ray* scattered) const override;
     float3 emitted(float2 uv, const Hit& hit) const override;
     
@@ -116,12 +214,21 @@ public:
 
     DiffuseLightMaterial(float3 light);
     
+    float3 light() const;
+    
+    // Multiplies the light, if set
+    std::shared_ptr< Texture > emissionTexture() const;
+    void setEmissionTexture(std::shared_ptr< Texture > texture);
+    
+    IMaterial* clone() const override;
     bool scatter(const Ray& ray, const Hit& hit, float3* attenuation, Ray* scattered) const override;
     float3 emitted(float2 uv, const Hit& hit) const override;
+    bool isTextured() const override;
     
 private:
     
     float3 _light;
+    std::shared_ptr< Texture > _emissionTexture;
 };
 
 
@@ -142,12 +249,18 @@ public:
     void setRadius(float radius);
     
     // Material
-    IMaterial* material() const;
+    IMaterial* material() const override;
     void setMaterial(IMaterial* material);
     
     // Returns true if a hit was found, and returns that
-    // position and normal via optional in/out via argument
+    // position and normal via optional in/out via argument.
+    // UVs wrap around y: u from longitude, v from the top (+y) down
     bool hitTest(const Ray& ray, float tmin, float tmax, Hit* hit = nullptr) const override;
+    void fillTextureCoordinates(const Ray& ray, Hit* hit) const override;
+    
+    AABB bounds() const override;
+    
+    IHittable* clone() const override;
     
 private:
     
@@ -155,6 +268,8 @@ private:
     float _radius = 1.0;
     IMaterial* _material = nullptr; // Set in constructor to a default..
     
+    void fillHit(const Ray& ray, float t, Hit* hit) const;
+    
 };
 
 // Scene has a collection of hittable objects
@@ -165,11 +280,58 @@ public:
     // Public for ease. Leaking, that's fine for toy project
     std::vector< IHittable* > shapes;
     
+    // Optional light from infinitely far away; misses are black without one
+    EnvironmentMap* environment = nullptr;
+    
+    // Optional acceleration structure over shapes; tests every shape without one.
+    // Rebuild or refit it after moving shapes
+    std::shared_ptr< BVH > bvh;
+    
     // Given a ray, return closest hit test (if any)
     bool hitTest(const Ray& ray, float tmin, float tmax, Hit* hit = nullptr) const;
     
 };
 
+// Version of a scene that renders can read while it's being edited. Snapshots
+// own copies of every shape and material, so the caller can carry on editing
+// the moment capture() returns; nothing in one ever changes.
+class SceneSnapshot
+{
+public:
+    
+    // Copies the shapes, and the scene's BVH if it has one, refit to the copies
+    static SceneSnapshot* capture(const Scene& scene, uint64_t version);
+    
+    ~SceneSnapshot();
+    
+    const Scene& scene() const;
+    uint64_t version() const;
+    
+    // The caller's scene this was captured from, to capture again after edits
+    const Scene& source() const;
+    
+    // Index of a caller's shape, -1 if not in the snapshot
+    int indexOf(const IHittable* shape) const;
+    
+    // Indices of the shapes wearing one of the caller's materials
+    std::vector< int > indicesWithMaterial(const IMaterial* material) const;
+    
+    // The caller's material behind a hit, so first hit records stay comparable
+    // across snapshots
+    const IMaterial* sourceMaterial(const Hit& hit) const;
+    
+private:
+    
+    SceneSnapshot() = default;
+    
+    Scene _scene;
+    Scene _source;
+    uint64_t _version = 0;
+    
+    // Per shape, the material it was copied from
+    std::vector< const IMaterial* > _sourceMaterials;
+};
+
 // Camera describes location, fov, target resolution, etc.
 class Camera
 {
@@ -194,10 +356,15 @@ public:
     // Given a UV coordinate, return vector. Is randomized for AA if sample count > 1
     Ray getRay(float2 uv) const;
     
+    // Where a point lands on screen (the UV getRay() takes), through the lens
+    // center; false if it's behind the camera
+    bool project(const float3& point, float2* uv) const;
+    
 private:
     
     float _fovy; // Vertical degrees
     float _lensRadius;
+    float _pixelSpread = 0; // Radians one pixel covers
     int2 _resolution = simd_make_int2(100, 100);
     
     int _sampleCount = 1;
@@ -219,52 +386,316 @@ class Raytracer
 {
 public:
     
-    Raytracer(const Camera& camera, const Scene& scene);
+    // Renders on the given pool, or the shared pool if none is given. The framebuffer
+    // options pick the pixel format and whether finished tiles stream to disk
+    Raytracer(const Camera& camera, const Scene& scene, RenderThreadPool* pool = nullptr,
+              const Framebuffer::Options& framebufferOptions = Framebuffer::Options());
     ~Raytracer();
     
     // Start rendering: this is a background operation, non-blocking
     void renderAsync();
     bool isComplete();
     
+    // Blocks until the render (or a cancelled one) has wound down
+    void waitUntilComplete();
+    
+    // Once complete, render the next frame of an animation from a new camera of the
+    // same resolution, reusing the framebuffer and work list. Shapes can have moved
+    // in between, but not been added or removed; publishScene() them first. Also
+    // the way on after a cancel(). Returns false if not possible
+    bool renderFrameAsync(const Camera& camera);
+    
+    // Stop rendering early: pixels already in flight finish, the rest stay black.
+    // isComplete() turns true once the workers have drained; renderFrameAsync()
+    // and rerenderAsync() can start again from there
+    void cancel();
+    
+    // Share of the pool relative to other renders on it; an interactive preview
+    // at priority 8 gets ~8x the pixels of a batch render at priority 1
+    int priority() const;
+    void setPriority(int priority);
+    
+    // Keep each pixel's first hit and the objects / materials its samples touched,
+    // so edits can re-render only what they affect. Primary-hit scope misses
+    // changes seen in reflections or shadows; whole-path scope catches those too
+    // but invalidates more. Not available when streaming tiles to disk. Set
+    // before renderAsync().
+    enum InvalidationScope {
+        InvalidatePrimaryHits,
+        InvalidateWholePaths,
+    };
+    void setFirstHitCacheEnabled(bool enabled, InvalidationScope scope = InvalidatePrimaryHits);
+    const FirstHitCache* firstHitCache() const;
+    
+    // After editing a shape or material in place (only while not rendering), flag
+    // the pixels it can have changed; the next rerenderAsync() copies the scene's
+    // edits in. Shapes are also ray tested where they are now, to catch pixels they
+    // moved into. Returns the number of pixels flagged.
+    int invalidateShape(const IHittable* shape);
+    int invalidateMaterial(const IMaterial* material);
+    
+    // Once complete, re-render just the flagged pixels; the rest of the image is kept
+    void rerenderAsync();
+    
+    // Render in progressive passes (1, 2, 4.. samples) and learn where light comes
+    // from as they go, steering diffuse and rough bounces towards it. Pays off when
+    // light arrives through small openings. Not available when streaming tiles to
+    // disk; set before renderAsync()
+    void setPathGuidingEnabled(bool enabled, const PathGuide::Options& options = PathGuide::Options());
+    
+    // Trace photons from the emitters (spheres with a DiffuseLightMaterial)
+    // through glass and mirrors before every pass, and light diffuse surfaces
+    // with them, instead of hoping diffuse bounces find the emitters through the
+    // glass. Renders go in passes so the gather radius can shrink. Not available
+    // when streaming tiles to disk; set before renderAsync()
+    void setCausticPhotonsEnabled(bool enabled, const PhotonMap::Options& options = PhotonMap::Options());
+    
+    // Interactive camera moves: each renderFrameAsync() starts from the last frame,
+    // reprojected into the new view wherever the same surfaces are still visible,
+    // and its samples refine that. Lighting that changes with the view lags by up
+    // to maxHistorySamples. Re-renders after edits drop the history, but a scene
+    // published with publishScene() shows through it until fresh samples outweigh
+    // it. Not available when streaming tiles to disk; set before renderAsync()
+    void setTemporalReuseEnabled(bool enabled, const TemporalHistory::Options& options = TemporalHistory::Options());
+    
+    // Render just a window of the frame, in pixels; the rest stays black. Not
+    // while rendering; a zero size renders the whole frame again
+    void setCropWindow(int2 origin, int2 size);
+    
+    // Render some pixels first: those near a focus point (falling off over the
+    // radius, in pixels), or by a priority map of one weight per pixel (0 goes
+    // last), which wins over the focus. Blocks of pixels are still picked at
+    // random, but weighted, so the rest fills in as the focus finishes. Can change
+    // mid-render: blocks not started yet get reordered, nothing restarts.
+    // Streamed tiles ignore it, since they go in order to keep memory down
+    void setFocusPoint(int2 pixel, float radius);
+    void setPriorityMap(const std::vector< float >& priorities);
+    void clearPriorities();
+    
     // Query current render buffers. This locks the async rendering work,
-    // so it is expensive.
-    CGImageRef copyRenderImage();
+    // so it is expensive. With maxDimension set, huge frames are point-sampled
+    // down so the preview doesn't need a full-size 32-bit copy.
+    CGImageRef copyRenderImage(int maxDimension = 0);
+    
+    // Linear radiance, straight from the render
+    const Framebuffer& framebuffer() const;
+    
+    // Full-precision copy of the current render, ready to hand to an ImageExporter
+    std::shared_ptr< ExportImage > copyLinearImage();
+    
+    // While rendering, queue a snapshot to the exporter every interval seconds. The
+    // path format gets the snapshot number, e.g. "/tmp/raytracing_%03d.exr". If the
+    // exporter is backed up the snapshot is dropped; rendering never waits on it,
+    // and the copy is made on the exporter's threads. The exporter has to outlive
+    // us. Set this up before renderAsync().
+    void setSnapshotOutput(ImageExporter* exporter, const std::string& pathFormat, double intervalSeconds);
+    
+    // Also publish pixels to shared memory as they finish, for viewers in other
+    // processes. Same resolution as the camera and tile size as the framebuffer;
+    // set before renderAsync()
+    void setSharedFramebuffer(SharedFramebuffer* sharedFramebuffer);
+    
+    // Swap in a copy of the scene as it is now, from any thread, even mid-render.
+    // Workers pick it up from their next pixel (or tile), and the old copy is freed
+    // once none of them is using it; the traversal never takes a lock. Samples
+    // already taken stay in the image. Returns the new version, counting up from 1.
+    // The scene's shapes and materials are read again only after invalidateShape() /
+    // invalidateMaterial(), so don't edit them in place while a render or another
+    // thread's publish could be reading them: edit between renders, or publish new ones
+    uint64_t publishScene(const Scene& scene);
+    uint64_t sceneVersion() const;
     
 private:
     
-    // Camera and scene to render
+    // Camera and scene to render: a copy of the constructor's scene, then of the
+    // latest published or edited one. Readers load it inside an Epoch::Guard
     Camera _camera;
-    Scene _scene;
+    std::atomic< SceneSnapshot* > _snapshot;
+    os_unfair_lock _publishLock;
+    
+    // Publish a fresh copy of the current snapshot's source, picking up edits
+    // made in place while not rendering. Only once flagged, since it copies the
+    // whole scene
+    void recaptureScene();
+    bool _sceneEdited = false;
+    
+    // Backing image buffer, linear radiance
+    Framebuffer* _framebuffer;
+    
+    // Pool we're doing the work on, and the job currently running on it
+    RenderThreadPool* _pool;
+    std::shared_ptr< RenderJob > _job;
+    int _priority = 1;
+    bool _cancelled = false;
+    bool _renderSubmitted = false;
+    
+    // Work item: a small block of pixels, or a whole tile when streaming tiles out
+    struct WorkItem
+    {
+        int2 pixelPos;
+        int2 size;
+    };
     
-    // Backing image buffer
-    os_unfair_lock _backingBufferLock;
-    float3* _backingBuffer;
+    // Where a path is relative to its last photon gather: emitters it reaches
+    // from there through glass or mirrors alone were already counted by photons
+    enum CausticPath {
+        CausticNone,
+        CausticGathered,
+        CausticThroughSpecular,
+    };
     
-    // Background queue we're doing the dispatch_apply from
-    dispatch_queue_t _workQueue;
+    // Ray testing the scene.. scatterPdf is the density the ray was scattered
+    // with, used to weight environment hits against light sampling (0 if none).
+    // Hits get noted in the record, if given
+    float3 rayTest(const SceneSnapshot& snapshot, const Ray& ray, int depth = 0, float scatterPdf = 0,
+                   PathRecord* record = nullptr, CausticPath causticPath = CausticNone) const;
     
-    // Work item
-    struct WorkItem
+    // Light sample of the environment from a hit, MIS weighted against the material
+    // (and the guide, given the hit's region; -1 if not guided); unweighted on the
+    // last bounce, which has no continuation to share with
+    float3 sampleEnvironment(const SceneSnapshot& snapshot, const Ray& ray, const Hit& hit, const float3& attenuation, int guideRegion, bool lastBounce, PathRecord* record) const;
+    
+    // Density of a guided bounce: the material / guide mix
+    float guidedScatterPdf(int guideRegion, const float3& direction, float materialPdf) const;
+    
+    // Trace all samples of the item's pixels and store them
+    void renderItem(const WorkItem& workItem);
+    
+    // Last frame's color where the pixel's new first hit was, and how many samples
+    // it counts as (0 if disoccluded)
+    float3 reprojectHistory(int x, int y, const PathRecord& record, float* weight) const;
+    
+    // Last frame moved into the new view, as the viewport's picture until the
+    // first pass replaces it pixel by pixel
+    void splatHistory();
+    float3 renderPixel(const SceneSnapshot& snapshot, int2 pixelPos, PathRecord* record) const;
+    
+    // First hits of the last render, if enabled
+    FirstHitCache* _firstHitCache = nullptr;
+    
+    // Learned bounce directions, if enabled
+    PathGuide* _pathGuide = nullptr;
+    
+    // Caustic photons of the current pass, if enabled; traced in chunks, one per
+    // pool item, from emitters picked by power. Each chunk finds the emitters in
+    // the snapshot it picked up
+    PhotonMap* _photonMap = nullptr;
+    struct PhotonEmitter
     {
-        int2 pixelPos;
+        const Sphere* sphere;
+        float cdf;
+    };
+    std::vector< std::vector< Photon > > _photonChunks;
+    
+    // Last frame, and the camera it was seen from, if reusing it
+    TemporalHistory* _temporalHistory = nullptr;
+    Camera _historyCamera;
+    
+    static std::vector< PhotonEmitter > photonEmitters(const Scene& scene);
+    void tracePhotons(const SceneSnapshot& snapshot, int count, std::vector< Photon >* photons) const;
+    
+    // Samples the current pass traces per pixel, after sampleStart done before it;
+    // train is set when a later pass will learn from this one. Doubling passes
+    // go 1, 2, 4.. samples, others keep to the photon map's pass size
+    struct Pass
+    {
+        int sampleStart = 0;
+        int sampleCount = 0;
+        bool train = false;
+        bool doubling = false;
+    };
+    Pass _pass;
+    
+    // Runs prepareWorkItems as a setup job on the pool, then renders the items
+    void submitWork(std::function<void()> prepareWorkItems);
+    
+    // Pass after pass until every sample is done, photons first if enabled; the
+    // submit calls need the work lock
+    void beginPasses(bool progressive);
+    void submitPass();
+    void submitPhotonPass();
+    void submitRenderPass();
+    void finishRenderPass();
+    void completeRender();
+    
+    // Work items covering the whole frame, or the crop window
+    void prepareFrameWorkItems();
+    void frameBounds(int2* low, int2* high) const;
+    int2 _cropOrigin = simd_make_int2( 0, 0 );
+    int2 _cropSize = simd_make_int2( 0, 0 );
+    
+    // Order the pass hands out work items in. Each pool item bumps the cursor of
+    // the current order and takes that item unless it's claimed already, so
+    // claims never lock and the order can be swapped mid-pass (old ones go
+    // through Epoch). The lock is for swapping orders and changing priorities
+    struct WorkOrder
+    {
+        std::vector< uint32_t > items;
+        std::atomic< size_t > cursor{ 0 };
     };
+    os_unfair_lock _orderLock;
+    std::atomic< WorkOrder* > _workOrder{ nullptr };
+    std::vector< std::atomic< uint8_t > > _itemClaimed; // Reallocated between passes only
+    uint64_t _orderGeneration = 0;
     
-    // Ray testing the scene..
-    float3 rayTest(const Ray& ray, int depth = 0) const;
+    // Publishes a new order, starting at its first item; lock must be held
+    void swapWorkOrder(std::vector< uint32_t > items);
     
-    // Work items and lock
+    // What goes first, guarded by the order lock; copied out to sort by. The
+    // version goes up with every change, so a sort can tell it's stale
+    struct Priorities
+    {
+        bool hasFocus = false;
+        int2 focusPoint;
+        float focusRadius = 0;
+        std::vector< float > map; // Per pixel, if set
+        
+        bool isSet() const;
+        float of(const WorkItem& workItem, int2 resolution) const;
+    };
+    Priorities _priorities;
+    uint64_t _prioritiesVersion = 0;
+    
+    // Item indices by a weighted random pick (1 / priority scaled exponential keys),
+    // so higher priorities tend to go first and zero goes last
+    std::vector< uint32_t > priorityOrder(std::vector< uint32_t > items, const Priorities& priorities) const;
+    
+    // Fresh order over every item, for a new pass; and one over just the items
+    // not claimed yet, after priorities change
+    void resetWorkOrder();
+    void reorderRemainingWork();
+    size_t claimNextWorkItem();
+    
+    // Progressive snapshots; whichever worker notices one is due takes it
+    ImageExporter* _snapshotExporter = nullptr;
+    std::string _snapshotPathFormat;
+    int64_t _snapshotInterval = 0; // Nanoseconds
+    std::atomic< int64_t > _nextSnapshotTime{ 0 };
+    std::atomic< int > _snapshotIndex{ 0 };
+    std::atomic< int > _snapshotsInFlight{ 0 };
+    
+    void takeSnapshotIfDue();
+    
+    // Where finished pixels get published for other processes, if anywhere
+    SharedFramebuffer* _sharedFramebuffer = nullptr;
+    
+    // Work items; lock guards the job handle and its flags
     os_unfair_lock _workLock;
     std::vector< WorkItem > _workItems;
+    bool _partialWorkItems = false; // Not the frame's usual list: a re-render's pixels, or a new crop
+    bool _rerendering = false;      // Only the first-hit cache's flagged pixels, until complete
     
     // Current state
     enum State {
         Setup,      // Initialized, doing no work
         Active,     // Active work
         Complete,   // All done!
-    } _state;
+    };
+    std::atomic< State > _state;
     
-    // Final image we've rendered
+    // Final image we've rendered, and the downsampling it was made with
     CGImageRef _finalImage;
+    int _finalImageStride;
     
 };
 
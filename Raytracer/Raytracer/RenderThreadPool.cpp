@@ -0,0 +1,343 @@
+//
+//  RenderThreadPool.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "RenderThreadPool.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <pthread.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#pragma mark CPU Topology
+
+#if defined(__linux__)
+
+// Parses a kernel cpulist string, e.g. "0-15,32-47"
+static std::vector< int > parseCpuList(const std::string& cpuList)
+{
+    std::vector< int > cpus;
+    std::stringstream stream( cpuList );
+    std::string range;
+    while( std::getline( stream, range, ',' ) )
+    {
+        if( range.empty() )
+            continue;
+
+        size_t dash = range.find( '-' );
+        int first = std::stoi( range.substr( 0, dash ) );
+        int last = ( dash == std::string::npos ) ? first : std::stoi( range.substr( dash + 1 ) );
+        for( int cpu = first; cpu <= last; cpu++ )
+            cpus.push_back( cpu );
+    }
+    return cpus;
+}
+
+// CPUs this process may run on, restricted to a NUMA node if one is given
+static std::vector< int > availableCpus(int numaNode)
+{
+    std::vector< int > cpus;
+
+    cpu_set_t processSet;
+    CPU_ZERO( &processSet );
+    if( sched_getaffinity( 0, sizeof( processSet ), &processSet ) != 0 )
+        return cpus;
+
+    if( numaNode >= 0 )
+    {
+        std::ifstream file( "/sys/devices/system/node/node" + std::to_string( numaNode ) + "/cpulist" );
+        std::string cpuList;
+        if( std::getline( file, cpuList ) )
+        {
+            for( int cpu : parseCpuList( cpuList ) )
+            {
+                if( CPU_ISSET( cpu, &processSet ) )
+                    cpus.push_back( cpu );
+            }
+            return cpus;
+        }
+
+        printf( "NUMA node %d not found, using all CPUs\n", numaNode );
+    }
+
+    for( int cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+    {
+        if( CPU_ISSET( cpu, &processSet ) )
+            cpus.push_back( cpu );
+    }
+    return cpus;
+}
+
+#endif
+
+#pragma mark RenderJob Class
+
+void RenderJob::cancel()
+{
+    _cancelled = true;
+
+    RenderThreadPool* pool = _pool;
+    if( pool != nullptr )
+        pool->jobCancelled();
+}
+
+bool RenderJob::isCancelled() const
+{
+    return _cancelled;
+}
+
+bool RenderJob::isComplete() const
+{
+    return _complete;
+}
+
+void RenderJob::wait()
+{
+    std::unique_lock< std::mutex > lock( _completeLock );
+    _completeCondition.wait( lock, [this]{ return _complete.load(); } );
+}
+
+int RenderJob::priority() const
+{
+    return _priority;
+}
+
+void RenderJob::setPriority(int priority)
+{
+    _priority = std::max( priority, 1 );
+}
+
+#pragma mark RenderThreadPool Class
+
+// Most items a worker claims per trip through the pool lock
+static const size_t kMaxBatchSize = 64;
+
+RenderThreadPool::RenderThreadPool()
+    : RenderThreadPool( Options() )
+{
+}
+
+RenderThreadPool::RenderThreadPool(const Options& options)
+{
+    _options = options;
+
+#if defined(__linux__)
+    if( options.pinWorkers || options.numaNode >= 0 )
+        _cpus = availableCpus( options.numaNode );
+#endif
+
+    int workerCount = options.workerCount;
+    if( workerCount <= 0 )
+        workerCount = _cpus.empty() ? (int)std::thread::hardware_concurrency() : (int)_cpus.size();
+    workerCount = std::max( workerCount, 1 );
+
+    for( int i = 0; i < workerCount; i++ )
+        _workers.emplace_back( &RenderThreadPool::workerMain, this, i );
+}
+
+RenderThreadPool::~RenderThreadPool()
+{
+    {
+        std::lock_guard< std::mutex > lock( _lock );
+        _shuttingDown = true;
+        for( const std::shared_ptr< RenderJob >& job : _jobs )
+            job->_cancelled = true;
+    }
+    _workCondition.notify_all();
+
+    for( std::thread& worker : _workers )
+        worker.join();
+}
+
+RenderThreadPool* RenderThreadPool::shared()
+{
+    // Leaked on purpose: workers may still be finishing up during static destruction
+    static RenderThreadPool* pool = new RenderThreadPool();
+    return pool;
+}
+
+int RenderThreadPool::workerCount() const
+{
+    return (int)_workers.size();
+}
+
+std::shared_ptr< RenderJob > RenderThreadPool::submit(size_t count, int priority, std::function<void(size_t)> work, std::function<void()> completion)
+{
+    std::shared_ptr< RenderJob > job = std::make_shared< RenderJob >();
+    job->_work = work;
+    job->_completion = completion;
+    job->_count = count;
+    job->_pool = this;
+    job->setPriority( priority );
+
+    {
+        std::lock_guard< std::mutex > lock( _lock );
+
+        // Start new jobs level with the least-served runnable job, so a job that
+        // joins late neither starves others nor gets starved by them
+        double virtualTime = 0;
+        bool foundRunnable = false;
+        for( const std::shared_ptr< RenderJob >& other : _jobs )
+        {
+            if( other->_cancelled == false && other->_nextItem < other->_count )
+            {
+                virtualTime = foundRunnable ? std::min( virtualTime, other->_virtualTime ) : other->_virtualTime;
+                foundRunnable = true;
+            }
+        }
+        job->_virtualTime = virtualTime;
+
+        _jobs.push_back( job );
+    }
+    _workCondition.notify_all();
+
+    return job;
+}
+
+std::shared_ptr< RenderJob > RenderThreadPool::nextJob()
+{
+    std::shared_ptr< RenderJob > best;
+    for( const std::shared_ptr< RenderJob >& job : _jobs )
+    {
+        if( job->_cancelled || job->_nextItem >= job->_count )
+            continue;
+
+        if( best == nullptr || job->_virtualTime < best->_virtualTime )
+            best = job;
+    }
+    return best;
+}
+
+size_t RenderThreadPool::batchSize(const RenderJob& job) const
+{
+    // Several batches per worker, so the tail of a job still spreads out, and
+    // priority changes and cancels still take effect within a batch or so
+    const size_t remaining = job._count - job._nextItem;
+    const size_t perWorker = remaining / ( _workers.size() * 4 );
+    return std::max< size_t >( 1, std::min( perWorker, kMaxBatchSize ) );
+}
+
+void RenderThreadPool::jobCancelled()
+{
+    // Taking the lock means no worker is between checking the job and waiting
+    {
+        std::lock_guard< std::mutex > lock( _lock );
+    }
+    _workCondition.notify_all();
+}
+
+bool RenderThreadPool::retireIfDone(const std::shared_ptr< RenderJob >& job)
+{
+    if( job->_runningBatches > 0 )
+        return false;
+    if( job->_cancelled == false && job->_nextItem < job->_count )
+        return false;
+
+    auto it = std::find( _jobs.begin(), _jobs.end(), job );
+    if( it == _jobs.end() )
+        return false; // Someone else already retired it
+
+    _jobs.erase( it );
+    job->_pool = nullptr;
+    return true;
+}
+
+void RenderThreadPool::workerMain(int workerIndex)
+{
+#if defined(__linux__)
+    if( _cpus.empty() == false )
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO( &cpuSet );
+        if( _options.pinWorkers )
+        {
+            CPU_SET( _cpus[ workerIndex % _cpus.size() ], &cpuSet );
+        }
+        else
+        {
+            for( int cpu : _cpus )
+                CPU_SET( cpu, &cpuSet );
+        }
+        pthread_setaffinity_np( pthread_self(), sizeof( cpuSet ), &cpuSet );
+    }
+#elif defined(__APPLE__)
+    // No affinity API on macOS; match the QoS our old dispatch queue had
+    pthread_set_qos_class_self_np( QOS_CLASS_DEFAULT, 0 );
+#endif
+
+    std::unique_lock< std::mutex > lock( _lock );
+    while( true )
+    {
+        // Retire anything cancelled while nobody was working on it (or empty jobs)
+        std::vector< std::shared_ptr< RenderJob > > retired;
+        for( size_t i = 0; i < _jobs.size(); )
+        {
+            std::shared_ptr< RenderJob > job = _jobs[ i ];
+            if( retireIfDone( job ) )
+                retired.push_back( job );
+            else
+                i++;
+        }
+
+        std::shared_ptr< RenderJob > job = nextJob();
+        if( job == nullptr && retired.empty() )
+        {
+            if( _shuttingDown )
+                return;
+
+            // Woken by new jobs, cancels, and shutdown
+            _workCondition.wait( lock );
+            continue;
+        }
+
+        if( job != nullptr )
+        {
+            // Claim a batch of items and advance the job's pass by their strides
+            const size_t firstItem = job->_nextItem;
+            const size_t itemCount = batchSize( *job );
+            job->_nextItem += itemCount;
+            job->_runningBatches++;
+            job->_virtualTime += (double)itemCount / job->priority();
+
+            lock.unlock();
+            for( size_t item = firstItem; item < firstItem + itemCount; item++ )
+            {
+                // The rest of the batch counts as skipped
+                if( job->_cancelled )
+                    break;
+                job->_work( item );
+            }
+            lock.lock();
+
+            job->_runningBatches--;
+            if( retireIfDone( job ) )
+                retired.push_back( job );
+        }
+
+        // Completion handlers run without the pool lock; they may submit new jobs
+        if( retired.empty() == false )
+        {
+            lock.unlock();
+            for( const std::shared_ptr< RenderJob >& retiredJob : retired )
+            {
+                if( retiredJob->_completion )
+                    retiredJob->_completion();
+
+                std::lock_guard< std::mutex > completeLock( retiredJob->_completeLock );
+                retiredJob->_complete = true;
+                retiredJob->_completeCondition.notify_all();
+            }
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,129 @@
+//
+//  RenderThreadPool.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef RenderThreadPool_h
+#define RenderThreadPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class RenderThreadPool;
+
+// A batch of work items submitted to the pool. Each item is an index in [0, count),
+// handed to the job's work function exactly once (unless cancelled first).
+class RenderJob
+{
+public:
+
+    // Stops handing out new items; items already running finish normally, and
+    // the completion fires as soon as they have
+    void cancel();
+    bool isCancelled() const;
+
+    // True once every item ran (or was skipped by cancel) and the completion fired
+    bool isComplete() const;
+
+    // Blocks the calling thread until the job is complete
+    void wait();
+
+    // Relative weight: a priority 4 job gets ~4x the items of a priority 1 job
+    // while both are runnable. Can be changed while running.
+    int priority() const;
+    void setPriority(int priority);
+
+private:
+
+    friend class RenderThreadPool;
+
+    std::function<void(size_t)> _work;
+    std::function<void()> _completion;
+
+    size_t _count = 0;
+    size_t _nextItem = 0;       // Guarded by pool lock
+    size_t _runningBatches = 0; // Guarded by pool lock
+    double _virtualTime = 0;    // Stride scheduling pass, guarded by pool lock
+
+    // Pool to wake when cancelled, cleared once the job is retired
+    std::atomic< RenderThreadPool* > _pool{ nullptr };
+
+    std::atomic< int > _priority{ 1 };
+    std::atomic< bool > _cancelled{ false };
+    std::atomic< bool > _complete{ false };
+
+    std::mutex _completeLock;
+    std::condition_variable _completeCondition;
+};
+
+// Shared pool of render workers. Many jobs (i.e. several Raytracers) can be in
+// flight at once; workers pick items across jobs with priority-weighted stride
+// scheduling, so an interactive preview can run next to a batch render without
+// either starving.
+class RenderThreadPool
+{
+public:
+
+    struct Options
+    {
+        // 0 means one worker per logical CPU (or per CPU of the NUMA node)
+        int workerCount = 0;
+
+        // Linux only: pin each worker to a single CPU, round-robin
+        bool pinWorkers = false;
+
+        // Linux only: keep workers on this NUMA node's CPUs, -1 for any
+        int numaNode = -1;
+    };
+
+    RenderThreadPool();
+    RenderThreadPool(const Options& options);
+    ~RenderThreadPool();
+
+    // Process-wide pool with default options, created on first use
+    static RenderThreadPool* shared();
+
+    int workerCount() const;
+
+    // Queue up count items; work is called from worker threads, completion is called
+    // once from whichever worker finishes (or cancels) the last item.
+    std::shared_ptr< RenderJob > submit(size_t count, int priority, std::function<void(size_t)> work, std::function<void()> completion = nullptr);
+
+private:
+
+    friend class RenderJob;
+
+    void workerMain(int workerIndex);
+
+    // Picks the runnable job with the smallest virtual time. Pool lock must be held
+    std::shared_ptr< RenderJob > nextJob();
+
+    // How many of the job's items a worker claims at once. Pool lock must be held
+    size_t batchSize(const RenderJob& job) const;
+
+    // Wakes workers after a job got cancelled, so they retire it
+    void jobCancelled();
+
+    // Finishes off a job once nothing is running and nothing is left. Pool lock must be held
+    bool retireIfDone(const std::shared_ptr< RenderJob >& job);
+
+    std::vector< int > _cpus; // CPUs workers may run on, empty if unrestricted
+    Options _options;
+
+    std::vector< std::thread > _workers;
+
+    std::mutex _lock;
+    std::condition_variable _workCondition;
+    std::vector< std::shared_ptr< RenderJob > > _jobs;
+    bool _shuttingDown = false;
+};
+
+#endif /* RenderThreadPool_h */
@@ -0,0 +1,168 @@
+//
+//  SequenceRenderer.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "SequenceRenderer.h"
+
+#include <chrono>
+
+SequenceRenderer::SequenceRenderer(const Scene& scene, const CameraPath& cameraPath, const std::vector< ObjectTrack >& tracks,
+                                   const Options& options, RenderThreadPool* pool, ImageExporter* exporter)
+{
+    _scene = scene;
+    _cameraPath = cameraPath;
+    _tracks = tracks;
+    _options = options;
+
+    _pool = ( pool != nullptr ) ? pool : RenderThreadPool::shared();
+    _ownsExporter = ( exporter == nullptr );
+    _exporter = _ownsExporter ? new ImageExporter() : exporter;
+}
+
+SequenceRenderer::~SequenceRenderer()
+{
+    cancel();
+    if( _thread.joinable() )
+        _thread.join();
+
+    delete _raytracer.load();
+    if( _ownsExporter )
+        delete _exporter;
+}
+
+void SequenceRenderer::renderAsync()
+{
+    // Just once
+    if( _thread.joinable() )
+        return;
+
+    _thread = std::thread( [this]() {
+        renderFrames();
+    });
+}
+
+void SequenceRenderer::cancel()
+{
+    // Set before looking at the raytracer: either we see it, or it sees the flag
+    _cancelled = true;
+
+    Raytracer* raytracer = _raytracer;
+    if( raytracer != nullptr )
+        raytracer->cancel();
+}
+
+void SequenceRenderer::wait()
+{
+    if( _thread.joinable() )
+        _thread.join();
+}
+
+bool SequenceRenderer::isComplete() const
+{
+    return _complete;
+}
+
+int SequenceRenderer::completedFrameCount() const
+{
+    return _completedFrameCount;
+}
+
+Raytracer* SequenceRenderer::raytracer() const
+{
+    return _raytracer;
+}
+
+void SequenceRenderer::prepareScene(float time)
+{
+    for( const ObjectTrack& track : _tracks )
+        track.apply( time );
+
+    // First frame builds; later frames update it in place, and publishing the
+    // scene each frame refits a copy of it rather than building again
+    if( _scene.bvh == nullptr || _scene.bvh->shapeCount() != _scene.shapes.size() )
+    {
+        _scene.bvh = std::make_shared< BVH >( _scene.shapes );
+        return;
+    }
+
+    // Nothing moves without tracks
+    if( _tracks.empty() )
+        return;
+
+    // Refit is linear and keeps the tree; once things have moved far enough that
+    // boxes overlap a lot, a fresh build pays for itself
+    _scene.bvh->refit( _scene.shapes );
+    if( _scene.bvh->cost() > _scene.bvh->buildCost() * _options.rebuildThreshold )
+    {
+        printf( "Rebuilding BVH (cost %.2f, was %.2f when built)\n", _scene.bvh->cost(), _scene.bvh->buildCost() );
+        _scene.bvh->build( _scene.shapes );
+    }
+}
+
+void SequenceRenderer::renderFrames()
+{
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point startTime = Clock::now();
+    const ImageExporter::Format format = ImageExporter::formatForPath( _options.pathFormat );
+
+    for( int frame = 0; frame < _options.frameCount && _cancelled == false; frame++ )
+    {
+        const Clock::time_point frameStartTime = Clock::now();
+        const float time = _options.startTime + frame / _options.frameRate;
+
+        prepareScene( time );
+
+        Camera camera = _cameraPath.cameraAt( time, _options.resolution );
+        camera.setSampleCount( _options.sampleCount );
+        camera.setMaxBounceCount( _options.maxBounceCount );
+
+        // One raytracer for the whole sequence, re-aimed each frame
+        Raytracer* raytracer = _raytracer;
+        if( raytracer == nullptr )
+        {
+            raytracer = new Raytracer( camera, _scene, _pool );
+            _raytracer = raytracer;
+            if( _cancelled )
+                break;
+            raytracer->renderAsync();
+        }
+        else
+        {
+            // The raytracer renders its own copy; moves reach it once published
+            if( _tracks.empty() == false )
+                raytracer->publishScene( _scene );
+            if( raytracer->renderFrameAsync( camera ) == false )
+                break;
+        }
+
+        // A frame clears cancels from before it started, so pass ours on again
+        if( _cancelled )
+            raytracer->cancel();
+
+        raytracer->waitUntilComplete();
+        if( _cancelled )
+            break;
+
+        // Copy out now, since the next frame reuses the framebuffer; the exporter
+        // encodes and writes while we trace on. Blocks only if it falls behind
+        char path[ 1024 ];
+        snprintf( path, sizeof( path ), _options.pathFormat.c_str(), frame );
+        _exporter->exportImage( raytracer->copyLinearImage(), path, format );
+        _completedFrameCount++;
+
+        const double frameSeconds = std::chrono::duration< double >( Clock::now() - frameStartTime ).count();
+        printf( "Frame %d of %d traced in %.2fs\n", frame + 1, _options.frameCount, frameSeconds );
+    }
+
+    _exporter->waitUntilIdle();
+
+    const double totalSeconds = std::chrono::duration< double >( Clock::now() - startTime ).count();
+    if( _completedFrameCount > 0 && totalSeconds > 0 )
+        printf( "Sequence: %d frames in %.1fs (%.0f frames/hour)\n", _completedFrameCount.load(), totalSeconds, _completedFrameCount * 3600.0 / totalSeconds );
+
+    _complete = true;
+}
@@ -0,0 +1,89 @@
+//
+//  SequenceRenderer.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef SequenceRenderer_h
+#define SequenceRenderer_h
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Animation.h"
+#include "Raytracer.h"
+
+// Renders an animation: a keyframed camera and object tracks over a scene, one
+// image per frame. Everything that can be kept between frames is: one Raytracer
+// (framebuffer, work list) re-aimed per frame, and a BVH that gets refit rather
+// than rebuilt. Frame N is copied out and handed to the exporter, which encodes
+// and writes it while frame N+1 traces.
+class SequenceRenderer
+{
+public:
+
+    struct Options
+    {
+        int2 resolution = simd_make_int2( 640, 360 );
+        int sampleCount = 16;
+        int maxBounceCount = 8;
+
+        int frameCount = 24;
+        float startTime = 0; // Seconds
+        float frameRate = 24;
+
+        // printf style, gets the frame number; the extension picks the format
+        std::string pathFormat = "/tmp/frame_%04d.png";
+
+        // Rebuild the BVH once refitting has made it this much more costly than when built
+        float rebuildThreshold = 1.5f;
+    };
+
+    // Shapes are moved by the tracks, so the scene can't be rendered elsewhere at the
+    // same time. The pool and exporter default to shared / owned ones
+    SequenceRenderer(const Scene& scene, const CameraPath& cameraPath, const std::vector< ObjectTrack >& tracks,
+                     const Options& options, RenderThreadPool* pool = nullptr, ImageExporter* exporter = nullptr);
+
+    // Cancels and waits
+    ~SequenceRenderer();
+
+    // Renders every frame on a background thread
+    void renderAsync();
+    void cancel();
+
+    // Blocks until all frames are written (or it got cancelled)
+    void wait();
+    bool isComplete() const;
+
+    // Frames traced so far, and the one being traced, whose preview can be shown
+    int completedFrameCount() const;
+    Raytracer* raytracer() const;
+
+private:
+
+    Scene _scene;
+    CameraPath _cameraPath;
+    std::vector< ObjectTrack > _tracks;
+    Options _options;
+
+    RenderThreadPool* _pool;
+    ImageExporter* _exporter;
+    bool _ownsExporter;
+
+    std::thread _thread;
+    std::atomic< Raytracer* > _raytracer{ nullptr };
+    std::atomic< int > _completedFrameCount{ 0 };
+    std::atomic< bool > _cancelled{ false };
+    std::atomic< bool > _complete{ false };
+
+    void renderFrames();
+
+    // Moves everything to the given time and gets the BVH up to date
+    void prepareScene(float time);
+};
+
+#endif /* SequenceRenderer_h */
@@ -0,0 +1,301 @@
+//
+//  SharedFramebuffer.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "SharedFramebuffer.h"
+#include "Framebuffer.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Keeps each part of the segment on its own cache lines
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+SharedFramebuffer* SharedFramebuffer::create(const std::string& name, int2 resolution, int samplesPerPixel, int tileSize,
+                                             size_t maxPixelBytes)
+{
+    const int tileCountX = ( resolution.x + tileSize - 1 ) / tileSize;
+    const int tileCountY = ( resolution.y + tileSize - 1 ) / tileSize;
+    const size_t tileCount = (size_t)tileCountX * tileCountY;
+    const size_t slotBytes = (size_t)tileSize * tileSize * 3 * sizeof( float );
+    const size_t slotCount = std::max< size_t >( 1, std::min( tileCount, maxPixelBytes / slotBytes ) );
+    if( tileCount >= kSharedFramebufferSlotTileMask )
+    {
+        printf( "Too many tiles for shared framebuffer %s\n", name.c_str() );
+        return nullptr;
+    }
+
+    const size_t tileOffset = alignUp( sizeof( SharedFramebufferHeader ), 64 );
+    const size_t slotOffset = alignUp( tileOffset + tileCount * sizeof( SharedFramebufferTile ), 64 );
+    const size_t pixelOffset = alignUp( slotOffset + slotCount * sizeof( SharedFramebufferSlot ), 64 );
+    const size_t totalBytes = pixelOffset + slotCount * slotBytes;
+
+    // A crashed render can leave one behind; we own this name now
+    shm_unlink( name.c_str() );
+    int fd = shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 );
+    if( fd < 0 )
+    {
+        printf( "Failed to create shared framebuffer %s\n", name.c_str() );
+        return nullptr;
+    }
+
+    if( ftruncate( fd, totalBytes ) != 0 )
+    {
+        close( fd );
+        shm_unlink( name.c_str() );
+        return nullptr;
+    }
+
+    void* base = mmap( nullptr, totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( base == MAP_FAILED )
+    {
+        shm_unlink( name.c_str() );
+        return nullptr;
+    }
+
+    SharedFramebuffer* framebuffer = new SharedFramebuffer();
+    framebuffer->_name = name;
+    framebuffer->_base = (uint8_t*)base;
+    framebuffer->_size = totalBytes;
+    framebuffer->_slotReferenced = std::vector< std::atomic< uint8_t > >( slotCount );
+
+    // Fresh segments are zero filled: just the header needs filling in. The magic
+    // goes last so clients never see a half written header as valid
+    SharedFramebufferHeader* header = new( base ) SharedFramebufferHeader;
+    header->version = kSharedFramebufferVersion;
+    header->width = resolution.x;
+    header->height = resolution.y;
+    header->tileSize = tileSize;
+    header->tileCountX = tileCountX;
+    header->tileCountY = tileCountY;
+    header->slotCount = (int32_t)slotCount;
+    header->samplesPerPixel = samplesPerPixel;
+    header->tileOffset = tileOffset;
+    header->slotOffset = slotOffset;
+    header->pixelOffset = pixelOffset;
+    header->totalBytes = totalBytes;
+    header->generation = 0;
+    header->state = SharedFramebufferRendering;
+
+    framebuffer->_header = header;
+    framebuffer->_tiles = new( framebuffer->_base + tileOffset ) SharedFramebufferTile[ tileCount ];
+    framebuffer->_slots = new( framebuffer->_base + slotOffset ) SharedFramebufferSlot[ slotCount ];
+    framebuffer->_pixels = (float*)( framebuffer->_base + pixelOffset );
+    for( size_t i = 0; i < tileCount; i++ )
+    {
+        framebuffer->_tiles[ i ].generation = 0;
+        framebuffer->_tiles[ i ].sampleCount = 0;
+        framebuffer->_tiles[ i ].slot = -1;
+    }
+    for( size_t i = 0; i < slotCount; i++ )
+        framebuffer->_slots[ i ].state = 0;
+
+    std::atomic_thread_fence( std::memory_order_release );
+    header->magic = kSharedFramebufferMagic;
+
+    return framebuffer;
+}
+
+SharedFramebuffer::~SharedFramebuffer()
+{
+    // Clients still mapping it keep their view; tell them nothing more is coming
+    setState( SharedFramebufferClosed );
+    munmap( _base, _size );
+    shm_unlink( _name.c_str() );
+}
+
+const std::string& SharedFramebuffer::name() const
+{
+    return _name;
+}
+
+int2 SharedFramebuffer::resolution() const
+{
+    return simd_make_int2( _header->width, _header->height );
+}
+
+int SharedFramebuffer::tileSize() const
+{
+    return _header->tileSize;
+}
+
+void SharedFramebuffer::clear()
+{
+    // Pixels stay where they are; with no slots and no samples, tiles read as black
+    const int tileCount = _header->tileCountX * _header->tileCountY;
+    for( int i = 0; i < tileCount; i++ )
+    {
+        _tiles[ i ].slot = -1;
+        _tiles[ i ].sampleCount = 0;
+        _tiles[ i ].generation++;
+    }
+    for( int i = 0; i < _header->slotCount; i++ )
+    {
+        // Never from under a copier, should a publish run late; with no tile
+        // pointing at it, the slot gets evicted
+        std::atomic< uint64_t >& state = _slots[ i ].state;
+        uint64_t current = state.load( std::memory_order_relaxed );
+        uint64_t cleared;
+        do
+        {
+            if( ( current & kSharedFramebufferSlotCopierMask ) != 0 )
+                break;
+            cleared = ( current & ~kSharedFramebufferSlotTileMask ) + kSharedFramebufferSlotSequenceOne;
+        } while( state.compare_exchange_weak( current, cleared ) == false );
+        _slotReferenced[ i ] = 0;
+    }
+    _header->state = SharedFramebufferRendering;
+    _header->generation++;
+}
+
+bool SharedFramebuffer::beginCopy(int32_t slot, int tileIndex)
+{
+    std::atomic< uint64_t >& state = _slots[ slot ].state;
+    uint64_t current = state.load( std::memory_order_relaxed );
+    do
+    {
+        if( ( current & kSharedFramebufferSlotTileMask ) != (uint64_t)tileIndex + 1 )
+            return false;
+    } while( state.compare_exchange_weak( current, current + kSharedFramebufferSlotCopierOne, std::memory_order_acquire ) == false );
+
+    // Clients have to see us copying before they see any of the pixels
+    std::atomic_thread_fence( std::memory_order_release );
+    return true;
+}
+
+void SharedFramebuffer::endCopy(int32_t slot)
+{
+    _slots[ slot ].state.fetch_add( kSharedFramebufferSlotSequenceOne - kSharedFramebufferSlotCopierOne, std::memory_order_release );
+    _slotReferenced[ slot ].store( 1, std::memory_order_relaxed );
+}
+
+int32_t SharedFramebuffer::claimSlot(int tileIndex)
+{
+    // Clock: a free slot, or one nobody has published to since the hand last came by
+    while( true )
+    {
+        const int32_t slot = _clockHand.fetch_add( 1, std::memory_order_relaxed ) % _header->slotCount;
+        std::atomic< uint64_t >& state = _slots[ slot ].state;
+        uint64_t current = state.load( std::memory_order_relaxed );
+        if( ( current & kSharedFramebufferSlotCopierMask ) != 0 )
+            continue;
+        if( ( current & kSharedFramebufferSlotTileMask ) != 0 && _slotReferenced[ slot ].exchange( 0, std::memory_order_relaxed ) != 0 )
+            continue;
+
+        const uint64_t claimed = ( current & ~kSharedFramebufferSlotTileMask ) + (uint64_t)tileIndex + 1 + kSharedFramebufferSlotCopierOne;
+        if( state.compare_exchange_strong( current, claimed, std::memory_order_acquire ) == false )
+            continue;
+        std::atomic_thread_fence( std::memory_order_release );
+
+        // The evicted tile's count and generation stand: clients keep their copy.
+        // If its publisher already moved it to another slot, that one stands too
+        const int evicted = (int)( current & kSharedFramebufferSlotTileMask ) - 1;
+        if( evicted >= 0 )
+        {
+            int32_t expected = slot;
+            _tiles[ evicted ].slot.compare_exchange_strong( expected, -1, std::memory_order_release );
+        }
+        return slot;
+    }
+}
+
+void SharedFramebuffer::abandonSlot(int32_t slot)
+{
+    // Someone publishing the same tile may have found it too; the last one out frees it
+    std::atomic< uint64_t >& state = _slots[ slot ].state;
+    uint64_t current = state.load( std::memory_order_relaxed );
+    uint64_t released;
+    do
+    {
+        released = current - kSharedFramebufferSlotCopierOne + kSharedFramebufferSlotSequenceOne;
+        if( ( released & kSharedFramebufferSlotCopierMask ) == 0 )
+            released &= ~kSharedFramebufferSlotTileMask;
+    } while( state.compare_exchange_weak( current, released, std::memory_order_release ) == false );
+}
+
+void SharedFramebuffer::copyIn(const Framebuffer& framebuffer, int32_t slot, int tileIndex, int2 pixelPos, int2 size)
+{
+    const int tileSize = _header->tileSize;
+    const int2 tileOrigin = simd_make_int2( tileIndex % _header->tileCountX, tileIndex / _header->tileCountX ) * tileSize;
+    float* slotPixels = _pixels + (size_t)slot * tileSize * tileSize * 3;
+    for( int y = pixelPos.y; y < pixelPos.y + size.y; y++ )
+    {
+        float* pixel = slotPixels + ( (size_t)( y - tileOrigin.y ) * tileSize + ( pixelPos.x - tileOrigin.x ) ) * 3;
+        for( int x = pixelPos.x; x < pixelPos.x + size.x; x++ )
+        {
+            const float3 color = framebuffer.pixel( x, y );
+            pixel[ 0 ] = color.x;
+            pixel[ 1 ] = color.y;
+            pixel[ 2 ] = color.z;
+            pixel += 3;
+        }
+    }
+}
+
+void SharedFramebuffer::publish(const Framebuffer& framebuffer, int2 pixelPos, int2 size, uint64_t sampleCount)
+{
+    const int tileSize = _header->tileSize;
+    const int tileX = pixelPos.x / tileSize;
+    const int tileY = pixelPos.y / tileSize;
+    const int tileIndex = tileY * _header->tileCountX + tileX;
+    SharedFramebufferTile& tile = _tiles[ tileIndex ];
+
+    while( true )
+    {
+        // Threads publishing other rects of the tile copy in alongside us
+        int32_t slot = tile.slot.load( std::memory_order_acquire );
+        if( slot >= 0 && beginCopy( slot, tileIndex ) )
+        {
+            copyIn( framebuffer, slot, tileIndex, pixelPos, size );
+            endCopy( slot );
+            break;
+        }
+
+        // A tile new to the pool, or evicted, brings all of its pixels
+        const int32_t claimed = claimSlot( tileIndex );
+        if( tile.slot.compare_exchange_strong( slot, claimed, std::memory_order_acq_rel ) )
+        {
+            const int2 tileOrigin = simd_make_int2( tileX, tileY ) * tileSize;
+            const int2 tileExtent = simd_make_int2( std::min( tileSize, _header->width - tileOrigin.x ), std::min( tileSize, _header->height - tileOrigin.y ) );
+            copyIn( framebuffer, claimed, tileIndex, tileOrigin, tileExtent );
+            endCopy( claimed );
+            break;
+        }
+        abandonSlot( claimed );
+    }
+
+    // Release ordering: a client that sees the new generation sees the pixels
+    tile.sampleCount.fetch_add( sampleCount, std::memory_order_relaxed );
+    tile.generation.fetch_add( 1, std::memory_order_release );
+    _header->generation.fetch_add( 1, std::memory_order_release );
+}
+
+void SharedFramebuffer::discardSamples(int x, int y, uint64_t sampleCount)
+{
+    // Never below zero, should the last render have been cut short
+    const int tileSize = _header->tileSize;
+    SharedFramebufferTile& tile = _tiles[ ( y / tileSize ) * _header->tileCountX + ( x / tileSize ) ];
+    uint64_t count = tile.sampleCount.load( std::memory_order_relaxed );
+    uint64_t reduced;
+    do
+    {
+        reduced = count - std::min( count, sampleCount );
+    } while( tile.sampleCount.compare_exchange_weak( count, reduced, std::memory_order_relaxed ) == false );
+}
+
+void SharedFramebuffer::setState(SharedFramebufferState state)
+{
+    _header->state = state;
+    _header->generation++;
+}
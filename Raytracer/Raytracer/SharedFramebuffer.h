@@ -0,0 +1,158 @@
+//
+//  SharedFramebuffer.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef SharedFramebuffer_h
+#define SharedFramebuffer_h
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "VectorTypes.h"
+
+class Framebuffer;
+
+// Layout of the POSIX shared memory segment, for the renderer and for clients that
+// map it read-only. Four parts, each at an offset given in the header:
+//
+//   SharedFramebufferHeader
+//   SharedFramebufferTile[ tileCountX * tileCountY ]
+//   SharedFramebufferSlot[ slotCount ]
+//   float pixels: linear RGB, slot after slot, each tileSize x tileSize (edge
+//                 tiles only partly used)
+//
+// Pixels live in a bounded pool of slots rather than one per tile, so the segment
+// stays small for huge frames. A tile gets a slot when it's first published, and
+// once the pool runs out takes one from a tile that hasn't been published since
+// a clock hand last swept past it. Tiles without a slot are black if their sample
+// count is 0; otherwise they were evicted, and clients keep what they copied before.
+//
+// Renderer threads copy published pixels in from the framebuffer without taking
+// any lock: each slot's state word holds the tile it belongs to, how many threads
+// are copying in, and a sequence bumped as each copy finishes. A thread joins the
+// copiers only while the slot still holds its tile, and a slot changes tiles only
+// with nobody copying in. After a copy, the tile's generation and the header's are
+// bumped. Clients compare generations to find changed tiles, and keep a slot's
+// copy only if its state showed the tile with no copiers and was unchanged around
+// the copy.
+
+static const uint32_t kSharedFramebufferMagic = 0x42465452; // "RTFB"
+static const uint32_t kSharedFramebufferVersion = 3;
+
+// Parts of a slot's state word
+static const uint64_t kSharedFramebufferSlotTileMask = 0x3FFFFF;      // Tile held plus one, 0 if free
+static const uint64_t kSharedFramebufferSlotCopierMask = 0xFFC00000;  // Renderer threads copying in
+static const uint64_t kSharedFramebufferSlotCopierOne = 0x400000;
+static const uint64_t kSharedFramebufferSlotSequenceOne = 1ull << 32; // Finished copies, in the rest
+
+enum SharedFramebufferState : uint32_t
+{
+    SharedFramebufferRendering = 0,
+    SharedFramebufferComplete = 1,
+    SharedFramebufferClosed = 2, // Renderer went away
+};
+
+struct SharedFramebufferHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    int32_t width;
+    int32_t height;
+    int32_t tileSize;
+    int32_t tileCountX;
+    int32_t tileCountY;
+    int32_t slotCount;
+    int32_t samplesPerPixel; // Target; tiles are done at tile pixels * this
+
+    uint64_t tileOffset;
+    uint64_t slotOffset;
+    uint64_t pixelOffset;
+    uint64_t totalBytes;
+
+    std::atomic< uint64_t > generation; // Bumped whenever any tile is published
+    std::atomic< uint32_t > state;      // SharedFramebufferState
+};
+
+struct SharedFramebufferTile
+{
+    std::atomic< uint64_t > generation;
+    std::atomic< uint64_t > sampleCount; // Samples traced into the tile since the last clear
+    std::atomic< int32_t > slot;         // -1 if the tile's pixels aren't in the segment
+};
+
+struct SharedFramebufferSlot
+{
+    std::atomic< uint64_t > state; // Tile, copiers and sequence, as above
+};
+
+static_assert( ATOMIC_LLONG_LOCK_FREE == 2, "shared memory counters must be lock free" );
+
+// Renderer side: creates and owns the segment, unlinking it when destroyed
+class SharedFramebuffer
+{
+public:
+
+    // Name is a POSIX shm name like "/raytracer" (31 characters at most on macOS).
+    // Pixels take at most maxPixelBytes (one slot per tile if the frame fits).
+    // Replaces a stale segment of the same name; nullptr on failure
+    static SharedFramebuffer* create(const std::string& name, int2 resolution, int samplesPerPixel, int tileSize = 64,
+                                     size_t maxPixelBytes = 64 << 20);
+    ~SharedFramebuffer();
+
+    const std::string& name() const;
+    int2 resolution() const;
+    int tileSize() const;
+
+    // Starting over: no pixels, zero counts, back to rendering. Not while publishing
+    void clear();
+
+    // Copies a rect of freshly written pixels (sampleCount samples in all) in from
+    // the framebuffer, which has to have the same tile size, and marks it updated.
+    // The rect can't straddle tiles. Any number of threads can publish at once
+    void publish(const Framebuffer& framebuffer, int2 pixelPos, int2 size, uint64_t sampleCount);
+
+    // Takes samples back out of a pixel's tile count, when it's about to be
+    // rendered over from scratch
+    void discardSamples(int x, int y, uint64_t sampleCount);
+
+    void setState(SharedFramebufferState state);
+
+private:
+
+    SharedFramebuffer() = default;
+
+    std::string _name;
+    uint8_t* _base = nullptr;
+    size_t _size = 0;
+
+    SharedFramebufferHeader* _header = nullptr;
+    SharedFramebufferTile* _tiles = nullptr;
+    SharedFramebufferSlot* _slots = nullptr;
+    float* _pixels = nullptr;
+
+    // Eviction: set as a slot is published to, cleared as the clock hand passes
+    std::vector< std::atomic< uint8_t > > _slotReferenced;
+    std::atomic< uint32_t > _clockHand = { 0 };
+
+    // Joins the slot's copiers if it still holds the tile
+    bool beginCopy(int32_t slot, int tileIndex);
+    void endCopy(int32_t slot);
+
+    // Slot for a tile that has none, evicting if need be; comes back with the copy begun
+    int32_t claimSlot(int tileIndex);
+
+    // A claimed slot another thread beat us to giving the tile
+    void abandonSlot(int32_t slot);
+
+    // Copy a rect of the framebuffer into the slot; the copy has to be begun
+    void copyIn(const Framebuffer& framebuffer, int32_t slot, int tileIndex, int2 pixelPos, int2 size);
+};
+
+#endif /* SharedFramebuffer_h */
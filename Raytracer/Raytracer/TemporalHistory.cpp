@@ -0,0 +1,212 @@
+//
+//  TemporalHistory.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "TemporalHistory.h"
+
+#include <algorithm>
+#include <limits>
+
+TemporalHistory::TemporalHistory(int2 resolution, const Options& options)
+{
+    _resolution = resolution;
+    _options = options;
+    _frame.assign( (size_t)resolution.x * resolution.y, Entry() );
+    _history.assign( (size_t)resolution.x * resolution.y, Entry() );
+}
+
+const TemporalHistory::Options& TemporalHistory::options() const
+{
+    return _options;
+}
+
+void TemporalHistory::beginFrame()
+{
+    for( Entry& entry : _frame )
+        entry.rendered = false;
+}
+
+void TemporalHistory::storeHit(int x, int y, bool hit, const float3& pos, const float3& norm, bool edge, float historyWeight)
+{
+    Entry& entry = _frame[ (size_t)y * _resolution.x + x ];
+    for( int axis = 0; axis < 3; axis++ )
+    {
+        entry.pos[ axis ] = pos[ axis ];
+        entry.norm[ axis ] = hit ? norm[ axis ] : 0;
+    }
+    entry.weight = historyWeight;
+    entry.edge = edge;
+    entry.rendered = true;
+
+    if( historyWeight > 0 )
+        _reusedCount++;
+}
+
+float TemporalHistory::historyWeight(int x, int y) const
+{
+    return _frame[ (size_t)y * _resolution.x + x ].weight;
+}
+
+float3 TemporalHistory::lookup(float2 pixel, bool hit, const float3& pos, const float3& norm, float depth, float* weight) const
+{
+    *weight = 0;
+    float3 color = simd_make_float3( 0, 0, 0 );
+    if( _hasHistory == false )
+        return color;
+
+    // Bilinear taps, each only if it saw the same surface (or also missed)
+    const int x0 = (int)floor( pixel.x );
+    const int y0 = (int)floor( pixel.y );
+    const float fx = pixel.x - x0;
+    const float fy = pixel.y - y0;
+    const float tolerance = _options.depthTolerance * depth;
+    float coverage = 0;
+    for( int tap = 0; tap < 4; tap++ )
+    {
+        const int x = x0 + ( tap & 1 );
+        const int y = y0 + ( tap >> 1 );
+        if( x < 0 || y < 0 || x >= _resolution.x || y >= _resolution.y )
+            continue;
+
+        const Entry& entry = _history[ (size_t)y * _resolution.x + x ];
+        if( entry.edge || entry.weight <= 0 )
+            continue;
+
+        const float3 oldNorm = simd_make_float3( entry.norm[ 0 ], entry.norm[ 1 ], entry.norm[ 2 ] );
+        const bool oldHit = ( simd_length_squared( oldNorm ) > 0 );
+        if( oldHit != hit )
+            continue;
+
+        if( hit )
+        {
+            // Distance off the new hit's plane, so glancing surfaces still match
+            const float3 offset = simd_make_float3( entry.pos[ 0 ], entry.pos[ 1 ], entry.pos[ 2 ] ) - pos;
+            if( fabs( simd_dot( offset, norm ) ) > tolerance || simd_dot( oldNorm, norm ) < _options.normalTolerance )
+                continue;
+        }
+
+        const float bilinear = ( ( tap & 1 ) ? fx : 1 - fx ) * ( ( tap >> 1 ) ? fy : 1 - fy );
+        color += simd_make_float3( entry.color[ 0 ], entry.color[ 1 ], entry.color[ 2 ] ) * bilinear;
+        coverage += bilinear;
+        *weight += entry.weight * bilinear;
+    }
+
+    // Partly rejected: the taps that matched, trusted as much as they cover
+    if( coverage <= 0.001f )
+    {
+        *weight = 0;
+        return simd_make_float3( 0, 0, 0 );
+    }
+    return color / coverage;
+}
+
+void TemporalHistory::splat(Framebuffer& framebuffer, int2 low, int2 high,
+                            const std::function<bool(const float3& pos, float2* pixel, float* depth)>& project) const
+{
+    const int2 size = high - low;
+    if( _hasHistory == false || size.x <= 0 || size.y <= 0 )
+        return;
+
+    // Each old pixel to the new pixel nearest where it lands; the closest wins
+    std::vector< float > depths( (size_t)size.x * size.y, std::numeric_limits< float >::max() );
+    std::vector< float3 > colors( (size_t)size.x * size.y );
+    for( const Entry& entry : _history )
+    {
+        // Never rendered, like outside a crop
+        if( entry.weight <= 0 )
+            continue;
+
+        float2 pixel;
+        float depth;
+        if( project( simd_make_float3( entry.pos[ 0 ], entry.pos[ 1 ], entry.pos[ 2 ] ), &pixel, &depth ) == false )
+            continue;
+
+        const int x = (int)floor( pixel.x + 0.5f ) - low.x;
+        const int y = (int)floor( pixel.y + 0.5f ) - low.y;
+        if( x < 0 || y < 0 || x >= size.x || y >= size.y )
+            continue;
+
+        const size_t index = (size_t)y * size.x + x;
+        if( depth < depths[ index ] )
+        {
+            depths[ index ] = depth;
+            colors[ index ] = simd_make_float3( entry.color[ 0 ], entry.color[ 1 ], entry.color[ 2 ] );
+        }
+    }
+
+    // Pixels nothing landed on take their closest covered neighbor, which closes
+    // the cracks a zoom or turn leaves; bigger holes (disocclusions) stay black
+    const float empty = std::numeric_limits< float >::max();
+    for( int y = 0; y < size.y; y++ )
+    {
+        for( int x = 0; x < size.x; x++ )
+        {
+            size_t best = (size_t)y * size.x + x;
+            if( depths[ best ] == empty )
+            {
+                for( int neighbor = 0; neighbor < 9; neighbor++ )
+                {
+                    const int nx = x + neighbor % 3 - 1;
+                    const int ny = y + neighbor / 3 - 1;
+                    if( nx < 0 || ny < 0 || nx >= size.x || ny >= size.y )
+                        continue;
+
+                    const size_t index = (size_t)ny * size.x + nx;
+                    if( depths[ index ] < depths[ best ] )
+                        best = index;
+                }
+            }
+
+            if( depths[ best ] < empty )
+                framebuffer.setPixel( low.x + x, low.y + y, colors[ best ] );
+        }
+    }
+}
+
+void TemporalHistory::endFrame(const Framebuffer& framebuffer, int sampleCount)
+{
+    // Copied, not swapped: a re-render after this only stores the pixels it redoes
+    for( int y = 0; y < _resolution.y; y++ )
+    {
+        for( int x = 0; x < _resolution.x; x++ )
+        {
+            const size_t index = (size_t)y * _resolution.x + x;
+            Entry& entry = _history[ index ];
+            entry = _frame[ index ];
+            if( entry.rendered == false )
+            {
+                // The framebuffer's black there isn't what the view looks like
+                entry.weight = 0;
+                continue;
+            }
+
+            const float3 color = framebuffer.pixel( x, y );
+            for( int channel = 0; channel < 3; channel++ )
+                entry.color[ channel ] = color[ channel ];
+            entry.weight = std::min( entry.weight + sampleCount, _options.maxHistorySamples );
+        }
+    }
+
+    _hasHistory = true;
+    _reusedCount = 0;
+}
+
+void TemporalHistory::discard()
+{
+    _hasHistory = false;
+    _reusedCount = 0;
+}
+
+bool TemporalHistory::hasHistory() const
+{
+    return _hasHistory;
+}
+
+int TemporalHistory::reusedCount() const
+{
+    return _reusedCount;
+}
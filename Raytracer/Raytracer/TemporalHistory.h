@@ -0,0 +1,102 @@
+//
+//  TemporalHistory.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef TemporalHistory_h
+#define TemporalHistory_h
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "VectorTypes.h"
+#include "Framebuffer.h"
+
+// Last frame's colors and first hits, so a frame from a slightly moved camera
+// can start from them instead of from nothing. Each new first hit is projected
+// into the old view, and the (up to 4) old pixels around it count as history if
+// they saw the same surface: close to its plane, facing the same way. What's
+// accepted stands in for samples already taken, and fresh samples refine it.
+class TemporalHistory
+{
+public:
+
+    struct Options
+    {
+        // Most samples history counts as; lower catches up sooner with shading
+        // that changes with the view (reflections), at the cost of more noise
+        float maxHistorySamples = 32;
+
+        // Furthest an old hit can be off the new hit's surface, relative to the
+        // new hit's distance from the camera
+        float depthTolerance = 0.02f;
+
+        // Least cosine between the old and new hits' normals
+        float normalTolerance = 0.9f;
+    };
+
+    TemporalHistory(int2 resolution, const Options& options);
+
+    const Options& options() const;
+
+    // A new view: no pixel of the current frame is rendered yet. Re-renders of the
+    // same view don't call this, so the pixels they skip stay part of the frame
+    void beginFrame();
+
+    // Current frame: a pixel's first hit (hit is false for a miss, pos then being
+    // far along the ray), whether its samples saw other surfaces too, and the
+    // history weight it started from
+    void storeHit(int x, int y, bool hit, const float3& pos, const float3& norm, bool edge, float historyWeight);
+    float historyWeight(int x, int y) const;
+
+    // History for a new first hit, at a spot of the last frame in pixels (of the
+    // un-jittered sample positions); weight 0 if nothing matches
+    float3 lookup(float2 pixel, bool hit, const float3& pos, const float3& norm, float depth, float* weight) const;
+
+    // Something to show before the first pass lands: every history pixel moved to
+    // where the new view sees it, nearest first, single-pixel cracks filled from
+    // their neighbors. Project gives a world position's pixel (of the un-jittered
+    // sample positions) and depth in the new view, false if it's off screen. Only
+    // [low, high) is written; the rest of the framebuffer is left alone
+    void splat(Framebuffer& framebuffer, int2 low, int2 high,
+               const std::function<bool(const float3& pos, float2* pixel, float* depth)>& project) const;
+
+    // A frame completed with this many fresh samples per pixel: the colors and
+    // hits of the pixels it rendered become the history, and the rest (outside a
+    // crop) have none
+    void endFrame(const Framebuffer& framebuffer, int sampleCount);
+
+    // Forget the history, if the view of the scene changed some other way
+    void discard();
+    bool hasHistory() const;
+
+    // Pixels of the current frame that picked up history
+    int reusedCount() const;
+
+private:
+
+    // Packed per-pixel entry; float3 would pad each vector to 16 bytes. Misses
+    // have a zero normal, and history the frame didn't render has no weight
+    struct Entry
+    {
+        float pos[ 3 ];
+        float norm[ 3 ];
+        float color[ 3 ];
+        float weight;
+        bool edge;
+        bool rendered;
+    };
+
+    int2 _resolution;
+    Options _options;
+    std::vector< Entry > _frame;
+    std::vector< Entry > _history;
+    bool _hasHistory = false;
+    std::atomic< int > _reusedCount{ 0 };
+};
+
+#endif /* TemporalHistory_h */
@@ -0,0 +1,286 @@
+//
+//  Texture.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "Texture.h"
+#include "ImageLoader.h"
+#include "PixelFormat.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdio.h>
+
+static int wrapTexel(int x, int size, Texture::Wrap wrap)
+{
+    if( wrap == Texture::WrapRepeat )
+        return ( ( x % size ) + size ) % size;
+    return std::min( std::max( x, 0 ), size - 1 );
+}
+
+static float wrapCoordinate(float u, Texture::Wrap wrap)
+{
+    if( wrap == Texture::WrapRepeat )
+        return u - floor( u );
+    return std::min( std::max( u, 0.0f ), 1.0f );
+}
+
+#pragma mark Conversion
+
+bool Texture::convert(const std::string& imagePath, const std::string& texturePath)
+{
+    return convert( imagePath, texturePath, ConvertOptions() );
+}
+
+bool Texture::convert(const std::string& imagePath, const std::string& texturePath, const ConvertOptions& options)
+{
+    int2 resolution = simd_make_int2( 0, 0 );
+    std::vector< float > pixels;
+    if( loadImage( imagePath, &resolution, &pixels, options.srgb ) == false )
+    {
+        printf( "Failed to read texture image %s\n", imagePath.c_str() );
+        return false;
+    }
+
+    const int tileSize = std::max( options.tileSize, 1 );
+    const int apronSize = tileSize + 1;
+    const size_t tileBytes = (size_t)apronSize * apronSize * 3 * sizeof( uint16_t );
+
+    // Box filtered mip chain, rounding odd sizes up so no texel is dropped
+    std::vector< std::vector< float > > chain;
+    std::vector< TextureFileLevel > levels;
+    chain.push_back( std::move( pixels ) );
+    int width = resolution.x;
+    int height = resolution.y;
+    uint64_t offset = sizeof( TextureFileHeader );
+    while( true )
+    {
+        TextureFileLevel level;
+        level.width = width;
+        level.height = height;
+        level.tileCountX = ( width + tileSize - 1 ) / tileSize;
+        level.tileCountY = ( height + tileSize - 1 ) / tileSize;
+        levels.push_back( level );
+
+        if( width == 1 && height == 1 )
+            break;
+
+        const int nextWidth = std::max( ( width + 1 ) / 2, 1 );
+        const int nextHeight = std::max( ( height + 1 ) / 2, 1 );
+        const std::vector< float >& source = chain.back();
+        std::vector< float > next( (size_t)nextWidth * nextHeight * 3 );
+        for( int y = 0; y < nextHeight; y++ )
+        {
+            for( int x = 0; x < nextWidth; x++ )
+            {
+                for( int channel = 0; channel < 3; channel++ )
+                {
+                    float sum = 0;
+                    for( int corner = 0; corner < 4; corner++ )
+                    {
+                        const int sourceX = std::min( x * 2 + ( corner & 1 ), width - 1 );
+                        const int sourceY = std::min( y * 2 + ( corner >> 1 ), height - 1 );
+                        sum += source[ ( (size_t)sourceY * width + sourceX ) * 3 + channel ];
+                    }
+                    next[ ( (size_t)y * nextWidth + x ) * 3 + channel ] = sum * 0.25f;
+                }
+            }
+        }
+        chain.push_back( std::move( next ) );
+        width = nextWidth;
+        height = nextHeight;
+    }
+
+    offset += levels.size() * sizeof( TextureFileLevel );
+    for( TextureFileLevel& level : levels )
+    {
+        level.offset = offset;
+        offset += (uint64_t)level.tileCountX * level.tileCountY * tileBytes;
+    }
+
+    TextureFileHeader header;
+    header.magic = kTextureFileMagic;
+    header.version = kTextureFileVersion;
+    header.width = resolution.x;
+    header.height = resolution.y;
+    header.tileSize = tileSize;
+    header.levelCount = (int)levels.size();
+    header.wrapU = options.wrapU;
+    header.wrapV = options.wrapV;
+
+    FILE* file = fopen( texturePath.c_str(), "wb" );
+    if( file == nullptr )
+    {
+        printf( "Failed to create texture %s\n", texturePath.c_str() );
+        return false;
+    }
+
+    bool success = ( fwrite( &header, sizeof( header ), 1, file ) == 1 );
+    success &= ( fwrite( levels.data(), sizeof( TextureFileLevel ), levels.size(), file ) == levels.size() );
+
+    // Tiles carry the texels to their right and below (wrapped or clamped), so
+    // sampling never straddles two tiles
+    std::vector< uint16_t > tile( (size_t)apronSize * apronSize * 3 );
+    for( size_t levelIndex = 0; levelIndex < levels.size() && success; levelIndex++ )
+    {
+        const TextureFileLevel& level = levels[ levelIndex ];
+        const std::vector< float >& texels = chain[ levelIndex ];
+        for( int tileY = 0; tileY < level.tileCountY; tileY++ )
+        {
+            for( int tileX = 0; tileX < level.tileCountX; tileX++ )
+            {
+                for( int row = 0; row < apronSize; row++ )
+                {
+                    const int y = wrapTexel( tileY * tileSize + row, level.height, options.wrapV );
+                    for( int column = 0; column < apronSize; column++ )
+                    {
+                        const int x = wrapTexel( tileX * tileSize + column, level.width, options.wrapU );
+                        const float* texel = &texels[ ( (size_t)y * level.width + x ) * 3 ];
+                        uint16_t* destination = &tile[ ( (size_t)row * apronSize + column ) * 3 ];
+                        for( int channel = 0; channel < 3; channel++ )
+                            destination[ channel ] = float_to_half( texel[ channel ] );
+                    }
+                }
+                success &= ( fwrite( tile.data(), 1, tileBytes, file ) == tileBytes );
+            }
+        }
+    }
+
+    success &= ( fclose( file ) == 0 );
+    if( success == false )
+        printf( "Failed to write texture %s\n", texturePath.c_str() );
+    return success;
+}
+
+#pragma mark Texture Class
+
+std::shared_ptr< Texture > Texture::open(const std::string& path, TextureCache* cache)
+{
+    const int file = ::open( path.c_str(), O_RDONLY );
+    if( file < 0 )
+    {
+        printf( "Failed to open texture %s\n", path.c_str() );
+        return nullptr;
+    }
+
+    std::shared_ptr< Texture > texture( new Texture() );
+    texture->_file = file;
+
+    TextureFileHeader& header = texture->_header;
+    if( pread( file, &header, sizeof( header ), 0 ) != sizeof( header ) || header.magic != kTextureFileMagic ||
+        header.version != kTextureFileVersion || header.levelCount <= 0 || header.levelCount > 32 || header.tileSize <= 0 )
+    {
+        printf( "Not a texture: %s\n", path.c_str() );
+        return nullptr;
+    }
+
+    const size_t levelBytes = header.levelCount * sizeof( TextureFileLevel );
+    texture->_levels.resize( header.levelCount );
+    if( pread( file, texture->_levels.data(), levelBytes, sizeof( header ) ) != (ssize_t)levelBytes )
+    {
+        printf( "Truncated texture: %s\n", path.c_str() );
+        return nullptr;
+    }
+
+    const size_t apronSize = header.tileSize + 1;
+    texture->_tileBytes = apronSize * apronSize * 3 * sizeof( uint16_t );
+    texture->_cache = ( cache != nullptr ) ? cache : TextureCache::shared();
+    texture->_id = texture->_cache->registerTexture();
+    return texture;
+}
+
+Texture::~Texture()
+{
+    if( _cache != nullptr )
+        _cache->evictTexture( _id );
+    if( _file >= 0 )
+        close( _file );
+}
+
+int2 Texture::resolution() const
+{
+    return simd_make_int2( _header.width, _header.height );
+}
+
+int Texture::levelCount() const
+{
+    return _header.levelCount;
+}
+
+std::shared_ptr< TextureTile > Texture::loadTile(int level, int tileX, int tileY) const
+{
+    const TextureFileLevel& fileLevel = _levels[ level ];
+    const off_t offset = fileLevel.offset + ( (uint64_t)tileY * fileLevel.tileCountX + tileX ) * _tileBytes;
+
+    std::shared_ptr< TextureTile > tile = std::make_shared< TextureTile >();
+    tile->texels.resize( _tileBytes / sizeof( uint16_t ) );
+    if( pread( _file, tile->texels.data(), _tileBytes, offset ) != (ssize_t)_tileBytes )
+        return nullptr;
+    return tile;
+}
+
+float3 Texture::sample(float2 uv, float2 footprint) const
+{
+    // Level where one texel spans the footprint
+    const float texels = std::max( footprint.x * _header.width, footprint.y * _header.height );
+    const float level = ( texels > 1 ) ? std::min( log2( texels ), (float)( _header.levelCount - 1 ) ) : 0;
+
+    const int lower = (int)level;
+    const float blend = level - lower;
+    const float3 color = bilinear( lower, uv );
+    if( blend < 0.01f || lower + 1 >= _header.levelCount )
+        return color;
+    return color * ( 1 - blend ) + bilinear( lower + 1, uv ) * blend;
+}
+
+float3 Texture::bilinear(int level, float2 uv) const
+{
+    const TextureFileLevel& fileLevel = _levels[ level ];
+    const Wrap wrapU = (Wrap)_header.wrapU;
+    const Wrap wrapV = (Wrap)_header.wrapV;
+
+    // Texel centers are at half coordinates
+    const float s = wrapCoordinate( uv.x, wrapU ) * fileLevel.width - 0.5f;
+    const float t = wrapCoordinate( uv.y, wrapV ) * fileLevel.height - 0.5f;
+    int x = (int)floor( s );
+    int y = (int)floor( t );
+    float fx = s - x;
+    float fy = t - y;
+
+    // Left of the first texel center: blend with the last one, or just take the first
+    if( x < 0 )
+    {
+        x = ( wrapU == WrapRepeat ) ? fileLevel.width - 1 : 0;
+        fx = ( wrapU == WrapRepeat ) ? fx : 0;
+    }
+    if( y < 0 )
+    {
+        y = ( wrapV == WrapRepeat ) ? fileLevel.height - 1 : 0;
+        fy = ( wrapV == WrapRepeat ) ? fy : 0;
+    }
+    x = std::min( x, fileLevel.width - 1 );
+    y = std::min( y, fileLevel.height - 1 );
+
+    const int tileSize = _header.tileSize;
+    std::shared_ptr< const TextureTile > tile = _cache->tile( *this, level, x / tileSize, y / tileSize );
+    if( tile == nullptr )
+        return simd_make_float3( 0, 0, 0 );
+
+    const int apronSize = tileSize + 1;
+    const uint16_t* texel = &tile->texels[ ( (size_t)( y % tileSize ) * apronSize + ( x % tileSize ) ) * 3 ];
+    const size_t down = (size_t)apronSize * 3;
+
+    float3 color;
+    for( int channel = 0; channel < 3; channel++ )
+    {
+        const float top = half_to_float( texel[ channel ] ) * ( 1 - fx ) + half_to_float( texel[ 3 + channel ] ) * fx;
+        const float bottom = half_to_float( texel[ down + channel ] ) * ( 1 - fx ) + half_to_float( texel[ down + 3 + channel ] ) * fx;
+        color[ channel ] = top * ( 1 - fy ) + bottom * fy;
+    }
+    return color;
+}
@@ -0,0 +1,110 @@
+//
+//  Texture.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef Texture_h
+#define Texture_h
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TextureCache.h"
+#include "VectorTypes.h"
+
+// On-disk layout of a converted texture (.rtex): this header, then one
+// TextureFileLevel per mip level, then every level's tiles, row by row.
+// Tiles are all the same size, edge tiles padded, so each one's offset follows
+// from its position.
+static const uint32_t kTextureFileMagic = 0x58455452; // "RTEX"
+static const uint32_t kTextureFileVersion = 1;
+
+struct TextureFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t tileSize;
+    int32_t levelCount;
+    uint32_t wrapU; // Texture::Wrap
+    uint32_t wrapV;
+};
+
+struct TextureFileLevel
+{
+    int32_t width;
+    int32_t height;
+    int32_t tileCountX;
+    int32_t tileCountY;
+    uint64_t offset; // Of the level's first tile
+};
+
+// Image texture, read through a TextureCache a tile at a time. Sampling picks
+// the mip levels whose texels best match the footprint of the ray (its cone
+// where it hit), and blends them trilinearly, so distant or blurry hits only
+// ever page in small levels.
+class Texture
+{
+public:
+
+    enum Wrap
+    {
+        WrapRepeat,
+        WrapClamp,
+    };
+
+    struct ConvertOptions
+    {
+        int tileSize = 64;
+
+        // Color images (albedo, emission) are display referred; data images
+        // (roughness) are read as is
+        bool srgb = true;
+
+        Wrap wrapU = WrapRepeat;
+        Wrap wrapV = WrapRepeat;
+    };
+
+    // Turns any image loadImage() reads into a tiled, mip-mapped .rtex. Done
+    // once, ahead of rendering; needs the whole image in memory
+    static bool convert(const std::string& imagePath, const std::string& texturePath);
+    static bool convert(const std::string& imagePath, const std::string& texturePath, const ConvertOptions& options);
+
+    // Opens a converted texture without reading any texels yet; nullptr on failure
+    static std::shared_ptr< Texture > open(const std::string& path, TextureCache* cache = nullptr);
+
+    ~Texture();
+
+    int2 resolution() const;
+    int levelCount() const;
+
+    // Linear RGB at uv (0..1, v down the image). The footprint is how much of
+    // the texture the ray covers there, in uv units along u and v
+    float3 sample(float2 uv, float2 footprint) const;
+
+private:
+
+    friend class TextureCache;
+
+    Texture() = default;
+
+    int _file = -1;
+    uint32_t _id = 0;
+    TextureCache* _cache = nullptr;
+    TextureFileHeader _header;
+    std::vector< TextureFileLevel > _levels;
+    size_t _tileBytes = 0;
+
+    // Read straight from the file, for the cache
+    std::shared_ptr< TextureTile > loadTile(int level, int tileX, int tileY) const;
+
+    float3 bilinear(int level, float2 uv) const;
+};
+
+#endif /* Texture_h */
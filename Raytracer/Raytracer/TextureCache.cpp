@@ -0,0 +1,137 @@
+//
+//  TextureCache.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#include "TextureCache.h"
+#include "Texture.h"
+
+TextureCache::TextureCache(size_t capacityBytes)
+{
+    _capacity = capacityBytes;
+    _shards.reset( new Shard[ kShardCount ] );
+}
+
+TextureCache* TextureCache::shared()
+{
+    // Leaked on purpose, like the shared thread pool
+    static TextureCache* cache = new TextureCache( 256ull << 20 );
+    return cache;
+}
+
+size_t TextureCache::capacity() const
+{
+    return _capacity;
+}
+
+TextureCache::Stats TextureCache::stats() const
+{
+    Stats stats;
+    for( int shardIndex = 0; shardIndex < kShardCount; shardIndex++ )
+    {
+        Shard& shard = _shards[ shardIndex ];
+        os_unfair_lock_lock( &shard.lock );
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.bytes += shard.bytes;
+        os_unfair_lock_unlock( &shard.lock );
+    }
+    return stats;
+}
+
+uint64_t TextureCache::tileKey(uint32_t textureId, int level, int tileX, int tileY)
+{
+    // 24 bits of texture, 8 of level, 16 each of tile position
+    return ( (uint64_t)( textureId & 0xffffff ) << 40 ) | ( (uint64_t)( level & 0xff ) << 32 ) | ( (uint64_t)( tileY & 0xffff ) << 16 ) | (uint64_t)( tileX & 0xffff );
+}
+
+TextureCache::Shard& TextureCache::shardFor(uint64_t key) const
+{
+    // Neighbouring tiles land in different shards
+    return _shards[ ( ( key * 0x9E3779B97F4A7C15ull ) >> 59 ) % kShardCount ];
+}
+
+std::shared_ptr< const TextureTile > TextureCache::tile(const Texture& texture, int level, int tileX, int tileY)
+{
+    const uint64_t key = tileKey( texture._id, level, tileX, tileY );
+    Shard& shard = shardFor( key );
+
+    os_unfair_lock_lock( &shard.lock );
+    auto found = shard.index.find( key );
+    if( found != shard.index.end() )
+    {
+        shard.entries.splice( shard.entries.begin(), shard.entries, found->second );
+        std::shared_ptr< const TextureTile > tile = found->second->tile;
+        shard.hits++;
+        os_unfair_lock_unlock( &shard.lock );
+        return tile;
+    }
+    shard.misses++;
+    os_unfair_lock_unlock( &shard.lock );
+
+    // Read without holding the shard up; if another thread got there first, use theirs
+    std::shared_ptr< const TextureTile > tile = texture.loadTile( level, tileX, tileY );
+    if( tile == nullptr )
+        return nullptr;
+
+    const size_t bytes = tile->texels.size() * sizeof( uint16_t );
+    const size_t shardCapacity = _capacity / kShardCount;
+
+    os_unfair_lock_lock( &shard.lock );
+    found = shard.index.find( key );
+    if( found != shard.index.end() )
+    {
+        tile = found->second->tile;
+    }
+    else
+    {
+        shard.entries.push_front( Entry{ key, tile, bytes } );
+        shard.index[ key ] = shard.entries.begin();
+        shard.bytes += bytes;
+
+        // Always keep the newest, even if it alone is over
+        while( shard.bytes > shardCapacity && shard.entries.size() > 1 )
+        {
+            const Entry& oldest = shard.entries.back();
+            shard.bytes -= oldest.bytes;
+            shard.index.erase( oldest.key );
+            shard.entries.pop_back();
+            shard.evictions++;
+        }
+    }
+    os_unfair_lock_unlock( &shard.lock );
+
+    return tile;
+}
+
+uint32_t TextureCache::registerTexture()
+{
+    return _nextTextureId++;
+}
+
+void TextureCache::evictTexture(uint32_t textureId)
+{
+    for( int shardIndex = 0; shardIndex < kShardCount; shardIndex++ )
+    {
+        Shard& shard = _shards[ shardIndex ];
+        os_unfair_lock_lock( &shard.lock );
+        for( auto entry = shard.entries.begin(); entry != shard.entries.end(); )
+        {
+            if( ( entry->key >> 40 ) == ( textureId & 0xffffff ) )
+            {
+                shard.bytes -= entry->bytes;
+                shard.index.erase( entry->key );
+                entry = shard.entries.erase( entry );
+            }
+            else
+            {
+                entry++;
+            }
+        }
+        os_unfair_lock_unlock( &shard.lock );
+    }
+}
@@ -0,0 +1,93 @@
+//
+//  TextureCache.h
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+
+#ifndef TextureCache_h
+#define TextureCache_h
+
+#include <os/lock.h>
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class Texture;
+
+// One tile of one mip level: RGB half floats, row-major, with a one texel apron
+// on the right and bottom so bilinear lookups never need a second tile
+struct TextureTile
+{
+    std::vector< uint16_t > texels;
+};
+
+// Fixed-size cache of texture tiles, shared by every texture and render thread.
+// Tiles get paged in from the texture files as they're sampled and the least
+// recently used ones get dropped once over capacity, so scenes can reference
+// far more texture than fits in memory. Split into shards with their own locks
+// so threads rarely wait on each other.
+class TextureCache
+{
+public:
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t bytes = 0; // Resident right now
+    };
+
+    explicit TextureCache(size_t capacityBytes);
+
+    // 256MB, for textures opened without a cache of their own
+    static TextureCache* shared();
+
+    size_t capacity() const;
+    Stats stats() const;
+
+    // The tile, read from the texture's file on a miss (outside any lock). Stays
+    // valid for as long as it's held, even if the cache drops it meanwhile
+    std::shared_ptr< const TextureTile > tile(const Texture& texture, int level, int tileX, int tileY);
+
+    // Keys for a new texture's tiles, and dropping them all once it's closed
+    uint32_t registerTexture();
+    void evictTexture(uint32_t textureId);
+
+private:
+
+    static const int kShardCount = 32;
+
+    struct Entry
+    {
+        uint64_t key;
+        std::shared_ptr< const TextureTile > tile;
+        size_t bytes;
+    };
+
+    // Most recently used at the front
+    struct Shard
+    {
+        os_unfair_lock lock = OS_UNFAIR_LOCK_INIT;
+        std::list< Entry > entries;
+        std::unordered_map< uint64_t, std::list< Entry >::iterator > index;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    size_t _capacity;
+    std::atomic< uint32_t > _nextTextureId{ 1 };
+    std::unique_ptr< Shard[] > _shards;
+
+    static uint64_t tileKey(uint32_t textureId, int level, int tileX, int tileY);
+    Shard& shardFor(uint64_t key) const;
+};
+
+#endif /* TextureCache_h */
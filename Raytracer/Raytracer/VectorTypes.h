@@ -29,6 +29,11 @@ inline uint8_t clamp( float value, uint8_t min, uint8_t max )
         return value;
 }
 
+inline float luminance(float3 color)
+{
+    return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+}
+
 inline float random_float()
 {
     return (float)rand() / RAND_MAX;
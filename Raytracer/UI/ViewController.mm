@@ -13,6 +13,8 @@
 @interface ViewController ()
 {
     Raytracer* _raytracer;
+    ImageExporter* _exporter;
+    SharedFramebuffer* _sharedFramebuffer;
     NSTimer* _syncTimer;
 }
 @end
@@ -75,6 +77,10 @@
     sphere->setMaterial( new DiffuseLightMaterial( simd_make_float3( 4, 4, 4 ) ) );
     scene.shapes.push_back(sphere);
     
+    // Light with an HDR environment map (Radiance .hdr or .pfm) if there's one lying around
+    if( [[NSFileManager defaultManager] fileExistsAtPath: @"/tmp/environment.hdr"] )
+        scene.environment = EnvironmentMap::load( "/tmp/environment.hdr" );
+    
     // Create a bunch of random spheres..
     for( int y = -11; y < 11; y++ )
     {
@@ -115,6 +121,13 @@
     // Do any additional setup after loading the view.
     _raytracer = new Raytracer( camera, scene );
     
+    // Images get written on the exporter's own threads, never on main
+    _exporter = new ImageExporter();
+    
+    // Publish to /raytracer too, so Tools/SharedFramebufferDump (or anything else) can watch
+    _sharedFramebuffer = SharedFramebuffer::create( "/raytracer", camera.resolution(), camera.sampleCount() );
+    _raytracer->setSharedFramebuffer( _sharedFramebuffer );
+    
     // Start rendering right away
     _raytracer->renderAsync();
     
@@ -124,8 +137,9 @@
         // Retain self...
         Raytracer* raytracer = self->_raytracer;
         
-        // Get latest image..
-        CGImageRef progressImage = raytracer->copyRenderImage();
+        // Get latest image, capped to something a window can show; poster sized
+        // frames would otherwise need a second full-size copy every tick
+        CGImageRef progressImage = raytracer->copyRenderImage( 4096 );
         [self->_raytracerView updateImage: progressImage];
         CGImageRelease(progressImage);
         
@@ -139,23 +153,10 @@
             [self->_syncTimer invalidate];
             self->_syncTimer = nil;
             
-            // Save image out to /tmp/raytracing.png
-            CGImageRef image = raytracer->copyRenderImage();
-            
-            CFURLRef url = (__bridge CFURLRef)[NSURL fileURLWithPath: @"/tmp/raytracing.png"];
-            CGImageDestinationRef destination = CGImageDestinationCreateWithURL( url, kUTTypePNG, 1, NULL );
-            CGImageDestinationAddImage( destination, image, NULL );
-            
-            if( CGImageDestinationFinalize( destination ) == false )
-            {
-                NSLog( @"Failed to write image!" );
-                CFRelease( destination );
-                CGImageRelease( image );
-                return;
-            }
-            
-            CFRelease( destination );
-            CGImageRelease( image );
+            // Save image out to /tmp/raytracing.png, plus a linear HDR copy
+            std::shared_ptr< ExportImage > image = raytracer->copyLinearImage();
+            self->_exporter->exportImage( image, "/tmp/raytracing.png", ImageExporter::FormatPNG );
+            self->_exporter->exportImage( image, "/tmp/raytracing.exr", ImageExporter::FormatEXR );
         }
     }];
 }
@@ -163,6 +164,8 @@
 - (void) dealloc
 {
     delete _raytracer;
+    delete _sharedFramebuffer; // After the raytracer: it writes until stopped
+    delete _exporter; // Finishes pending writes
 }
 
 @end
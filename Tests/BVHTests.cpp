@@ -0,0 +1,150 @@
+//
+//  BVHTests.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+//  Checks BVH traversal against testing every shape: same closest hit (shape
+//  and distance) for random rays through random spheres, including rays that
+//  start inside spheres or in the middle of the scene. Again after the spheres
+//  move and the tree is refit, after a rebuild, and for a copy refit to copies
+//  of the spheres.
+//
+//  Build, from the repository root (macOS; Raytracer.cpp needs CoreGraphics):
+//    c++ -std=gnu++14 -O2 -IRaytracer/Raytracer Tests/BVHTests.cpp Raytracer/Raytracer/[A-Z]*.cpp -framework CoreGraphics -lz -o bvh_tests
+//
+//  Run:
+//    ./bvh_tests
+//
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "Raytracer.h"
+
+static int gFailureCount = 0;
+
+#define CHECK( condition ) \
+    do { if( !( condition ) ) { printf( "  FAILED line %d: %s\n", __LINE__, #condition ); gFailureCount++; } } while( 0 )
+
+static const int kRayCount = 100000;
+
+static float3 randomPoint(std::mt19937& random, float extent)
+{
+    std::uniform_real_distribution< float > distribution( -extent, extent );
+    return simd_make_float3( distribution( random ), distribution( random ), distribution( random ) );
+}
+
+// Mismatched rays between the BVH and every shape, and how many hit at all
+static int compareHits(const std::vector< IHittable* >& shapes, const BVH& bvh, std::mt19937& random, int* hitCount)
+{
+    Scene bruteForce;
+    bruteForce.shapes = shapes;
+
+    int mismatchCount = 0;
+    *hitCount = 0;
+    for( int i = 0; i < kRayCount; i++ )
+    {
+        Ray ray;
+        ray.pos = randomPoint( random, 12.0f );
+        ray.dir = simd_normalize( randomPoint( random, 1.0f ) );
+        const float tmax = ( i % 4 == 0 ) ? 5.0f : std::numeric_limits< float >::max();
+
+        Hit expected, actual;
+        const bool expectedHit = bruteForce.hitTest( ray, 0.001f, tmax, &expected );
+        const bool actualHit = bvh.hitTest( shapes, ray, 0.001f, tmax, &actual );
+        if( expectedHit != actualHit )
+        {
+            mismatchCount++;
+            continue;
+        }
+        if( expectedHit == false )
+            continue;
+
+        // Two spheres can touch; the same distance is as good
+        const float expectedDistance = simd_length( expected.pos - ray.pos );
+        const float actualDistance = simd_length( actual.pos - ray.pos );
+        if( actual.shapeIndex != expected.shapeIndex && fabsf( actualDistance - expectedDistance ) > 1e-4f )
+            mismatchCount++;
+        (*hitCount)++;
+    }
+    return mismatchCount;
+}
+
+static void testEmpty()
+{
+    printf( "Empty and single shape\n" );
+    std::vector< IHittable* > shapes;
+    BVH empty( shapes );
+    Ray ray;
+    ray.pos = simd_make_float3( 0, 0, -5 );
+    ray.dir = simd_make_float3( 0, 0, 1 );
+    Hit hit;
+    CHECK( empty.hitTest( shapes, ray, 0.001f, 100.0f, &hit ) == false );
+
+    shapes.push_back( new Sphere( 1.0f ) );
+    BVH single( shapes );
+    CHECK( single.hitTest( shapes, ray, 0.001f, 100.0f, &hit ) );
+    CHECK( hit.shapeIndex == 0 && fabsf( hit.pos.z + 1.0f ) < 1e-4f );
+    CHECK( single.hitTest( shapes, ray, 0.001f, 3.0f, &hit ) == false );
+    delete shapes[ 0 ];
+}
+
+static void testRandomSpheres(int sphereCount)
+{
+    printf( "%d random spheres\n", sphereCount );
+    std::mt19937 random( sphereCount );
+    std::uniform_real_distribution< float > radius( 0.05f, 1.5f );
+
+    std::vector< IHittable* > shapes;
+    for( int i = 0; i < sphereCount; i++ )
+    {
+        Sphere* sphere = new Sphere( radius( random ) );
+        sphere->setPosition( randomPoint( random, 10.0f ) );
+        shapes.push_back( sphere );
+    }
+
+    BVH bvh( shapes );
+    CHECK( bvh.shapeCount() == shapes.size() );
+    int hitCount = 0;
+    CHECK( compareHits( shapes, bvh, random, &hitCount ) == 0 );
+    CHECK( hitCount > 0 );
+
+    // Move everything a little, some a lot, and refit the same tree
+    for( size_t i = 0; i < shapes.size(); i++ )
+    {
+        Sphere* sphere = (Sphere*)shapes[ i ];
+        sphere->setPosition( sphere->position() + randomPoint( random, ( i % 10 == 0 ) ? 8.0f : 0.5f ) );
+    }
+    bvh.refit( shapes );
+    CHECK( compareHits( shapes, bvh, random, &hitCount ) == 0 );
+
+    bvh.build( shapes );
+    CHECK( compareHits( shapes, bvh, random, &hitCount ) == 0 );
+
+    // Copied and refit to copies of the shapes, like scene snapshots do
+    std::vector< IHittable* > copies;
+    for( IHittable* shape : shapes )
+        copies.push_back( shape->clone() );
+    BVH copy( bvh );
+    copy.refit( copies );
+    CHECK( compareHits( copies, copy, random, &hitCount ) == 0 );
+    for( IHittable* shape : copies )
+        delete shape;
+
+    for( IHittable* shape : shapes )
+        delete shape;
+}
+
+int main()
+{
+    testEmpty();
+    for( int sphereCount : { 2, 7, 64, 1000 } )
+        testRandomSpheres( sphereCount );
+
+    printf( gFailureCount == 0 ? "All passed\n" : "%d checks failed\n", gFailureCount );
+    return ( gFailureCount == 0 ) ? 0 : 1;
+}
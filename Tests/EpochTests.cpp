@@ -0,0 +1,230 @@
+//
+//  EpochTests.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+//  Checks Epoch's ordering: nothing retired is reclaimed while a guard from
+//  before the retire is still held, guards taken after it don't hold it back,
+//  and readers swapping against a writer never see a reclaimed object.
+//
+//  Build, from the repository root:
+//    c++ -std=gnu++14 -O2 -IRaytracer/Raytracer Tests/EpochTests.cpp Raytracer/Raytracer/Epoch.cpp -o epoch_tests
+//
+//  Run:
+//    ./epoch_tests
+//
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "Epoch.h"
+
+static int gFailureCount = 0;
+
+#define CHECK( condition ) \
+    do { if( !( condition ) ) { printf( "  FAILED line %d: %s\n", __LINE__, #condition ); gFailureCount++; } } while( 0 )
+
+// Holds a guard on its own thread until told to let go
+class Reader
+{
+public:
+
+    Reader()
+    {
+        _thread = std::thread( [this]() {
+            Epoch::Guard guard;
+            _entered = true;
+            while( _release == false )
+                std::this_thread::yield();
+        });
+        while( _entered == false )
+            std::this_thread::yield();
+    }
+
+    void release()
+    {
+        _release = true;
+        _thread.join();
+    }
+
+private:
+
+    std::thread _thread;
+    std::atomic< bool > _entered{ false };
+    std::atomic< bool > _release{ false };
+};
+
+static void testNoReaders()
+{
+    printf( "Retire with no readers\n" );
+    bool reclaimed = false;
+    Epoch::retire( [&reclaimed]() { reclaimed = true; } );
+    CHECK( reclaimed );
+    CHECK( Epoch::reclaim() == 0 );
+}
+
+static void testReaderFromBefore()
+{
+    printf( "Reader from before the retire\n" );
+    Reader reader;
+    bool reclaimed = false;
+    Epoch::retire( [&reclaimed]() { reclaimed = true; } );
+    CHECK( reclaimed == false );
+    CHECK( Epoch::reclaim() == 1 );
+    CHECK( reclaimed == false );
+
+    reader.release();
+    CHECK( Epoch::reclaim() == 0 );
+    CHECK( reclaimed );
+}
+
+static void testReaderFromAfter()
+{
+    printf( "Reader from after the retire\n" );
+    Reader before;
+    bool reclaimed = false;
+    Epoch::retire( [&reclaimed]() { reclaimed = true; } );
+
+    // Can't have loaded the retired object, so it mustn't hold it back
+    Reader after;
+    before.release();
+    CHECK( Epoch::reclaim() == 0 );
+    CHECK( reclaimed );
+    after.release();
+}
+
+static void testOrder()
+{
+    printf( "Retires either side of a reader\n" );
+    Reader first;
+    bool firstReclaimed = false;
+    Epoch::retire( [&firstReclaimed]() { firstReclaimed = true; } );
+
+    Reader second;
+    bool secondReclaimed = false;
+    Epoch::retire( [&secondReclaimed]() { secondReclaimed = true; } );
+
+    // The first reader holds back both; the second only what came after it
+    first.release();
+    Epoch::reclaim();
+    CHECK( firstReclaimed );
+    CHECK( secondReclaimed == false );
+
+    second.release();
+    Epoch::reclaim();
+    CHECK( secondReclaimed );
+}
+
+static void testNesting()
+{
+    printf( "Nested guards\n" );
+    bool reclaimed = false;
+    std::atomic< int > step{ 0 };
+    std::thread thread( [&step]() {
+        Epoch::Guard outer;
+        {
+            Epoch::Guard inner;
+            step = 1;
+            while( step == 1 )
+                std::this_thread::yield();
+        }
+
+        // Still inside the outer guard
+        step = 3;
+        while( step == 3 )
+            std::this_thread::yield();
+    });
+
+    while( step != 1 )
+        std::this_thread::yield();
+    Epoch::retire( [&reclaimed]() { reclaimed = true; } );
+    step = 2;
+    while( step != 3 )
+        std::this_thread::yield();
+    CHECK( Epoch::reclaim() == 1 );
+    CHECK( reclaimed == false );
+
+    step = 4;
+    thread.join();
+    CHECK( Epoch::reclaim() == 0 );
+    CHECK( reclaimed );
+}
+
+// Readers load the current object and check it stays alive for the whole guard,
+// while a writer keeps swapping it out. Reclaimed objects are only marked dead,
+// not freed, so the readers can look
+static void testSwapping()
+{
+    printf( "Readers against a swapping writer\n" );
+    struct Object
+    {
+        std::atomic< bool > alive{ true };
+    };
+
+    static const int kSwapCount = 200000;
+    static const int kReaderCount = 4;
+    std::vector< Object* > objects;
+    for( int i = 0; i <= kSwapCount; i++ )
+        objects.push_back( new Object() );
+
+    std::atomic< Object* > current{ objects[ 0 ] };
+    std::atomic< bool > done{ false };
+    std::atomic< int > deadCount{ 0 };
+    std::atomic< int > readCount{ 0 };
+
+    std::vector< std::thread > readers;
+    for( int i = 0; i < kReaderCount; i++ )
+    {
+        readers.emplace_back( [&]() {
+            while( done == false )
+            {
+                Epoch::Guard guard;
+                Object* object = current.load();
+                for( int spin = 0; spin < 16; spin++ )
+                {
+                    if( object->alive.load() == false )
+                        deadCount++;
+                }
+                readCount++;
+            }
+        });
+    }
+
+    for( int i = 1; i <= kSwapCount; i++ )
+    {
+        Object* old = current.exchange( objects[ i ] );
+        Epoch::retire( [old]() { old->alive = false; } );
+    }
+    done = true;
+    for( std::thread& reader : readers )
+        reader.join();
+
+    CHECK( deadCount == 0 );
+    CHECK( readCount > 0 );
+    CHECK( Epoch::reclaim() == 0 );
+
+    int reclaimedCount = 0;
+    for( Object* object : objects )
+    {
+        reclaimedCount += ( object->alive == false ) ? 1 : 0;
+        delete object;
+    }
+    CHECK( reclaimedCount == kSwapCount );
+}
+
+int main()
+{
+    testNoReaders();
+    testReaderFromBefore();
+    testReaderFromAfter();
+    testOrder();
+    testNesting();
+    testSwapping();
+
+    printf( gFailureCount == 0 ? "All passed\n" : "%d checks failed\n", gFailureCount );
+    return ( gFailureCount == 0 ) ? 0 : 1;
+}
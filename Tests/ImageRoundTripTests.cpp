@@ -0,0 +1,293 @@
+//
+//  ImageRoundTripTests.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+//  Writes images with ImageExporter and reads them back: PFM and EXR have to
+//  come back bit for bit, PNG within its 8-bit gamma encoding. Sizes are picked
+//  so strips don't divide the image evenly. The files are parsed here, which
+//  also checks the stitched PNG stream and the EXR header are well formed.
+//
+//  Build, from the repository root:
+//    c++ -std=gnu++14 -O2 -IRaytracer/Raytracer Tests/ImageRoundTripTests.cpp Raytracer/Raytracer/ImageExporter.cpp -lz -o image_tests
+//
+//  Run:
+//    ./image_tests [scratch directory, /tmp by default]
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "ImageExporter.h"
+
+static int gFailureCount = 0;
+
+#define CHECK( condition ) \
+    do { if( !( condition ) ) { printf( "  FAILED line %d: %s\n", __LINE__, #condition ); gFailureCount++; } } while( 0 )
+
+// Gradients, values past 1 (and a sun's worth), and a few tiny ones
+static std::shared_ptr< ExportImage > makeImage(int2 resolution)
+{
+    std::shared_ptr< ExportImage > image = std::make_shared< ExportImage >();
+    image->resolution = resolution;
+    image->pixels.resize( (size_t)resolution.x * resolution.y * 3 );
+    for( int y = 0; y < resolution.y; y++ )
+    {
+        for( int x = 0; x < resolution.x; x++ )
+        {
+            float* pixel = &image->pixels[ ( (size_t)y * resolution.x + x ) * 3 ];
+            pixel[ 0 ] = (float)x / resolution.x;
+            pixel[ 1 ] = (float)y / resolution.y * 2.0f;
+            pixel[ 2 ] = ( x == y ) ? 50000.0f : 1e-6f * ( x + y );
+        }
+    }
+    return image;
+}
+
+static bool exportAndWait(ImageExporter& exporter, std::shared_ptr< ExportImage > image, const std::string& path, ImageExporter::Format format)
+{
+    bool written = false;
+    exporter.exportImage( image, path, format, false, [&written](bool success) { written = success; } );
+    exporter.waitUntilIdle();
+    return written;
+}
+
+static bool readFile(const std::string& path, std::vector< uint8_t >* bytes)
+{
+    FILE* file = fopen( path.c_str(), "rb" );
+    if( file == nullptr )
+        return false;
+    fseek( file, 0, SEEK_END );
+    bytes->resize( ftell( file ) );
+    fseek( file, 0, SEEK_SET );
+    const bool read = ( fread( bytes->data(), 1, bytes->size(), file ) == bytes->size() );
+    fclose( file );
+    return read;
+}
+
+template< typename T >
+static T readValue(const std::vector< uint8_t >& bytes, size_t offset)
+{
+    T value;
+    memcpy( &value, &bytes[ offset ], sizeof( T ) );
+    return value;
+}
+
+static uint32_t readBigEndian(const std::vector< uint8_t >& bytes, size_t offset)
+{
+    return ( (uint32_t)bytes[ offset ] << 24 ) | ( (uint32_t)bytes[ offset + 1 ] << 16 ) | ( (uint32_t)bytes[ offset + 2 ] << 8 ) | bytes[ offset + 3 ];
+}
+
+// Little-endian PFM, rows bottom to top; pixels come out top to bottom
+static bool readPFM(const std::string& path, int2* resolution, std::vector< float >* pixels)
+{
+    std::vector< uint8_t > bytes;
+    if( readFile( path, &bytes ) == false )
+        return false;
+
+    int width = 0, height = 0, length = 0;
+    float scale = 0;
+    bytes.push_back( 0 );
+    if( sscanf( (const char*)bytes.data(), "PF\n%d %d\n%f\n%n", &width, &height, &scale, &length ) != 3 || length == 0 || scale >= 0 )
+        return false;
+    bytes.pop_back();
+
+    const size_t rowFloats = (size_t)width * 3;
+    if( bytes.size() != length + rowFloats * height * sizeof( float ) )
+        return false;
+
+    *resolution = simd_make_int2( width, height );
+    pixels->resize( rowFloats * height );
+    for( int y = 0; y < height; y++ )
+        memcpy( &(*pixels)[ y * rowFloats ], &bytes[ length + ( height - 1 - y ) * rowFloats * sizeof( float ) ], rowFloats * sizeof( float ) );
+    return true;
+}
+
+// 8-bit RGB PNG, rows filtered with None or Sub (all the exporter writes); raw
+// bytes back as 0-1
+static bool readPNG(const std::string& path, int2* resolution, std::vector< float >* pixels)
+{
+    std::vector< uint8_t > bytes;
+    if( readFile( path, &bytes ) == false || bytes.size() < 8 + 25 || memcmp( bytes.data(), "\x89PNG\r\n\x1a\n", 8 ) != 0 )
+        return false;
+
+    // Chunks: length, type, data, CRC; each CRC is checked
+    int width = 0, height = 0;
+    std::vector< uint8_t > compressed;
+    size_t offset = 8;
+    while( offset + 12 <= bytes.size() )
+    {
+        const uint32_t length = readBigEndian( bytes, offset );
+        if( length > bytes.size() - offset - 12 )
+            return false;
+
+        const std::string type( (const char*)&bytes[ offset + 4 ], 4 );
+        const uint8_t* data = &bytes[ offset + 8 ];
+        if( crc32( crc32( 0, nullptr, 0 ), &bytes[ offset + 4 ], length + 4 ) != readBigEndian( bytes, offset + 8 + length ) )
+            return false;
+
+        if( type == "IHDR" )
+        {
+            width = (int)readBigEndian( bytes, offset + 8 );
+            height = (int)readBigEndian( bytes, offset + 12 );
+            if( data[ 8 ] != 8 || data[ 9 ] != 2 || data[ 12 ] != 0 )
+                return false;
+        }
+        else if( type == "IDAT" )
+        {
+            compressed.insert( compressed.end(), data, data + length );
+        }
+        offset += 12 + length;
+    }
+
+    const size_t rowBytes = 1 + (size_t)width * 3;
+    std::vector< uint8_t > raw( rowBytes * height );
+    uLongf rawSize = raw.size();
+    if( width <= 0 || height <= 0 || uncompress( raw.data(), &rawSize, compressed.data(), compressed.size() ) != Z_OK || rawSize != raw.size() )
+        return false;
+
+    *resolution = simd_make_int2( width, height );
+    pixels->resize( (size_t)width * height * 3 );
+    for( int y = 0; y < height; y++ )
+    {
+        uint8_t* row = &raw[ y * rowBytes ];
+        if( row[ 0 ] > 1 )
+            return false;
+        for( int i = 0; i < width * 3; i++ )
+        {
+            if( row[ 0 ] == 1 && i >= 3 )
+                row[ 1 + i ] += row[ 1 + i - 3 ];
+            (*pixels)[ (size_t)y * width * 3 + i ] = row[ 1 + i ] / 255.0f;
+        }
+    }
+    return true;
+}
+
+static void testPFM(ImageExporter& exporter, const std::string& directory, int2 resolution)
+{
+    printf( "PFM %dx%d\n", resolution.x, resolution.y );
+    std::shared_ptr< ExportImage > image = makeImage( resolution );
+    const std::string path = directory + "/roundtrip.pfm";
+    CHECK( exportAndWait( exporter, image, path, ImageExporter::FormatPFM ) );
+
+    int2 loadedResolution = simd_make_int2( 0, 0 );
+    std::vector< float > pixels;
+    CHECK( readPFM( path, &loadedResolution, &pixels ) );
+    CHECK( loadedResolution.x == resolution.x && loadedResolution.y == resolution.y );
+    CHECK( pixels == image->pixels );
+    remove( path.c_str() );
+}
+
+static void testPNG(ImageExporter& exporter, const std::string& directory, int2 resolution)
+{
+    printf( "PNG %dx%d\n", resolution.x, resolution.y );
+    std::shared_ptr< ExportImage > image = makeImage( resolution );
+    const std::string path = directory + "/roundtrip.png";
+    CHECK( exportAndWait( exporter, image, path, ImageExporter::FormatPNG ) );
+
+    // Raw 8-bit values back, so compare in the exporter's sqrt encoding
+    int2 loadedResolution = simd_make_int2( 0, 0 );
+    std::vector< float > pixels;
+    CHECK( readPNG( path, &loadedResolution, &pixels ) );
+    CHECK( loadedResolution.x == resolution.x && loadedResolution.y == resolution.y );
+    CHECK( pixels.size() == image->pixels.size() );
+
+    int mismatchCount = 0;
+    for( size_t i = 0; i < pixels.size() && pixels.size() == image->pixels.size(); i++ )
+    {
+        const float expected = std::min( sqrtf( image->pixels[ i ] ), 1.0f );
+        if( fabsf( pixels[ i ] - expected ) > 1.0f / 255.0f + 1e-6f )
+            mismatchCount++;
+    }
+    CHECK( mismatchCount == 0 );
+    remove( path.c_str() );
+}
+
+static void testEXR(ImageExporter& exporter, const std::string& directory, int2 resolution)
+{
+    printf( "EXR %dx%d\n", resolution.x, resolution.y );
+    std::shared_ptr< ExportImage > image = makeImage( resolution );
+    const std::string path = directory + "/roundtrip.exr";
+    CHECK( exportAndWait( exporter, image, path, ImageExporter::FormatEXR ) );
+
+    std::vector< uint8_t > bytes;
+    CHECK( readFile( path, &bytes ) );
+    remove( path.c_str() );
+    if( bytes.size() < 8 )
+        return;
+    CHECK( readValue< uint32_t >( bytes, 0 ) == 20000630 );
+
+    // Attributes: name, type, size, value; an empty name ends them
+    size_t offset = 8;
+    int32_t window[ 4 ] = { -1, -1, -1, -1 };
+    int compression = -1;
+    while( offset < bytes.size() && bytes[ offset ] != 0 )
+    {
+        const std::string name = (const char*)&bytes[ offset ];
+        offset += name.size() + 1;
+        const std::string type = (const char*)&bytes[ offset ];
+        offset += type.size() + 1;
+        const int32_t size = readValue< int32_t >( bytes, offset );
+        offset += 4;
+        if( name == "dataWindow" && size == 16 )
+            memcpy( window, &bytes[ offset ], 16 );
+        if( name == "compression" && size == 1 )
+            compression = bytes[ offset ];
+        offset += size;
+    }
+    offset++;
+    CHECK( compression == 0 );
+    CHECK( window[ 0 ] == 0 && window[ 1 ] == 0 && window[ 2 ] == resolution.x - 1 && window[ 3 ] == resolution.y - 1 );
+
+    // One chunk per scanline: y, byte count, then the B, G and R planes
+    const size_t lineBytes = (size_t)resolution.x * 3 * sizeof( float );
+    int mismatchCount = 0;
+    for( int line = 0; line < resolution.y; line++ )
+    {
+        const uint64_t chunk = readValue< uint64_t >( bytes, offset + line * sizeof( uint64_t ) );
+        if( chunk + 8 + lineBytes > bytes.size() || readValue< int32_t >( bytes, chunk ) != line ||
+            readValue< int32_t >( bytes, chunk + 4 ) != (int32_t)lineBytes )
+        {
+            mismatchCount++;
+            continue;
+        }
+
+        for( int x = 0; x < resolution.x; x++ )
+        {
+            const float* expected = &image->pixels[ ( (size_t)line * resolution.x + x ) * 3 ];
+            for( int plane = 0; plane < 3; plane++ )
+            {
+                const float value = readValue< float >( bytes, chunk + 8 + ( (size_t)plane * resolution.x + x ) * sizeof( float ) );
+                if( value != expected[ 2 - plane ] )
+                    mismatchCount++;
+            }
+        }
+    }
+    CHECK( mismatchCount == 0 );
+}
+
+int main(int argc, const char* argv[])
+{
+    const std::string directory = ( argc > 1 ) ? argv[ 1 ] : "/tmp";
+
+    // Small strips, so every image is several and the last one is short
+    ImageExporter::Options options;
+    options.stripHeight = 16;
+    ImageExporter exporter( options );
+
+    for( int2 resolution : { simd_make_int2( 1, 1 ), simd_make_int2( 131, 77 ), simd_make_int2( 640, 33 ) } )
+    {
+        testPFM( exporter, directory, resolution );
+        testPNG( exporter, directory, resolution );
+        testEXR( exporter, directory, resolution );
+    }
+
+    printf( gFailureCount == 0 ? "All passed\n" : "%d checks failed\n", gFailureCount );
+    return ( gFailureCount == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+//
+//  RenderFrameTests.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+//  Checks the interactive frame flow: a render or frame that gets cancelled
+//  still completes, and renderFrameAsync() starts the next frame from there and
+//  renders all of it, as many times over as it's cancelled.
+//
+//  Build, from the repository root (macOS; Raytracer.cpp needs CoreGraphics):
+//    c++ -std=gnu++14 -O2 -IRaytracer/Raytracer Tests/RenderFrameTests.cpp Raytracer/Raytracer/[A-Z]*.cpp -framework CoreGraphics -lz -o frame_tests
+//
+//  Run:
+//    ./frame_tests
+//
+
+#include <cstdio>
+
+#include "Raytracer.h"
+
+static int gFailureCount = 0;
+
+#define CHECK( condition ) \
+    do { if( !( condition ) ) { printf( "  FAILED line %d: %s\n", __LINE__, #condition ); gFailureCount++; } } while( 0 )
+
+// Inside a glowing sphere, so every finished pixel is lit
+static Scene makeScene()
+{
+    Scene scene;
+    Sphere* sky = new Sphere( 50 );
+    sky->setMaterial( new DiffuseLightMaterial( simd_make_float3( 0.5, 0.5, 0.5 ) ) );
+    Sphere* sphere = new Sphere( 1 );
+    scene.shapes = { sky, sphere };
+    return scene;
+}
+
+static Camera cameraAt(float x)
+{
+    Camera camera( simd_make_int2( 64, 48 ), simd_make_float3( x, 0, 5 ), simd_make_float3( 0, 0, 0 ), simd_make_float3( 0, 1, 0 ), 40, 0, 5 );
+    camera.setSampleCount( 16 );
+    camera.setMaxBounceCount( 3 );
+    return camera;
+}
+
+// Waits, then whether it finished: the final image is only made once complete
+static bool finish(Raytracer& raytracer)
+{
+    raytracer.waitUntilComplete();
+    CGImageRef image = raytracer.copyRenderImage();
+    if( image != nullptr )
+        CGImageRelease( image );
+    return raytracer.isComplete();
+}
+
+static int unlitPixelCount(const Raytracer& raytracer)
+{
+    int count = 0;
+    for( int y = 0; y < 48; y++ )
+    {
+        for( int x = 0; x < 64; x++ )
+        {
+            const float3 color = raytracer.framebuffer().pixel( x, y );
+            count += ( color.x + color.y + color.z <= 0 ) ? 1 : 0;
+        }
+    }
+    return count;
+}
+
+static void testFrameAfterCancel()
+{
+    printf( "Frame after a cancelled render\n" );
+    Scene scene = makeScene();
+    Raytracer raytracer( cameraAt( 0 ), scene );
+    raytracer.renderAsync();
+    raytracer.cancel();
+    CHECK( finish( raytracer ) );
+
+    CHECK( raytracer.renderFrameAsync( cameraAt( 0.1f ) ) );
+    CHECK( finish( raytracer ) );
+    CHECK( unlitPixelCount( raytracer ) == 0 );
+}
+
+static void testRepeatedCancels()
+{
+    printf( "Frames cancelled over and over\n" );
+    Scene scene = makeScene();
+    Raytracer raytracer( cameraAt( 0 ), scene );
+    raytracer.renderAsync();
+    CHECK( finish( raytracer ) );
+
+    // Each cancelled frame mid-flight, then one left to finish
+    for( int frame = 1; frame <= 5; frame++ )
+    {
+        CHECK( raytracer.renderFrameAsync( cameraAt( frame * 0.1f ) ) );
+        raytracer.cancel();
+        CHECK( finish( raytracer ) );
+    }
+    CHECK( raytracer.renderFrameAsync( cameraAt( 0.6f ) ) );
+    CHECK( finish( raytracer ) );
+    CHECK( unlitPixelCount( raytracer ) == 0 );
+}
+
+int main()
+{
+    testFrameAfterCancel();
+    testRepeatedCancels();
+
+    printf( gFailureCount == 0 ? "All passed\n" : "%d checks failed\n", gFailureCount );
+    return ( gFailureCount == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,354 @@
+//
+//  Benchmarks.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+//  Renders the scenes behind the numbers quoted in the README and prints the
+//  same comparisons, so they can be checked on other machines (times depend on
+//  the core count; the error and pixel counts shouldn't much). References are
+//  rendered at high sample counts first, so the full run takes minutes.
+//
+//  Build, from the repository root (macOS; Raytracer.cpp needs CoreGraphics):
+//    c++ -std=gnu++14 -O2 -IRaytracer/Raytracer Tools/Benchmarks.cpp Raytracer/Raytracer/[A-Z]*.cpp -framework CoreGraphics -lz -o rtbench
+//
+//  Run:
+//    ./rtbench [guiding|caustics|invalidation|temporal|focus|all]
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Raytracer.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration< double >( Clock::now() - start ).count();
+}
+
+static std::vector< float > finish(Raytracer& raytracer)
+{
+    raytracer.waitUntilComplete();
+    return raytracer.copyLinearImage()->pixels;
+}
+
+// Values clamped at a few times white, so a handful of fireflies don't decide it
+static double clampedError(const std::vector< float >& image, const std::vector< float >& reference)
+{
+    double error = 0;
+    for( size_t i = 0; i < image.size(); i++ )
+    {
+        const double difference = std::min( image[ i ], 4.0f ) - std::min( reference[ i ], 4.0f );
+        error += difference * difference;
+    }
+    return sqrt( error / image.size() );
+}
+
+#pragma mark Path Guiding
+
+// A closed room (the camera's inside a sphere) lit by a small emitter behind a
+// blocker, so diffuse bounces rarely find it unguided
+static Scene makeRoomScene()
+{
+    Scene scene;
+    Sphere* room = new Sphere( 8 );
+    Sphere* light = new Sphere( 0.3 );
+    light->setPosition( simd_make_float3( 0, 6.5, -4 ) );
+    light->setMaterial( new DiffuseLightMaterial( simd_make_float3( 200, 200, 200 ) ) );
+    Sphere* blocker = new Sphere( 1.5 );
+    blocker->setPosition( simd_make_float3( 0, 5, -3.5 ) );
+    Sphere* sphere = new Sphere( 1 );
+    sphere->setPosition( simd_make_float3( 0, -0.5, -1 ) );
+    scene.shapes = { room, light, blocker, sphere };
+    return scene;
+}
+
+static void benchmarkGuiding()
+{
+    printf( "Path guiding: closed room, hidden emitter, 200x150, 256 spp\n" );
+    const Scene scene = makeRoomScene();
+    Camera camera( simd_make_int2( 200, 150 ), simd_make_float3( 0, 0, 3 ), simd_make_float3( 0, 0, 0 ), simd_make_float3( 0, 1, 0 ), 60, 0, 3 );
+    camera.setSampleCount( 256 );
+    camera.setMaxBounceCount( 6 );
+
+    // Variance from the difference of two independent renders, clamped at white
+    double variances[ 2 ];
+    for( int guided = 0; guided < 2; guided++ )
+    {
+        std::vector< float > images[ 2 ];
+        const Clock::time_point start = Clock::now();
+        for( std::vector< float >& image : images )
+        {
+            Raytracer raytracer( camera, scene );
+            raytracer.setPathGuidingEnabled( guided == 1 );
+            raytracer.renderAsync();
+            image = finish( raytracer );
+        }
+
+        double variance = 0;
+        for( size_t i = 0; i < images[ 0 ].size(); i++ )
+        {
+            const double difference = std::min( images[ 0 ][ i ], 1.0f ) - std::min( images[ 1 ][ i ], 1.0f );
+            variance += difference * difference * 0.5;
+        }
+        variances[ guided ] = variance / images[ 0 ].size();
+        printf( "  %s: pixel variance %.6f, %.2fs a render\n", guided ? "guided" : "unguided", variances[ guided ], secondsSince( start ) / 2 );
+    }
+    printf( "  variance cut %.1fx\n", variances[ 0 ] / variances[ 1 ] );
+}
+
+#pragma mark Caustics
+
+static void benchmarkCaustics()
+{
+    printf( "Caustic photons: glass sphere under a small light, 288x192, 64 spp against 4096\n" );
+    Scene scene;
+    Sphere* ground = new Sphere( 1000 );
+    ground->setPosition( simd_make_float3( 0, -1000, 0 ) );
+    ground->setMaterial( new LambertianMaterial( simd_make_float3( 0.5, 0.5, 0.5 ) ) );
+    Sphere* glass = new Sphere( 1 );
+    glass->setPosition( simd_make_float3( 0, 1, 0 ) );
+    glass->setMaterial( new DielectricMaterial( 1.5 ) );
+    Sphere* light = new Sphere( 0.3 );
+    light->setPosition( simd_make_float3( 0.3, 4, -0.3 ) );
+    light->setMaterial( new DiffuseLightMaterial( simd_make_float3( 40, 40, 40 ) ) );
+    Sphere* mirror = new Sphere( 0.6 );
+    mirror->setPosition( simd_make_float3( -2, 0.6, 0 ) );
+    mirror->setMaterial( new MetalMaterial( simd_make_float3( 0.8, 0.8, 0.8 ), 0 ) );
+    scene.shapes = { ground, glass, light, mirror };
+
+    Camera camera( simd_make_int2( 288, 192 ), simd_make_float3( 0, 4, 6 ), simd_make_float3( 0, 0.2, 0 ), simd_make_float3( 0, 1, 0 ), 40, 0, 6 );
+    camera.setMaxBounceCount( 8 );
+
+    camera.setSampleCount( 4096 );
+    Raytracer referenceRaytracer( camera, scene );
+    referenceRaytracer.renderAsync();
+    const std::vector< float > reference = finish( referenceRaytracer );
+
+    camera.setSampleCount( 64 );
+    for( int photons = 0; photons < 2; photons++ )
+    {
+        Raytracer raytracer( camera, scene );
+        raytracer.setCausticPhotonsEnabled( photons == 1 );
+        const Clock::time_point start = Clock::now();
+        raytracer.renderAsync();
+        const std::vector< float > image = finish( raytracer );
+        const double seconds = secondsSince( start );
+
+        // Just the lit pixels of the caustic under the sphere
+        double error = 0;
+        int count = 0;
+        for( int y = 60; y < 100; y++ )
+        {
+            for( int x = 100; x < 200; x++ )
+            {
+                const size_t i = ( (size_t)y * 288 + x ) * 3;
+                if( reference[ i ] > 0.3f )
+                {
+                    error += ( image[ i ] - reference[ i ] ) * ( image[ i ] - reference[ i ] );
+                    count++;
+                }
+            }
+        }
+        printf( "  %s: caustic error %.3f over %d pixels, %.2fs\n", photons ? "photons" : "paths only", sqrt( error / count ), count, seconds );
+    }
+}
+
+#pragma mark First Hit Invalidation
+
+static void benchmarkInvalidation()
+{
+    printf( "First hit cache: grid of 480 spheres, 200x150, edit one sphere's material\n" );
+    Scene scene;
+    for( int y = 0; y < 20; y++ )
+    {
+        for( int x = 0; x < 24; x++ )
+        {
+            Sphere* sphere = new Sphere( 0.25 );
+            sphere->setPosition( simd_make_float3( -6 + x * 0.5, -5 + y * 0.5, 0 ) );
+            scene.shapes.push_back( sphere );
+        }
+    }
+    scene.environment = new EnvironmentMap( simd_make_int2( 4, 2 ), std::vector< float >( 24, 1.0f ) );
+
+    Camera camera( simd_make_int2( 200, 150 ), simd_make_float3( 0, 0, 12 ), simd_make_float3( 0, 0, 0 ), simd_make_float3( 0, 1, 0 ), 60, 0, 12 );
+    camera.setSampleCount( 4 );
+    camera.setMaxBounceCount( 3 );
+
+    for( int scope = 0; scope < 2; scope++ )
+    {
+        Raytracer raytracer( camera, scene );
+        raytracer.setFirstHitCacheEnabled( true, scope ? Raytracer::InvalidateWholePaths : Raytracer::InvalidatePrimaryHits );
+        raytracer.renderAsync();
+        raytracer.waitUntilComplete();
+
+        const int shapeIndex = 250;
+        int firstHitCount = 0;
+        for( int y = 0; y < 150; y++ )
+        {
+            for( int x = 0; x < 200; x++ )
+                firstHitCount += ( raytracer.firstHitCache()->record( x, y ).shape == shapeIndex ) ? 1 : 0;
+        }
+        const int flaggedCount = raytracer.invalidateMaterial( scene.shapes[ shapeIndex ]->material() );
+        printf( "  %s: first hit of %d pixels, material edit flags %d\n", scope ? "whole paths" : "primary hits", firstHitCount, flaggedCount );
+    }
+}
+
+#pragma mark Temporal Reuse
+
+static Camera orbitCamera(int frame, int sampleCount)
+{
+    const float angle = frame * 0.01f;
+    Camera camera( simd_make_int2( 160, 100 ), simd_make_float3( 8 * sin( angle ), 2.5, 8 * cos( angle ) ), simd_make_float3( 0, 1, 0 ), simd_make_float3( 0, 1, 0 ), 40, 0, 8 );
+    camera.setSampleCount( sampleCount );
+    camera.setMaxBounceCount( 6 );
+    return camera;
+}
+
+static void benchmarkTemporal()
+{
+    printf( "Temporal reuse: orbiting at 4 spp a frame, 160x100, against 512 spp\n" );
+    Scene scene;
+    Sphere* ground = new Sphere( 1000 );
+    ground->setPosition( simd_make_float3( 0, -1000, 0 ) );
+    Sphere* red = new Sphere( 1 );
+    red->setPosition( simd_make_float3( 0, 1, 0 ) );
+    red->setMaterial( new LambertianMaterial( simd_make_float3( 0.8, 0.3, 0.3 ) ) );
+    Sphere* light = new Sphere( 0.5 );
+    light->setPosition( simd_make_float3( 1, 3, 1 ) );
+    light->setMaterial( new DiffuseLightMaterial( simd_make_float3( 10, 10, 10 ) ) );
+    Sphere* metal = new Sphere( 1 );
+    metal->setPosition( simd_make_float3( 2.2, 1, 0 ) );
+    metal->setMaterial( new MetalMaterial( simd_make_float3( 0.8, 0.8, 0.8 ), 0.3 ) );
+    Sphere* blue = new Sphere( 1 );
+    blue->setPosition( simd_make_float3( -2.2, 1, 0 ) );
+    blue->setMaterial( new LambertianMaterial( simd_make_float3( 0.3, 0.3, 0.8 ) ) );
+    scene.shapes = { ground, red, light, metal, blue };
+    scene.bvh = std::make_shared< BVH >( scene.shapes );
+
+    const int frameCount = 16;
+    std::vector< std::vector< float > > references;
+    for( int frame = 0; frame < frameCount; frame++ )
+    {
+        Raytracer raytracer( orbitCamera( frame, 512 ), scene );
+        raytracer.renderAsync();
+        references.push_back( finish( raytracer ) );
+    }
+
+    for( int reuse = 0; reuse < 2; reuse++ )
+    {
+        Raytracer raytracer( orbitCamera( 0, 4 ), scene );
+        raytracer.setTemporalReuseEnabled( reuse == 1 );
+        raytracer.renderAsync();
+        double error = 0;
+        for( int frame = 0; frame < frameCount; frame++ )
+        {
+            if( frame > 0 )
+                raytracer.renderFrameAsync( orbitCamera( frame, 4 ) );
+            const std::vector< float > image = finish( raytracer );
+            if( frame == frameCount - 1 )
+                error = clampedError( image, references[ frame ] );
+        }
+        printf( "  %s: error after %d frames %.3f\n", reuse ? "reused" : "fresh", frameCount, error );
+    }
+}
+
+#pragma mark Focus
+
+static void benchmarkFocus()
+{
+    printf( "Focus: 320x200, 32 spp, time until a 20 pixel region is done\n" );
+    Scene scene;
+    Sphere* ground = new Sphere( 1000 );
+    ground->setPosition( simd_make_float3( 0, -1000, 0 ) );
+    Sphere* red = new Sphere( 1 );
+    red->setPosition( simd_make_float3( 0, 1, 0 ) );
+    red->setMaterial( new LambertianMaterial( simd_make_float3( 0.8, 0.3, 0.3 ) ) );
+    Sphere* light = new Sphere( 0.5 );
+    light->setPosition( simd_make_float3( 1, 3, 1 ) );
+    light->setMaterial( new DiffuseLightMaterial( simd_make_float3( 10, 10, 10 ) ) );
+    Sphere* metal = new Sphere( 1 );
+    metal->setPosition( simd_make_float3( 4, 1, 0 ) );
+    metal->setMaterial( new MetalMaterial( simd_make_float3( 0.8, 0.8, 0.8 ), 0.3 ) );
+    Sphere* sky = new Sphere( 500 );
+    sky->setMaterial( new DiffuseLightMaterial( simd_make_float3( 0.3, 0.3, 0.4 ) ) );
+    scene.shapes = { ground, red, light, metal, sky };
+    scene.bvh = std::make_shared< BVH >( scene.shapes );
+
+    Camera camera( simd_make_int2( 320, 200 ), simd_make_float3( 0, 2.5, 9 ), simd_make_float3( 1, 1, 0 ), simd_make_float3( 0, 1, 0 ), 40, 0, 9 );
+    camera.setSampleCount( 32 );
+    camera.setMaxBounceCount( 6 );
+
+    float2 metalUV, redUV;
+    camera.project( metal->position(), &metalUV );
+    camera.project( red->position(), &redUV );
+    const int2 metalPixel = simd_make_int2( metalUV.x * 320, metalUV.y * 200 );
+    const int2 redPixel = simd_make_int2( redUV.x * 320, redUV.y * 200 );
+
+    // Done once every pixel within 20 of the center has its samples (none are black)
+    auto regionDone = [](Raytracer& raytracer, int2 center) {
+        for( int y = center.y - 20; y <= center.y + 20; y++ )
+        {
+            for( int x = center.x - 20; x <= center.x + 20; x++ )
+            {
+                const float3 pixel = raytracer.framebuffer().pixel( x, y );
+                if( ( x - center.x ) * ( x - center.x ) + ( y - center.y ) * ( y - center.y ) <= 400 && pixel.x == 0 && pixel.y == 0 && pixel.z == 0 )
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    for( int mode = 0; mode < 3; mode++ )
+    {
+        Raytracer raytracer( camera, scene );
+        if( mode > 0 )
+            raytracer.setFocusPoint( metalPixel, 20 );
+
+        const Clock::time_point start = Clock::now();
+        raytracer.renderAsync();
+        const int2 target = ( mode == 2 ) ? redPixel : metalPixel;
+        bool refocused = false;
+        while( regionDone( raytracer, target ) == false )
+        {
+            if( mode == 2 && refocused == false && secondsSince( start ) > 0.05 )
+            {
+                raytracer.setFocusPoint( redPixel, 20 );
+                refocused = true;
+            }
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+        const double regionSeconds = secondsSince( start );
+        raytracer.waitUntilComplete();
+
+        const char* names[] = { "no focus", "focused", "refocused mid-render" };
+        printf( "  %s: region done in %.2fs, frame in %.2fs\n", names[ mode ], regionSeconds, secondsSince( start ) );
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* which = ( argc > 1 ) ? argv[ 1 ] : "all";
+    const bool all = ( strcmp( which, "all" ) == 0 );
+    bool ran = false;
+
+    if( all || strcmp( which, "guiding" ) == 0 ) { benchmarkGuiding(); ran = true; }
+    if( all || strcmp( which, "caustics" ) == 0 ) { benchmarkCaustics(); ran = true; }
+    if( all || strcmp( which, "invalidation" ) == 0 ) { benchmarkInvalidation(); ran = true; }
+    if( all || strcmp( which, "temporal" ) == 0 ) { benchmarkTemporal(); ran = true; }
+    if( all || strcmp( which, "focus" ) == 0 ) { benchmarkFocus(); ran = true; }
+
+    if( ran == false )
+    {
+        printf( "Usage: %s [guiding|caustics|invalidation|temporal|focus|all]\n", argv[ 0 ] );
+        return 1;
+    }
+    return 0;
+}
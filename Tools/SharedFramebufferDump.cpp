@@ -0,0 +1,214 @@
+//
+//  SharedFramebufferDump.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+//  Reference client for SharedFramebuffer: maps a running render's segment
+//  read-only and writes a PNG snapshot whenever tiles changed, at most once per
+//  interval, until the render completes or goes away. Only changed tiles are
+//  copied out of the segment; a tile caught mid-publish is read again next time.
+//
+//  Build, from the repository root:
+//    c++ -std=gnu++14 -O2 -IRaytracer/Raytracer Tools/SharedFramebufferDump.cpp Raytracer/Raytracer/ImageExporter.cpp -lz -o shmdump
+//
+//  Run:
+//    ./shmdump /raytracer /tmp/live_%04d.png 2
+//
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "ImageExporter.h"
+#include "SharedFramebuffer.h"
+
+// Waits up to timeout for the renderer to create the segment
+static const uint8_t* mapSegment(const char* name, size_t* size, double timeoutSeconds)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration< double >( timeoutSeconds );
+    while( true )
+    {
+        int fd = shm_open( name, O_RDONLY, 0 );
+        if( fd >= 0 )
+        {
+            struct stat info;
+            void* base = MAP_FAILED;
+            if( fstat( fd, &info ) == 0 && info.st_size >= (off_t)sizeof( SharedFramebufferHeader ) )
+                base = mmap( nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+            close( fd );
+
+            if( base != MAP_FAILED )
+            {
+                // The magic is written last: once it's there, the header is complete
+                const SharedFramebufferHeader* header = (const SharedFramebufferHeader*)base;
+                if( header->magic == kSharedFramebufferMagic )
+                {
+                    std::atomic_thread_fence( std::memory_order_acquire );
+                    *size = info.st_size;
+                    return (const uint8_t*)base;
+                }
+                munmap( base, info.st_size );
+            }
+        }
+
+        if( std::chrono::steady_clock::now() > deadline )
+            return nullptr;
+        std::this_thread::sleep_for( std::chrono::milliseconds( 250 ) );
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    if( argc < 3 )
+    {
+        printf( "Usage: %s <shm name> <png path format> [interval seconds]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    const char* name = argv[ 1 ];
+    const char* pathFormat = argv[ 2 ];
+    const double interval = ( argc > 3 ) ? atof( argv[ 3 ] ) : 1.0;
+
+    size_t size = 0;
+    const uint8_t* base = mapSegment( name, &size, 30.0 );
+    if( base == nullptr )
+    {
+        printf( "No shared framebuffer named %s\n", name );
+        return 1;
+    }
+
+    const SharedFramebufferHeader* header = (const SharedFramebufferHeader*)base;
+    if( header->version != kSharedFramebufferVersion || header->totalBytes > size )
+    {
+        printf( "Unsupported shared framebuffer (version %u)\n", header->version );
+        return 1;
+    }
+
+    const SharedFramebufferTile* tiles = (const SharedFramebufferTile*)( base + header->tileOffset );
+    const SharedFramebufferSlot* slots = (const SharedFramebufferSlot*)( base + header->slotOffset );
+    const float* pixels = (const float*)( base + header->pixelOffset );
+    const int tileSize = header->tileSize;
+    const int tileCount = header->tileCountX * header->tileCountY;
+    printf( "Mapped %s: %dx%d, %d tiles, %d slots\n", name, header->width, header->height, tileCount, header->slotCount );
+
+    // Our copy of the image, and the tile generations it reflects
+    std::shared_ptr< ExportImage > image = std::make_shared< ExportImage >();
+    image->resolution = simd_make_int2( header->width, header->height );
+    image->pixels.resize( (size_t)header->width * header->height * 3 );
+    std::vector< uint64_t > tileGenerations( tileCount, UINT64_MAX );
+
+    ImageExporter exporter;
+    uint64_t lastGeneration = UINT64_MAX;
+    int snapshotIndex = 0;
+    while( true )
+    {
+        // Read the state first: if it says done, the pixels we copy after are final
+        const uint32_t state = header->state.load( std::memory_order_acquire );
+        const uint64_t generation = header->generation.load( std::memory_order_acquire );
+        if( generation != lastGeneration )
+        {
+            // Stays behind if any tile has to be read again
+            bool complete = true;
+
+            uint64_t sampleCount = 0;
+            int changedTileCount = 0;
+            for( int tileIndex = 0; tileIndex < tileCount; tileIndex++ )
+            {
+                const SharedFramebufferTile& tile = tiles[ tileIndex ];
+                const uint64_t tileSampleCount = tile.sampleCount.load( std::memory_order_relaxed );
+                sampleCount += tileSampleCount;
+
+                const uint64_t tileGeneration = tile.generation.load( std::memory_order_acquire );
+                if( tileGeneration == tileGenerations[ tileIndex ] )
+                    continue;
+
+                const int tileX = tileIndex % header->tileCountX;
+                const int tileY = tileIndex / header->tileCountX;
+                const int width = std::min( tileSize, header->width - tileX * tileSize );
+                const int height = std::min( tileSize, header->height - tileY * tileSize );
+
+                // No slot: never published since the last clear, or evicted and
+                // unchanged since, in which case our copy is as good as it gets
+                const int32_t slot = tile.slot.load( std::memory_order_acquire );
+                if( slot < 0 )
+                {
+                    if( tileSampleCount == 0 )
+                    {
+                        for( int row = 0; row < height; row++ )
+                        {
+                            const int y = tileY * tileSize + row;
+                            memset( image->pixels.data() + ( (size_t)y * header->width + tileX * tileSize ) * 3, 0, width * 3 * sizeof( float ) );
+                        }
+                    }
+                    tileGenerations[ tileIndex ] = tileGeneration;
+                    changedTileCount++;
+                    continue;
+                }
+
+                // Skip slots being written, or just handed to another tile; try again next time round
+                const uint64_t slotState = slots[ slot ].state.load( std::memory_order_acquire );
+                if( ( slotState & kSharedFramebufferSlotTileMask ) != (uint64_t)tileIndex + 1 ||
+                    ( slotState & kSharedFramebufferSlotCopierMask ) != 0 )
+                {
+                    complete = false;
+                    continue;
+                }
+
+                // Tile rows into image rows, same row order as Raytracer::copyLinearImage()
+                const float* source = pixels + (size_t)slot * tileSize * tileSize * 3;
+                for( int row = 0; row < height; row++ )
+                {
+                    const int y = tileY * tileSize + row;
+                    float* destination = image->pixels.data() + ( (size_t)y * header->width + tileX * tileSize ) * 3;
+                    memcpy( destination, source + (size_t)row * tileSize * 3, width * 3 * sizeof( float ) );
+                }
+
+                // The copy only counts if nobody wrote the slot or took it over meanwhile
+                std::atomic_thread_fence( std::memory_order_acquire );
+                if( slots[ slot ].state.load( std::memory_order_relaxed ) != slotState )
+                {
+                    complete = false;
+                    continue;
+                }
+                tileGenerations[ tileIndex ] = tileGeneration;
+                changedTileCount++;
+            }
+            if( complete )
+                lastGeneration = generation;
+
+            if( changedTileCount > 0 )
+            {
+                const double target = (double)header->width * header->height * header->samplesPerPixel;
+                char path[ 1024 ];
+                snprintf( path, sizeof( path ), pathFormat, snapshotIndex++ );
+                printf( "%s: %d tiles changed, %.1f%% of samples\n", path, changedTileCount, ( target > 0 ) ? 100.0 * sampleCount / target : 0.0 );
+
+                // The exporter only reads the image, but we keep writing ours: hand it a copy
+                exporter.exportImage( std::make_shared< ExportImage >( *image ), path, ImageExporter::FormatPNG );
+            }
+        }
+
+        if( state != SharedFramebufferRendering )
+        {
+            printf( ( state == SharedFramebufferComplete ) ? "Render complete\n" : "Renderer closed\n" );
+            break;
+        }
+
+        std::this_thread::sleep_for( std::chrono::duration< double >( interval ) );
+    }
+
+    exporter.waitUntilIdle();
+    munmap( (void*)base, size );
+    return 0;
+}
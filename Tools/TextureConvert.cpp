@@ -0,0 +1,60 @@
+//
+//  TextureConvert.cpp
+//  Raytracer
+//
+//  Created by agent on 10/18/26.
+//  Copyright © 2026 agent. All rights reserved.
+//
+//  Converts images (.png, .hdr, .pfm) to the tiled, mip-mapped .rtex files
+//  Texture::open() reads, ahead of rendering.
+//
+//  Build, from the repository root:
+//    c++ -std=gnu++14 -O2 -IRaytracer/Raytracer Tools/TextureConvert.cpp Raytracer/Raytracer/Texture.cpp Raytracer/Raytracer/TextureCache.cpp Raytracer/Raytracer/ImageLoader.cpp -lz -o rtex
+//
+//  Run:
+//    ./rtex [--data] [--clamp-u] [--clamp-v] [--tile N] input.png output.rtex
+//
+//  --data keeps values as they are (roughness and other non-color maps)
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Texture.h"
+
+int main(int argc, const char* argv[])
+{
+    Texture::ConvertOptions options;
+    const char* paths[ 2 ] = { nullptr, nullptr };
+    int pathCount = 0;
+    for( int i = 1; i < argc; i++ )
+    {
+        if( strcmp( argv[ i ], "--data" ) == 0 )
+            options.srgb = false;
+        else if( strcmp( argv[ i ], "--clamp-u" ) == 0 )
+            options.wrapU = Texture::WrapClamp;
+        else if( strcmp( argv[ i ], "--clamp-v" ) == 0 )
+            options.wrapV = Texture::WrapClamp;
+        else if( strcmp( argv[ i ], "--tile" ) == 0 && i + 1 < argc )
+            options.tileSize = atoi( argv[ ++i ] );
+        else if( pathCount < 2 )
+            paths[ pathCount++ ] = argv[ i ];
+    }
+
+    if( pathCount < 2 )
+    {
+        printf( "Usage: %s [--data] [--clamp-u] [--clamp-v] [--tile N] <image> <output.rtex>\n", argv[ 0 ] );
+        return 1;
+    }
+
+    if( Texture::convert( paths[ 0 ], paths[ 1 ], options ) == false )
+        return 1;
+
+    std::shared_ptr< Texture > texture = Texture::open( paths[ 1 ] );
+    if( texture == nullptr )
+        return 1;
+
+    printf( "%s: %dx%d, %d levels\n", paths[ 1 ], texture->resolution().x, texture->resolution().y, texture->levelCount() );
+    return 0;
+}